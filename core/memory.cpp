@@ -15,6 +15,7 @@
 
 #include "memory.h"
 #include "thread.h"
+#include "debug.h"
 #include "util.h"
 #include "attrs.h"
 
@@ -23,6 +24,8 @@ using namespace zero;
 using namespace zero::memory;
 
 
+#ifndef ZERO_HEAP_TLSF
+
 namespace {
 
     static_assert( PAGE_BYTES > 0, "Pages must have at least one (1) byte each" );
@@ -34,18 +37,31 @@ namespace {
     // The bit mapped page manager
     PageManager<SRAM_PAGES> _sram;
 
+    // the fewest free pages there have been
+    uint16_t _lowestFreePages{ SRAM_PAGES };
+
+    // One bit per page, set for the first page of each allocated block. A block runs
+    // from there over the used pages up to the next block's first page, or a free page,
+    // so free() can work out its size alone.
+    uint8_t _blockStarts[ ROUND_UP( SRAM_PAGES, 8 ) / 8 ];
+
+    #ifdef ZERO_HEAP_ACCOUNTING
+        // the account each block was charged to, kept at its first page
+        uint8_t _owners[ SRAM_PAGES ];
+    #endif
+
 
     // Returns the address for the start of a given page
-    constexpr uint16_t getAddressForPage( const uint16_t pageNumber )
+    constexpr uintptr_t getAddressForPage( const uint16_t pageNumber )
     {
-        return ( (uint16_t) _memoryArea ) + ( pageNumber * PAGE_BYTES );
+        return ( (uintptr_t) _memoryArea ) + ( pageNumber * PAGE_BYTES );
     }
 
 
     // Return the page number for the given SRAM memory address
-    constexpr uint16_t getPageForAddress( const uint16_t address )
+    constexpr uint16_t getPageForAddress( const uintptr_t address )
     {
-        return ( ( address ) - ( (uint16_t) _memoryArea ) ) / PAGE_BYTES;
+        return ( ( address ) - ( (uintptr_t) _memoryArea ) ) / PAGE_BYTES;
     }
 
 
@@ -54,9 +70,44 @@ namespace {
     {
         return ROUND_UP( bytes, PAGE_BYTES ) / PAGE_BYTES;
     }
+
+
+    bool isBlockStart( const uint16_t pageNumber )
+    {
+        return _blockStarts[ pageNumber / 8 ] & ( 1 << ( pageNumber % 8 ) );
+    }
+
+
+    void markBlockStart( const uint16_t pageNumber, const bool isStart )
+    {
+        if ( isStart ) {
+            _blockStarts[ pageNumber / 8 ] |= ( 1 << ( pageNumber % 8 ) );
+        }
+        else {
+            _blockStarts[ pageNumber / 8 ] &= ~( 1 << ( pageNumber % 8 ) );
+        }
+    }
+
+
+    // Returns the number of pages in the allocated block starting at the given page
+    uint16_t getBlockPages( const uint16_t startPage )
+    {
+        uint16_t rc{ 1 };
+
+        while ( startPage + rc < SRAM_PAGES
+            and !_sram.isPageAvailable( startPage + rc )
+            and !isBlockStart( startPage + rc ) )
+        {
+            rc++;
+        }
+
+        return rc;
+    }
     
 }    // namespace
 
+#endif
+
 
 void WEAK onOutOfMemory()
 {
@@ -64,6 +115,82 @@ void WEAK onOutOfMemory()
 }
 
 
+#ifndef ZERO_HEAP_TLSF
+
+namespace {
+
+    // allocateFrom(), charging the block to the given account
+    void* MALLOC allocateFor(
+        const void* const caller,
+        const uint16_t bytesReqd,
+        uint16_t* const allocatedBytes,
+        const SearchStrategy strategy,
+        const uint8_t account )
+    {
+        void* rc{ nullptr };
+
+        #ifndef ZERO_HEAP_ACCOUNTING
+            (void) account;
+        #endif
+
+        if ( allocatedBytes ) {
+            *allocatedBytes = 0;
+        }
+
+        if ( bytesReqd ) {
+            // critical section - one Thread allocating at a time, thank you
+            ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+                const uint16_t numPages{ getNumPagesForBytes( bytesReqd ) };
+                int16_t startPage{ _sram.findFreePages( numPages, strategy ) };
+
+                #ifdef ZERO_HEAP_ACCOUNTING
+                    // going over quota looks just like running out of memory
+                    if ( startPage >= 0 and !charge( account, numPages * PAGE_BYTES ) ) {
+                        startPage = -1;
+                    }
+                #endif
+
+                // if there was a chunk the size we wanted
+                if ( startPage >= 0 ) {
+                    // mark the pages as no longer available
+                    for ( uint16_t curPageNumber = startPage;
+                        curPageNumber < startPage + numPages;
+                        curPageNumber++ )
+                    {
+                        _sram.markAsUsed( curPageNumber );
+                    }
+
+                    markBlockStart( startPage, true );
+                    _lowestFreePages = MIN( _lowestFreePages, _sram.getFreePageCount() );
+
+                    #ifdef ZERO_HEAP_ACCOUNTING
+                        _owners[ startPage ] = account;
+                    #endif
+
+                    // tell the caller how much we gave them
+                    if ( allocatedBytes ) {
+                        *allocatedBytes = numPages * PAGE_BYTES;
+                    }
+
+                    // outta here
+                    rc = (void*) getAddressForPage( startPage );
+
+                    HEAP_TRACE_FROM( caller, Allocate, rc, numPages * PAGE_BYTES );
+                }
+            }
+
+            if ( !rc ) {
+                HEAP_TRACE_FROM( caller, Fail, nullptr, bytesReqd );
+                onOutOfMemory();
+            }
+        }
+
+        return rc;
+    }
+
+}    // namespace
+
+
 /// @brief Allocates a chunk of SRAM.
 /// @param bytesReqd The minimum number of bytes required.
 /// @param allocatedBytes Optional. Default: `nullptr`. A place to store the number
@@ -81,40 +208,224 @@ void* MALLOC memory::allocate(
     uint16_t* const allocatedBytes,
     const SearchStrategy strategy )
 {
-    void* rc{ nullptr };
+    return allocateFrom( HEAP_CALLER, bytesReqd, allocatedBytes, strategy );
+}
+
+
+/// @private
+/// @brief allocate(), traced as called from caller
+void* MALLOC memory::allocateFrom(
+    const void* const caller,
+    const uint16_t bytesReqd,
+    uint16_t* const allocatedBytes,
+    const SearchStrategy strategy )
+{
+    #ifdef ZERO_HEAP_ACCOUNTING
+        const uint8_t account{ getCurrentAccount() };
+    #else
+        const uint8_t account{ 0 };
+    #endif
+
+    return allocateFor( caller, bytesReqd, allocatedBytes, strategy, account );
+}
+
+
+/// @brief Returns a chunk of previously allocated memory to the heap.
+/// @param address The address of the start of the chunk to free, as returned by
+/// allocate() or passed to claim().
+/// @param numBytes Optional. Default: 0. The number of bytes that were asked for. The
+/// heap keeps track of the size of each chunk itself, so this is only used by debug
+/// builds, to check it against the chunk's real size.
+/// @note Freeing anything that isn't the start of an allocated chunk, including freeing
+/// the same chunk twice, does nothing. Debug builds also assert.
+void memory::free( const void* const address, const uint16_t numBytes )
+{
+    freeFrom( HEAP_CALLER, address, numBytes );
+}
+
+
+/// @private
+/// @brief free(), traced as called from caller
+void memory::freeFrom( const void* const caller, const void* const address, const uint16_t numBytes )
+{
+    if ( !address ) return;
+
+    const uint16_t startPage{ getPageForAddress( (uintptr_t) address ) };
+
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( startPage >= SRAM_PAGES
+            or (uintptr_t) address != getAddressForPage( startPage )
+            or !isBlockStart( startPage ) )
+        {
+            dbg_assert( false, "Freeing unallocated memory" );
+            return;
+        }
+
+        const uint16_t numPages{ getBlockPages( startPage ) };
+
+        dbg_assert( !numBytes or getNumPagesForBytes( numBytes ) == numPages, "Free size mismatch" );
+
+        markBlockStart( startPage, false );
+
+        #ifdef ZERO_HEAP_ACCOUNTING
+            refund( _owners[ startPage ], numPages * PAGE_BYTES );
+        #endif
+
+        HEAP_TRACE_FROM( caller, Free, address, numPages * PAGE_BYTES );
+
+        // run from the first page to the last, ensuring the bitmap says 'free'
+        for ( uint16_t curPage = startPage;
+            curPage < startPage + numPages;
+            curPage++ )
+        {
+            _sram.markAsFree( curPage );
+        }
+    }
+}
+
+
+/// @brief Changes the size of a chunk of previously allocated memory
+/// @details Shrinking always happens in place. Growing takes the free pages straight
+/// after the chunk if there are enough, and otherwise also the free pages straight
+/// before it, sliding the contents down. Only if neither is enough is a new chunk
+/// allocated, the contents copied and the old chunk freed.
+/// With heap accounting, the chunk stays charged to the Thread that owns it, even when
+/// another Thread resizes or moves it.
+/// @param address The address of the start of the chunk, as returned by allocate(). If
+/// this is `nullptr`, reallocate() acts like allocate().
+/// @param bytesReqd The minimum number of bytes required. If this is zero (0), the chunk
+/// is freed.
+/// @param allocatedBytes Optional. Default: `nullptr`. A place to store the number
+/// of bytes actually allocated.
+/// @returns The new address of the chunk, or `nullptr` if there wasn't enough memory,
+/// in which case the chunk is left as it was.
+void* memory::reallocate(
+    const void* const address,
+    const uint16_t bytesReqd,
+    uint16_t* const allocatedBytes )
+{
+    if ( !address ) {
+        return allocateFrom( HEAP_CALLER, bytesReqd, allocatedBytes, SearchStrategy::BottomUp );
+    }
 
     if ( allocatedBytes ) {
         *allocatedBytes = 0;
     }
 
-    if ( bytesReqd ) {
-        // critical section - one Thread allocating at a time, thank you
-        ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
-            const uint16_t numPages{ getNumPagesForBytes( bytesReqd ) };
-            const int16_t startPage{ _sram.findFreePages( numPages, strategy ) };
+    if ( !bytesReqd ) {
+        freeFrom( HEAP_CALLER, address, 0 );
+        return nullptr;
+    }
+
+    const uint16_t startPage{ getPageForAddress( (uintptr_t) address ) };
+    const uint16_t numPages{ getNumPagesForBytes( bytesReqd ) };
+    uint16_t oldPages;
+    uint8_t account{ 0 };
+    void* rc{ nullptr };
+
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( startPage >= SRAM_PAGES
+            or (uintptr_t) address != getAddressForPage( startPage )
+            or !isBlockStart( startPage ) )
+        {
+            dbg_assert( false, "Reallocating unallocated memory" );
+            return nullptr;
+        }
+
+        oldPages = getBlockPages( startPage );
+
+        #ifdef ZERO_HEAP_ACCOUNTING
+            account = _owners[ startPage ];
+        #endif
+
+        if ( numPages <= oldPages ) {
+            #ifdef ZERO_HEAP_ACCOUNTING
+                refund( account, ( oldPages - numPages ) * PAGE_BYTES );
+            #endif
+
+            // hand back the pages off the end
+            for ( uint16_t curPage = startPage + numPages;
+                curPage < startPage + oldPages;
+                curPage++ )
+            {
+                _sram.markAsFree( curPage );
+            }
+
+            rc = (void*) address;
+        }
+        else {
+            const uint16_t extraPages{ (uint16_t) ( numPages - oldPages ) };
+            uint16_t above{ 0 };
+            uint16_t below{ 0 };
+
+            // count the free pages after the chunk, then before it, that we could use
+            while ( above < extraPages
+                and startPage + oldPages + above < SRAM_PAGES
+                and _sram.isPageAvailable( startPage + oldPages + above ) )
+            {
+                above++;
+            }
+
+            while ( above + below < extraPages
+                and below < startPage
+                and _sram.isPageAvailable( startPage - below - 1 ) )
+            {
+                below++;
+            }
 
-            // if there was a chunk the size we wanted
-            if ( startPage >= 0 ) {
-                // mark the pages as no longer available
-                for ( uint16_t curPageNumber = startPage;
-                    curPageNumber < startPage + numPages;
-                    curPageNumber++ )
+            bool fits{ above + below == extraPages };
+
+            #ifdef ZERO_HEAP_ACCOUNTING
+                // the block's owner pays for the growth, whoever resizes it
+                fits = fits and charge( account, extraPages * PAGE_BYTES );
+            #endif
+
+            if ( fits ) {
+                const uint16_t newStartPage{ (uint16_t) ( startPage - below ) };
+
+                for ( uint16_t curPage = newStartPage;
+                    curPage < newStartPage + numPages;
+                    curPage++ )
                 {
-                    _sram.markAsUsed( curPageNumber );
+                    _sram.markAsUsed( curPage );
                 }
 
-                // tell the caller how much we gave them
-                if ( allocatedBytes ) {
-                    *allocatedBytes = numPages * PAGE_BYTES;
+                rc = (void*) getAddressForPage( newStartPage );
+
+                if ( below ) {
+                    memmove( rc, address, oldPages * PAGE_BYTES );
+                    markBlockStart( startPage, false );
+                    markBlockStart( newStartPage, true );
+
+                    #ifdef ZERO_HEAP_ACCOUNTING
+                        _owners[ newStartPage ] = account;
+                    #endif
                 }
 
-                // outta here
-                rc = (void*) getAddressForPage( startPage );
+                _lowestFreePages = MIN( _lowestFreePages, _sram.getFreePageCount() );
             }
         }
 
-        if ( !rc ) {
-            onOutOfMemory();
+        #ifdef ZERO_HEAP_TRACE
+            if ( rc ) {
+                HEAP_TRACE( Free, address, oldPages * PAGE_BYTES );
+                HEAP_TRACE( Allocate, rc, numPages * PAGE_BYTES );
+            }
+        #endif
+    }
+
+    if ( rc ) {
+        if ( allocatedBytes ) {
+            *allocatedBytes = numPages * PAGE_BYTES;
+        }
+    }
+    else {
+        // no room to grow where it is - move it, still charged to the block's owner
+        rc = allocateFor( HEAP_CALLER, bytesReqd, allocatedBytes, SearchStrategy::BottomUp, account );
+
+        if ( rc ) {
+            memcpy( rc, address, oldPages * PAGE_BYTES );
+            freeFrom( HEAP_CALLER, address, 0 );
         }
     }
 
@@ -122,38 +433,226 @@ void* MALLOC memory::allocate(
 }
 
 
-/// @brief Returns a chunk of previously allocated memory to the heap.
-/// @param address The address of the start of the chunk to free.
-/// @param numBytes The number of bytes to be freed.
-void memory::free( const void* const address, const uint16_t numBytes )
+/// @brief Allocates a specific chunk of SRAM, if all of it is free.
+/// @param address The address of the start of the chunk, as previously returned by
+/// allocate().
+/// @param numBytes The number of bytes to claim.
+/// @returns `true` if the chunk was free and is now allocated, `false` if any of it is
+/// in use, or it isn't a run of whole pages inside the heap.
+/// @note This is for putting memory back exactly where it was, such as a Thread
+/// stack that still holds pointers into itself. Free the chunk with free(), as usual.
+bool memory::claim( const void* const address, const uint16_t numBytes )
 {
-    if ( !address or !numBytes ) return;
+    if ( !address or !numBytes ) return false;
 
     const uint16_t numPages{ getNumPagesForBytes( numBytes ) };
-    const uint16_t startPage{ getPageForAddress( (uint16_t) address ) };
+    const uint16_t startPage{ getPageForAddress( (uintptr_t) address ) };
 
     ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
-        // run from the first page to the last, ensuring the bitmap says 'free'
+        if ( (uintptr_t) address < (uintptr_t) _memoryArea
+            or startPage >= SRAM_PAGES
+            or numPages > SRAM_PAGES - startPage
+            or (uintptr_t) address != getAddressForPage( startPage ) )
+        {
+            dbg_assert( false, "Claiming memory outside the heap" );
+            return false;
+        }
+
         for ( uint16_t curPage = startPage;
             curPage < startPage + numPages;
             curPage++ )
         {
-            _sram.markAsFree( curPage );
+            if ( !_sram.isPageAvailable( curPage ) ) {
+                return false;
+            }
+        }
+
+        for ( uint16_t curPage = startPage;
+            curPage < startPage + numPages;
+            curPage++ )
+        {
+            _sram.markAsUsed( curPage );
+        }
+
+        markBlockStart( startPage, true );
+        _lowestFreePages = MIN( _lowestFreePages, _sram.getFreePageCount() );
+
+        #ifdef ZERO_HEAP_ACCOUNTING
+            // claimed memory is put back on behalf of someone else, so nobody pays
+            charge( 0, numPages * PAGE_BYTES );
+            _owners[ startPage ] = 0;
+        #endif
+
+        HEAP_TRACE( Claim, address, numPages * PAGE_BYTES );
+    }
+
+    return true;
+}
+
+
+#ifdef ZERO_HEAP_MOVABLE
+
+/// @private
+/// @brief Moves a block down into the free pages just below it, if there are any
+/// @param address The address of the start of the block.
+/// @returns The new address of the block, which is `address` if it didn't move.
+void* memory::slideDown( const void* const address )
+{
+    const uint16_t startPage{ getPageForAddress( (uintptr_t) address ) };
+    void* rc{ (void*) address };
+
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( startPage >= SRAM_PAGES or !isBlockStart( startPage ) ) {
+            return rc;
+        }
+
+        const uint16_t numPages{ getBlockPages( startPage ) };
+        uint16_t below{ 0 };
+
+        while ( below < startPage and _sram.isPageAvailable( startPage - below - 1 ) ) {
+            below++;
+        }
+
+        if ( below ) {
+            const uint16_t newStartPage{ (uint16_t) ( startPage - below ) };
+
+            for ( uint16_t curPage = newStartPage;
+                curPage < newStartPage + numPages;
+                curPage++ )
+            {
+                _sram.markAsUsed( curPage );
+            }
+
+            // the pages the block no longer covers
+            for ( uint16_t curPage = MAX( startPage, newStartPage + numPages );
+                curPage < startPage + numPages;
+                curPage++ )
+            {
+                _sram.markAsFree( curPage );
+            }
+
+            rc = (void*) getAddressForPage( newStartPage );
+            memmove( rc, address, numPages * PAGE_BYTES );
+
+            markBlockStart( startPage, false );
+            markBlockStart( newStartPage, true );
+
+            #ifdef ZERO_HEAP_ACCOUNTING
+                _owners[ newStartPage ] = _owners[ startPage ];
+            #endif
+
+            HEAP_TRACE( Free, address, numPages * PAGE_BYTES );
+            HEAP_TRACE( Allocate, rc, numPages * PAGE_BYTES );
+        }
+    }
+
+    return rc;
+}
+
+#endif
+
+
+#ifdef ZERO_HEAP_ACCOUNTING
+
+/// @private
+/// @brief Moves a block out of its Thread's account, into the unowned account
+/// @param address The address of the start of the block.
+void memory::disown( const void* const address )
+{
+    const uint16_t startPage{ getPageForAddress( (uintptr_t) address ) };
+
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( startPage < SRAM_PAGES and isBlockStart( startPage ) ) {
+            const uint16_t numBytes{ (uint16_t) ( getBlockPages( startPage ) * PAGE_BYTES ) };
+
+            refund( _owners[ startPage ], numBytes );
+            charge( 0, numBytes );
+            _owners[ startPage ] = 0;
+        }
+    }
+}
+
+#endif
+
+
+/// @brief Gets the amount of SRAM not currently allocated
+/// @returns The number of free bytes, some of which may be in separate blocks.
+/// @see getLargestFreeBlock()
+uint16_t memory::getFreeBytes()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        return _sram.getFreePageCount() * PAGE_BYTES;
+    }
+}
+
+
+/// @brief Gets the size of the biggest block that can be allocated right now
+/// @returns The number of bytes in the longest run of free pages. A call to allocate()
+/// for any more than this will fail, and call onOutOfMemory().
+uint16_t memory::getLargestFreeBlock()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        return _sram.getLargestFreeRun() * PAGE_BYTES;
+    }
+}
+
+
+/// @brief Gets a measure of how broken up the free memory is
+/// @returns 0 when all the free memory is in a single block (or there is none), rising
+/// towards 100 as the free memory is split into more, smaller blocks.
+uint8_t memory::getFragmentation()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        const uint16_t freePages{ _sram.getFreePageCount() };
+
+        if ( !freePages ) {
+            return 0;
         }
+
+        return 100 - (uint8_t) ( ( 100UL * _sram.getLargestFreeRun() ) / freePages );
+    }
+}
+
+
+/// @brief Gets the low-water mark of free memory
+/// @returns The fewest free bytes there have been since the system started, or since
+/// resetLowestFreeBytes() was last called.
+uint16_t memory::getLowestFreeBytes()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        return _lowestFreePages * PAGE_BYTES;
+    }
+}
+
+
+/// @brief Starts a new low-water mark from the amount of memory free right now
+void memory::resetLowestFreeBytes()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        _lowestFreePages = _sram.getFreePageCount();
     }
 }
 
 
-// overloads for new and delete operators
+#endif
+
+
+// overloads for new and delete operators, traced as called from where they were used
 void* operator new( size_t size )
 {
-    return memory::allocate( size );
+    return memory::allocateFrom( HEAP_CALLER, size, nullptr, memory::SearchStrategy::BottomUp );
+}
+
+
+void operator delete( void* p )
+{
+    memory::freeFrom( HEAP_CALLER, p, 0 );
 }
 
 
 void operator delete( void* p, size_t size )
 {
-    memory::free( p, size );
+    memory::freeFrom( HEAP_CALLER, p, size );
 }
 
 
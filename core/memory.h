@@ -16,6 +16,8 @@
 
 namespace zero {
 
+    class Thread;
+
     /// @brief Manages dynamic allocation of SRAM
     /// @details The amount of SRAM available to zero's allocator is defined in
     /// the `makefile`. Search for `DYNAMIC_BYTES`, making sure you're adjusting
@@ -29,12 +31,122 @@ namespace zero {
             uint16_t* const allocatedBytes = nullptr,
             const SearchStrategy strategy = memory::SearchStrategy::BottomUp );
 
-        // deallocate a contiguous chunk of memory
-        void free( const void* const address, const uint16_t numBytes );
+        // deallocate a contiguous chunk of memory - numBytes is only checked, in debug builds
+        void free( const void* const address, const uint16_t numBytes = 0 );
+
+        // resize a chunk of memory, in place if the memory around it allows
+        void* reallocate(
+            const void* const address,
+            const uint16_t bytesReqd,
+            uint16_t* const allocatedBytes = nullptr );
+
+        // allocate a specific contiguous chunk of memory, if it's free
+        bool claim( const void* const address, const uint16_t numBytes );
+
+        /// @private
+        // allocate() and free() for wrappers such as operator new, passing on their
+        // own caller for the heap trace (nullptr when not tracing)
+        void* allocateFrom(
+            const void* const caller,
+            const uint16_t bytesReqd,
+            uint16_t* const allocatedBytes,
+            const SearchStrategy strategy );
+
+        /// @private
+        void freeFrom( const void* const caller, const void* const address, const uint16_t numBytes );
+
+        // heap health, cheap enough to poll
+        uint16_t getFreeBytes();                        // bytes not allocated
+        uint16_t getLargestFreeBlock();                 // biggest single allocation possible now
+        uint8_t getFragmentation();                     // 0-100%, how broken up the free bytes are
+        uint16_t getLowestFreeBytes();                  // low-water mark of getFreeBytes()
+        void resetLowestFreeBytes();                    // start a new low-water mark from now
+
+        #ifdef ZERO_HEAP_MOVABLE
+            // a handle to a movable chunk, or zero (0) for none
+            typedef uint8_t MovableHandle;
+
+            // movable chunks, which compact() slides together while they're unlocked.
+            // Not for use with ZERO_DRIVERS_STACKSWAP, as chunks would slide into the
+            // SRAM of swapped-out stacks, which needs to stay free for them to come back.
+            MovableHandle allocateMovable(
+                const uint16_t bytesReqd,
+                uint16_t* const allocatedBytes = nullptr );
+
+            void freeMovable( MovableHandle& handle );
+            void* lock( const MovableHandle handle );   // pin the chunk, and get its address
+            void unlock( const MovableHandle handle );  // let the chunk move again
+            bool compact();                             // move one chunk down, if one can
+
+            /// @private
+            void* slideDown( const void* const address );
+        #endif
+
+        #ifdef ZERO_HEAP_TRACE
+            // what a TraceRecord records
+            enum class TraceOp : uint8_t {
+                Allocate = 1,                           // a chunk was allocated (or moved/resized to here)
+                Free = 2,                               // a chunk was freed (or moved/resized from here)
+                Claim = 3,                              // a chunk was claimed
+                Fail = 4,                               // an allocation failed
+            };
+
+            // a heap operation, as kept in the trace ring - nine (9) bytes, little-endian
+            struct TraceRecord {
+                TraceOp op;
+                uint8_t sequence;                       // counts up by one, so gaps show lost records
+                uint8_t threadId;                       // low byte of the Thread's ID, 0xFF if none
+                uint16_t address;                       // zero (0) for a Fail
+                uint16_t numBytes;                      // bytes allocated or freed, or asked for
+                uint16_t caller;                        // word address the heap was called from
+            };
+
+            // new, delete, reallocate(), Arena and movable chunks pass their own caller
+            // on, so records point at the code that used them. Anything else that calls
+            // the heap for someone else, such as an ObjectPool falling back to the
+            // heap, shows up as that caller instead.
+
+            uint8_t readTrace( TraceRecord* const dest, const uint8_t maxRecords );
+            uint16_t getTraceDroppedCount();
+
+            /// @private
+            void trace(
+                const TraceOp op,
+                const void* const address,
+                const uint16_t numBytes,
+                const void* const caller );
+        #endif
+
+        #ifdef ZERO_HEAP_ACCOUNTING
+            // per-Thread accounting
+            uint16_t getThreadBytes( const Thread& t );         // bytes t holds now
+            uint16_t getThreadPeakBytes( const Thread& t );     // most bytes t has held at once
+            bool setThreadQuota( Thread& t, const uint16_t quotaBytes );    // zero (0) for no limit
+
+            /// @private
+            void disown( const void* const address );
+            uint8_t getCurrentAccount();
+            bool charge( const uint8_t account, const uint16_t numBytes );
+            void refund( const uint8_t account, const uint16_t numBytes );
+            void closeAccount( Thread& t );
+        #endif
 
     }    // namespace memory
 
 }    // namespace zero
 
 
+/// @private
+#ifdef ZERO_HEAP_TRACE
+    #define HEAP_CALLER __builtin_return_address( 0 )
+    #define HEAP_TRACE_FROM( caller, op, address, numBytes ) zero::memory::trace( zero::memory::TraceOp::op, ( address ), ( numBytes ), ( caller ) );
+#else
+    #define HEAP_CALLER nullptr
+    #define HEAP_TRACE_FROM( caller, op, address, numBytes ) (void) ( caller );
+#endif
+
+/// @private
+#define HEAP_TRACE( op, address, numBytes ) HEAP_TRACE_FROM( HEAP_CALLER, op, address, numBytes )
+
+
 #endif
@@ -0,0 +1,183 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+/// @file
+/// @brief Contains per-Thread heap accounting and quotas
+/// @details Built with `HEAP_ACCOUNTING = 1` in the `makefile`. Every allocation is
+/// charged to an account belonging to the Thread that made it, and the heap remembers
+/// which account each block was charged to, so a block freed by another Thread is
+/// still paid back to the right one.
+
+
+#ifdef ZERO_HEAP_ACCOUNTING
+
+
+#include <stdint.h>
+
+#include "memory.h"
+#include "thread.h"
+#include "debug.h"
+#include "attrs.h"
+
+
+using namespace zero;
+using namespace zero::memory;
+
+
+namespace {
+
+    struct Account {
+        Thread* thread;                                 // nullptr once the Thread has exited
+        uint16_t bytes;
+        uint16_t peakBytes;
+        uint16_t quota;                                 // zero (0) for no limit
+    };
+
+    // Account zero (0) is for memory no Thread answers for, such as Thread stacks,
+    // and anything allocated before the scheduler starts or once the accounts run out.
+    // An exited Thread's account stays open until everything it leaked is freed.
+    Account _accounts[ HEAP_ACCOUNTS + 1 ];
+
+
+    // Finds the account for a Thread, opening one if need be
+    uint8_t getAccount( Thread& t )
+    {
+        if ( !t._heapAccount ) {
+            for ( uint8_t i = 1; i <= HEAP_ACCOUNTS; i++ ) {
+                if ( !_accounts[ i ].thread and !_accounts[ i ].bytes ) {
+                    _accounts[ i ] = { &t, 0, 0, 0 };
+                    t._heapAccount = i;
+                    break;
+                }
+            }
+        }
+
+        return t._heapAccount;
+    }
+
+}    // namespace
+
+
+/// @brief Default leak handler. Called when a Thread exits still holding heap memory.
+/// @param t The Thread that's exiting.
+/// @param numBytes The number of bytes it still holds.
+void WEAK onThreadLeak( Thread& t, const uint16_t numBytes )
+{
+    #ifdef DEBUG_ENABLED
+        dbg_pgm( "Leak: " );
+        debug::print( t.getName(), true );
+        dbg_pgm( " " );
+        dbg_int( numBytes );
+        dbg_pgm( "\r\n" );
+    #else
+        (void) t;
+        (void) numBytes;
+    #endif
+}
+
+
+/// @private
+/// @brief Gets the account to charge the current Thread's allocations to
+uint8_t memory::getCurrentAccount()
+{
+    Thread* const t{ Thread::getCurrentOrNull() };
+
+    return t ? getAccount( *t ) : 0;
+}
+
+
+/// @private
+/// @brief Charges an allocation to an account
+/// @returns `true` if the charge was made, `false` if it would go over the account's
+/// quota.
+bool memory::charge( const uint8_t account, const uint16_t numBytes )
+{
+    Account& a{ _accounts[ account ] };
+
+    if ( a.quota and (uint32_t) a.bytes + numBytes > a.quota ) {
+        return false;
+    }
+
+    a.bytes += numBytes;
+
+    if ( a.bytes > a.peakBytes ) {
+        a.peakBytes = a.bytes;
+    }
+
+    return true;
+}
+
+
+/// @private
+/// @brief Pays an account back for freed memory
+void memory::refund( const uint8_t account, const uint16_t numBytes )
+{
+    _accounts[ account ].bytes -= numBytes;
+}
+
+
+/// @private
+/// @brief Closes a Thread's account as the Thread exits, reporting anything it leaked
+void memory::closeAccount( Thread& t )
+{
+    Account& a{ _accounts[ t._heapAccount ] };
+
+    if ( t._heapAccount ) {
+        if ( a.bytes ) {
+            onThreadLeak( t, a.bytes );
+        }
+
+        a.thread = nullptr;
+        t._heapAccount = 0;
+    }
+}
+
+
+/// @brief Gets the amount of heap memory a Thread holds
+/// @param t The Thread.
+/// @returns The number of bytes allocated by the Thread and not yet freed, counted in
+/// whole pages (or blocks).
+uint16_t memory::getThreadBytes( const Thread& t )
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        return t._heapAccount ? _accounts[ t._heapAccount ].bytes : 0;
+    }
+}
+
+
+/// @brief Gets the most heap memory a Thread has held at once
+/// @param t The Thread.
+uint16_t memory::getThreadPeakBytes( const Thread& t )
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        return t._heapAccount ? _accounts[ t._heapAccount ].peakBytes : 0;
+    }
+}
+
+
+/// @brief Limits how much heap memory a Thread may hold
+/// @details An allocation that would take the Thread over its quota fails straight
+/// away, as if the heap were full, and calls onOutOfMemory().
+/// @param t The Thread.
+/// @param quotaBytes The most bytes the Thread may hold at once, or zero (0) for no limit.
+/// @returns `true` if the quota was set, `false` if there are no accounts left.
+bool memory::setThreadQuota( Thread& t, const uint16_t quotaBytes )
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        const uint8_t account{ getAccount( t ) };
+
+        if ( account ) {
+            _accounts[ account ].quota = quotaBytes;
+        }
+
+        return account;
+    }
+}
+
+
+#endif
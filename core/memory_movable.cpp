@@ -0,0 +1,175 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+/// @file
+/// @brief Contains movable heap chunks, and the compactor that moves them
+/// @details Built with `HEAP_MOVABLE = 1` in the `makefile`. A movable chunk is only
+/// reached through its handle, so while it's unlocked the compactor is free to slide
+/// it down into any free memory just below it. Done a chunk at a time from the idle
+/// Thread, this gathers the free memory back into big runs without a reset.
+
+
+#ifdef ZERO_HEAP_MOVABLE
+
+
+#include <stdint.h>
+
+#include "memory.h"
+#include "thread.h"
+#include "debug.h"
+
+
+using namespace zero;
+using namespace zero::memory;
+
+
+namespace {
+
+    struct Movable {
+        void* address;                                  // nullptr if the handle is unused
+        uint8_t locks;                                  // the chunk only moves when this is zero (0)
+    };
+
+    Movable _movables[ MOVABLE_HANDLES ];
+
+    // where compact() carries on from
+    uint8_t _nextToCompact{ 0 };
+
+
+    // Returns the table entry for a handle, or nullptr if the handle's no good
+    Movable* getMovable( const MovableHandle handle )
+    {
+        if ( !handle or handle > MOVABLE_HANDLES or !_movables[ handle - 1 ].address ) {
+            return nullptr;
+        }
+
+        return &_movables[ handle - 1 ];
+    }
+
+}    // namespace
+
+
+/// @brief Allocates a chunk of SRAM that the heap may move
+/// @param bytesReqd The minimum number of bytes required.
+/// @param allocatedBytes Optional. Default: `nullptr`. A place to store the number
+/// of bytes actually allocated.
+/// @returns A handle to the chunk, or zero (0) if there's no memory, or no handles
+/// left. Use lock() to get at the chunk.
+MovableHandle memory::allocateMovable( const uint16_t bytesReqd, uint16_t* const allocatedBytes )
+{
+    if ( allocatedBytes ) {
+        *allocatedBytes = 0;
+    }
+
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        for ( uint8_t i = 0; i < MOVABLE_HANDLES; i++ ) {
+            if ( !_movables[ i ].address ) {
+                void* const address{ allocateFrom( HEAP_CALLER, bytesReqd, allocatedBytes, SearchStrategy::BottomUp ) };
+
+                if ( !address ) {
+                    return 0;
+                }
+
+                _movables[ i ] = { address, 0 };
+
+                return i + 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/// @brief Frees a movable chunk
+/// @param handle The handle of the chunk to free. It's set to zero (0).
+void memory::freeMovable( MovableHandle& handle )
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        Movable* const m{ getMovable( handle ) };
+
+        if ( m ) {
+            dbg_assert( !m->locks, "Freeing locked memory" );
+
+            freeFrom( HEAP_CALLER, m->address, 0 );
+            m->address = nullptr;
+        }
+
+        handle = 0;
+    }
+}
+
+
+/// @brief Stops a movable chunk from moving, and gets its address
+/// @details Locks nest - the chunk can move again once every lock() has had its unlock().
+/// Keep chunks locked only while using them, or they'll get in the way of compaction.
+/// @param handle The handle of the chunk.
+/// @returns The address of the chunk, which stays put until it's unlocked, or `nullptr`
+/// if the handle is no good.
+void* memory::lock( const MovableHandle handle )
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        Movable* const m{ getMovable( handle ) };
+
+        if ( !m ) {
+            return nullptr;
+        }
+
+        dbg_assert( m->locks < 0xFF, "Too many locks" );
+        m->locks++;
+
+        return m->address;
+    }
+}
+
+
+/// @brief Lets a movable chunk move again
+/// @details Any pointers into the chunk are no good after this.
+/// @param handle The handle of the chunk, as passed to lock().
+void memory::unlock( const MovableHandle handle )
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        Movable* const m{ getMovable( handle ) };
+
+        if ( m and m->locks ) {
+            m->locks--;
+        }
+    }
+}
+
+
+/// @brief Moves one unlocked movable chunk down into free memory just below it
+/// @details The default idle Thread calls this until there's nothing left to move. If
+/// you replace idleThreadEntry(), call it from there.
+/// @returns `true` if a chunk was moved, `false` if there was nothing to move.
+bool memory::compact()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        for ( uint8_t n = 0; n < MOVABLE_HANDLES; n++ ) {
+            Movable& m{ _movables[ _nextToCompact ] };
+
+            if ( ++_nextToCompact == MOVABLE_HANDLES ) {
+                _nextToCompact = 0;
+            }
+
+            if ( m.address and !m.locks ) {
+                void* const moved{ slideDown( m.address ) };
+
+                if ( moved != m.address ) {
+                    m.address = moved;
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+
+#endif
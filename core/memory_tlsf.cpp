@@ -0,0 +1,854 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+/// @file
+/// @brief Contains a two-level segregated fit (TLSF) backend for the heap
+/// @details Selected with `HEAP_ALLOCATOR = TLSF` in the `makefile`. Every block has a
+/// small header, and free blocks are kept in lists by size class. A two-level bitmap
+/// of the non-empty lists finds a big enough block with a few bit operations, and
+/// freed blocks are merged with their free neighbours straight away, so allocate()
+/// and free() take the same bounded time however big or full the heap is.
+/// The price is that a free block less than a quarter bigger than the request can be
+/// missed, if it shares a list with smaller blocks and isn't at the head of it.
+
+
+#ifdef ZERO_HEAP_TLSF
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "memory.h"
+#include "thread.h"
+#include "debug.h"
+#include "util.h"
+#include "attrs.h"
+
+
+using namespace zero;
+using namespace zero::memory;
+
+
+void onOutOfMemory();
+
+
+namespace {
+
+    static_assert( DYNAMIC_BYTES > 0, "Heap cannot be zero (0) bytes in size" );
+
+    // The SRAM that the dynamic allocator can hand out to callers
+    uint8_t ALIGNED( 64 ) _memoryArea[ DYNAMIC_BYTES ];
+
+
+    // Every block starts with one of these. The free list links overlay the first
+    // bytes of the payload, so they only exist while the block is free.
+    struct Block {
+        Block* prevPhys;                                // the block just below this one, or nullptr
+        uint16_t size;                                  // payload bytes, and BLOCK_FREE
+
+        #ifdef ZERO_HEAP_ACCOUNTING
+            uint8_t owner;                              // the account the block was charged to
+            uint8_t spare[ 3 ];                         // keeps the header a whole number of granules
+        #endif
+
+        Block* nextFree;
+        Block* prevFree;
+    };
+
+    const uint16_t HEADER_BYTES{ offsetof( Block, nextFree ) };
+    const uint16_t MIN_PAYLOAD_BYTES{ sizeof( Block ) - HEADER_BYTES };
+
+    // payload sizes are a multiple of this, leaving the low bits of size for flags
+    const uint16_t GRANULE_BYTES{ 4 };
+    const uint16_t BLOCK_FREE{ 1 << 0 };
+
+    // each power-of-two size range is split into 1 << SL_LOG2 lists
+    const uint8_t SL_LOG2{ 2 };
+    const uint8_t SL_COUNT{ 1 << SL_LOG2 };
+
+    // sizes below this all share the first range, one list per granule
+    const uint16_t SMALL_BYTES{ 1 << ( SL_LOG2 + 2 ) };
+
+
+    // Returns the index of the highest set bit
+    constexpr uint8_t getMsb( uint16_t v )
+    {
+        uint8_t rc{ 0 };
+
+        if ( v & 0xFF00 ) { rc += 8; v >>= 8; }
+        if ( v & 0x00F0 ) { rc += 4; v >>= 4; }
+        if ( v & 0x000C ) { rc += 2; v >>= 2; }
+        if ( v & 0x0002 ) { rc += 1; }
+
+        return rc;
+    }
+
+
+    // Returns the index of the lowest set bit
+    constexpr uint8_t getLsb( const uint16_t v )
+    {
+        return getMsb( v & -v );
+    }
+
+
+    // one first-level range for the small sizes, and one per power of two above
+    const uint8_t FL_COUNT{ (uint8_t) ( getMsb( DYNAMIC_BYTES ) - ( SL_LOG2 + 2 ) + 2 ) };
+
+    static_assert( FL_COUNT <= 16, "Heap too big for the first-level bitmap" );
+
+    // the free lists, and bitmaps of which ones have blocks in them
+    Block* _freeLists[ FL_COUNT ][ SL_COUNT ];
+    uint16_t _flBitmap{ 0 };
+    uint8_t _slBitmap[ FL_COUNT ];
+
+    Block* _firstBlock{ nullptr };
+    uint16_t _freeBytes{ 0 };
+    uint16_t _lowestFreeBytes{ 0 };
+
+
+    uint16_t getSize( const Block* const b )
+    {
+        return b->size & ~( GRANULE_BYTES - 1 );
+    }
+
+
+    bool isFree( const Block* const b )
+    {
+        return b->size & BLOCK_FREE;
+    }
+
+
+    Block* getNextPhys( const Block* const b )
+    {
+        return (Block*) ( (uint8_t*) b + HEADER_BYTES + getSize( b ) );
+    }
+
+
+    // Works out which free list a block of the given size belongs in
+    void mapInsert( const uint16_t size, uint8_t& fl, uint8_t& sl )
+    {
+        if ( size < SMALL_BYTES ) {
+            fl = 0;
+            sl = size / GRANULE_BYTES;
+        }
+        else {
+            const uint8_t msb{ getMsb( size ) };
+
+            fl = msb - ( SL_LOG2 + 2 ) + 1;
+            sl = ( size >> ( msb - SL_LOG2 ) ) ^ SL_COUNT;
+        }
+    }
+
+
+    // Works out the first free list whose blocks are all at least the given size
+    bool mapSearch( uint16_t size, uint8_t& fl, uint8_t& sl )
+    {
+        if ( size >= SMALL_BYTES ) {
+            const uint16_t round{ (uint16_t) ( ( 1U << ( getMsb( size ) - SL_LOG2 ) ) - 1 ) };
+
+            if ( size > 0xFFFF - round ) {
+                return false;
+            }
+
+            size += round;
+        }
+
+        mapInsert( size, fl, sl );
+
+        return fl < FL_COUNT;
+    }
+
+
+    void insertFree( Block* const b )
+    {
+        uint8_t fl, sl;
+        mapInsert( getSize( b ), fl, sl );
+
+        b->prevFree = nullptr;
+        b->nextFree = _freeLists[ fl ][ sl ];
+
+        if ( b->nextFree ) {
+            b->nextFree->prevFree = b;
+        }
+
+        _freeLists[ fl ][ sl ] = b;
+        _flBitmap |= ( 1U << fl );
+        _slBitmap[ fl ] |= ( 1 << sl );
+
+        _freeBytes += getSize( b );
+    }
+
+
+    void removeFree( Block* const b )
+    {
+        uint8_t fl, sl;
+        mapInsert( getSize( b ), fl, sl );
+
+        if ( b->prevFree ) {
+            b->prevFree->nextFree = b->nextFree;
+        }
+        else {
+            _freeLists[ fl ][ sl ] = b->nextFree;
+
+            if ( !b->nextFree ) {
+                _slBitmap[ fl ] &= ~( 1 << sl );
+
+                if ( !_slBitmap[ fl ] ) {
+                    _flBitmap &= ~( 1U << fl );
+                }
+            }
+        }
+
+        if ( b->nextFree ) {
+            b->nextFree->prevFree = b->prevFree;
+        }
+
+        _freeBytes -= getSize( b );
+    }
+
+
+    // Finds a free block of at least size bytes, from the first list whose
+    // blocks are all big enough, without searching any list
+    Block* findGoodFit( const uint16_t size )
+    {
+        uint8_t fl, sl;
+
+        if ( !mapSearch( size, fl, sl ) ) {
+            return nullptr;
+        }
+
+        uint8_t slMap{ (uint8_t) ( _slBitmap[ fl ] & ( 0xFF << sl ) ) };
+
+        // nothing in this range - try the next non-empty range up
+        if ( !slMap ) {
+            const uint16_t flMap{ (uint16_t) ( _flBitmap & ( 0xFFFF << ( fl + 1 ) ) ) };
+
+            if ( !flMap ) {
+                return nullptr;
+            }
+
+            fl = getLsb( flMap );
+            slMap = _slBitmap[ fl ];
+        }
+
+        return _freeLists[ fl ][ getLsb( slMap ) ];
+    }
+
+
+    // Finds a free block of at least size bytes
+    Block* findFree( const uint16_t size )
+    {
+        Block* rc{ findGoodFit( size ) };
+
+        // the only blocks left that could be big enough share a list with smaller
+        // ones. The head of that list is worth one look before giving up, as it's
+        // often the only block there, such as the whole of an empty heap. Searching
+        // the rest of the list would make allocate() as slow as the list is long.
+        if ( !rc ) {
+            uint8_t fl, sl;
+            mapInsert( size, fl, sl );
+
+            rc = _freeLists[ fl ][ sl ];
+
+            if ( rc and getSize( rc ) < size ) {
+                rc = nullptr;
+            }
+        }
+
+        return rc;
+    }
+
+
+    // Returns the size a used block of total bytes ends up once trim() cuts it to size
+    uint16_t getTrimmedSize( const uint16_t total, const uint16_t size )
+    {
+        return ( total >= size + HEADER_BYTES + MIN_PAYLOAD_BYTES ) ? size : total;
+    }
+
+
+    // Gives any of a used block beyond size bytes back to the heap
+    void trim( Block* const b, const uint16_t size )
+    {
+        const uint16_t total{ getSize( b ) };
+
+        if ( getTrimmedSize( total, size ) != total ) {
+            Block* const rest{ (Block*) ( (uint8_t*) b + HEADER_BYTES + size ) };
+            Block* const next{ getNextPhys( b ) };
+
+            rest->prevPhys = b;
+            rest->size = ( total - size - HEADER_BYTES ) | BLOCK_FREE;
+
+            // a block being shrunk might have a free block above it
+            if ( isFree( next ) ) {
+                removeFree( next );
+                rest->size += HEADER_BYTES + getSize( next );
+            }
+
+            getNextPhys( rest )->prevPhys = rest;
+
+            b->size = size;
+
+            insertFree( rest );
+        }
+    }
+
+
+    // Rounds a request up to a whole number of granules, big enough to be freed
+    bool getBlockSize( const uint16_t bytesReqd, uint16_t& size )
+    {
+        if ( bytesReqd > DYNAMIC_BYTES ) {
+            return false;
+        }
+
+        size = ROUND_UP( bytesReqd, GRANULE_BYTES );
+        size = MAX( size, MIN_PAYLOAD_BYTES );
+
+        return true;
+    }
+
+
+    // Sets the heap up as one big free block, with a used, empty block
+    // at the very end so that nothing ever merges past it
+    void initHeap()
+    {
+        const uint16_t firstBytes{ (uint16_t) ( ( DYNAMIC_BYTES - 2 * HEADER_BYTES ) & ~( GRANULE_BYTES - 1 ) ) };
+
+        _firstBlock = (Block*) _memoryArea;
+        _firstBlock->prevPhys = nullptr;
+        _firstBlock->size = firstBytes | BLOCK_FREE;
+
+        Block* const sentinel{ getNextPhys( _firstBlock ) };
+        sentinel->prevPhys = _firstBlock;
+        sentinel->size = 0;
+
+        insertFree( _firstBlock );
+        _lowestFreeBytes = _freeBytes;
+    }
+
+
+    void noteLowWater()
+    {
+        _lowestFreeBytes = MIN( _lowestFreeBytes, _freeBytes );
+    }
+
+
+    // allocateFrom(), charging the block to the given account
+    void* MALLOC allocateFor(
+        const void* const caller,
+        const uint16_t bytesReqd,
+        uint16_t* const allocatedBytes,
+        const uint8_t account )
+    {
+        void* rc{ nullptr };
+        uint16_t size;
+
+        #ifndef ZERO_HEAP_ACCOUNTING
+            (void) account;
+        #endif
+
+        if ( allocatedBytes ) {
+            *allocatedBytes = 0;
+        }
+
+        if ( !bytesReqd ) {
+            return rc;
+        }
+
+        ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+            if ( !_firstBlock ) {
+                initHeap();
+            }
+
+            Block* const b{ getBlockSize( bytesReqd, size ) ? findFree( size ) : nullptr };
+            bool fits{ b != nullptr };
+
+            #ifdef ZERO_HEAP_ACCOUNTING
+                // going over quota looks just like running out of memory
+                fits = fits and charge( account, getTrimmedSize( getSize( b ), size ) );
+            #endif
+
+            if ( fits ) {
+                removeFree( b );
+                b->size &= ~BLOCK_FREE;
+                trim( b, size );
+                noteLowWater();
+
+                #ifdef ZERO_HEAP_ACCOUNTING
+                    b->owner = account;
+                #endif
+
+                if ( allocatedBytes ) {
+                    *allocatedBytes = getSize( b );
+                }
+
+                rc = (uint8_t*) b + HEADER_BYTES;
+
+                HEAP_TRACE_FROM( caller, Allocate, rc, getSize( b ) );
+            }
+        }
+
+        if ( !rc ) {
+            HEAP_TRACE_FROM( caller, Fail, nullptr, bytesReqd );
+            onOutOfMemory();
+        }
+
+        return rc;
+    }
+
+}    // namespace
+
+
+/// @brief Allocates a chunk of SRAM.
+/// @param bytesReqd The minimum number of bytes required.
+/// @param allocatedBytes Optional. Default: `nullptr`. A place to store the number
+/// of bytes actually allocated.
+/// @param strategy Ignored - the TLSF heap always takes the best-fitting free block.
+void* MALLOC memory::allocate(
+    const uint16_t bytesReqd,
+    uint16_t* const allocatedBytes,
+    const SearchStrategy strategy )
+{
+    return allocateFrom( HEAP_CALLER, bytesReqd, allocatedBytes, strategy );
+}
+
+
+/// @private
+/// @brief allocate(), traced as called from caller
+void* MALLOC memory::allocateFrom(
+    const void* const caller,
+    const uint16_t bytesReqd,
+    uint16_t* const allocatedBytes,
+    const SearchStrategy )
+{
+    #ifdef ZERO_HEAP_ACCOUNTING
+        const uint8_t account{ getCurrentAccount() };
+    #else
+        const uint8_t account{ 0 };
+    #endif
+
+    return allocateFor( caller, bytesReqd, allocatedBytes, account );
+}
+
+
+/// @brief Returns a chunk of previously allocated memory to the heap.
+/// @param address The address of the start of the chunk to free.
+/// @param numBytes Optional. Default: 0. The number of bytes that were asked for. The
+/// block's header records its size, so this is only used by debug builds, to check it.
+void memory::free( const void* const address, const uint16_t numBytes )
+{
+    freeFrom( HEAP_CALLER, address, numBytes );
+}
+
+
+/// @private
+/// @brief free(), traced as called from caller
+void memory::freeFrom( const void* const caller, const void* const address, const uint16_t numBytes )
+{
+    if ( !address ) return;
+
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        Block* b{ (Block*) ( (uint8_t*) address - HEADER_BYTES ) };
+
+        if ( isFree( b ) ) {
+            dbg_assert( false, "Freeing unallocated memory" );
+            return;
+        }
+
+        dbg_assert( numBytes <= getSize( b ), "Free size mismatch" );
+
+        #ifdef ZERO_HEAP_ACCOUNTING
+            refund( b->owner, getSize( b ) );
+        #endif
+
+        HEAP_TRACE_FROM( caller, Free, address, getSize( b ) );
+
+        b->size |= BLOCK_FREE;
+
+        // merge with the block above
+        Block* const next{ getNextPhys( b ) };
+
+        if ( isFree( next ) ) {
+            removeFree( next );
+            b->size += HEADER_BYTES + getSize( next );
+            getNextPhys( b )->prevPhys = b;
+        }
+
+        // ... and the block below
+        Block* const prev{ b->prevPhys };
+
+        if ( prev and isFree( prev ) ) {
+            removeFree( prev );
+            prev->size += HEADER_BYTES + getSize( b );
+            getNextPhys( prev )->prevPhys = prev;
+            b = prev;
+        }
+
+        insertFree( b );
+    }
+}
+
+
+/// @brief Changes the size of a chunk of previously allocated memory
+/// @details Shrinking always happens in place. Growing takes in the free block straight
+/// after the chunk if that's enough. Otherwise a new chunk is allocated, the contents
+/// copied and the old chunk freed.
+/// With heap accounting, the chunk stays charged to the Thread that owns it, even when
+/// another Thread resizes or moves it.
+/// @param address The address of the start of the chunk, as returned by allocate(). If
+/// this is `nullptr`, reallocate() acts like allocate().
+/// @param bytesReqd The minimum number of bytes required. If this is zero (0), the chunk
+/// is freed.
+/// @param allocatedBytes Optional. Default: `nullptr`. A place to store the number
+/// of bytes actually allocated.
+/// @returns The new address of the chunk, or `nullptr` if there wasn't enough memory,
+/// in which case the chunk is left as it was.
+void* memory::reallocate(
+    const void* const address,
+    const uint16_t bytesReqd,
+    uint16_t* const allocatedBytes )
+{
+    if ( !address ) {
+        return allocateFrom( HEAP_CALLER, bytesReqd, allocatedBytes, SearchStrategy::BottomUp );
+    }
+
+    if ( allocatedBytes ) {
+        *allocatedBytes = 0;
+    }
+
+    if ( !bytesReqd ) {
+        freeFrom( HEAP_CALLER, address, 0 );
+        return nullptr;
+    }
+
+    Block* const b{ (Block*) ( (uint8_t*) address - HEADER_BYTES ) };
+    uint16_t size;
+    uint16_t oldSize;
+    uint8_t account{ 0 };
+    void* rc{ nullptr };
+
+    if ( !getBlockSize( bytesReqd, size ) ) {
+        onOutOfMemory();
+        return nullptr;
+    }
+
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( isFree( b ) ) {
+            dbg_assert( false, "Reallocating unallocated memory" );
+            return nullptr;
+        }
+
+        oldSize = getSize( b );
+
+        #ifdef ZERO_HEAP_ACCOUNTING
+            account = b->owner;
+        #endif
+
+        // the free block above gets soaked up, if that makes it big enough
+        Block* const next{ getNextPhys( b ) };
+        const bool grow{ size > oldSize
+            and isFree( next )
+            and oldSize + HEADER_BYTES + getSize( next ) >= size };
+        const uint16_t total{ (uint16_t) ( grow ? oldSize + HEADER_BYTES + getSize( next ) : oldSize ) };
+        bool fits{ total >= size };
+
+        #ifdef ZERO_HEAP_ACCOUNTING
+            const uint16_t newSize{ getTrimmedSize( total, size ) };
+
+            // the block's owner pays for any growth, whoever resizes it
+            if ( fits and newSize > oldSize ) {
+                fits = charge( account, newSize - oldSize );
+            }
+            else if ( fits ) {
+                refund( account, oldSize - newSize );
+            }
+        #endif
+
+        if ( fits ) {
+            if ( grow ) {
+                removeFree( next );
+                b->size += HEADER_BYTES + getSize( next );
+                getNextPhys( b )->prevPhys = b;
+            }
+
+            trim( b, size );
+            noteLowWater();
+
+            if ( allocatedBytes ) {
+                *allocatedBytes = getSize( b );
+            }
+
+            rc = (void*) address;
+
+            HEAP_TRACE( Free, address, oldSize );
+            HEAP_TRACE( Allocate, rc, getSize( b ) );
+        }
+    }
+
+    if ( !rc ) {
+        // no room to grow where it is - move it, still charged to the block's owner
+        rc = allocateFor( HEAP_CALLER, bytesReqd, allocatedBytes, account );
+
+        if ( rc ) {
+            memcpy( rc, address, oldSize );
+            freeFrom( HEAP_CALLER, address, 0 );
+        }
+    }
+
+    return rc;
+}
+
+
+/// @brief Allocates a specific chunk of SRAM, if all of it is free.
+/// @param address The address of the start of the chunk, as previously returned by
+/// allocate().
+/// @param numBytes The number of bytes to claim.
+/// @returns `true` if the chunk was free and is now allocated, `false` if any of it is
+/// in use, or it isn't inside the heap.
+/// @note This walks the heap block by block, so unlike allocate() it isn't O(1).
+bool memory::claim( const void* const address, const uint16_t numBytes )
+{
+    uint16_t size;
+
+    if ( !address or !getBlockSize( numBytes, size ) ) return false;
+
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( !_firstBlock ) {
+            initHeap();
+        }
+
+        uint8_t* const want{ (uint8_t*) address - HEADER_BYTES };
+
+        if ( want < _memoryArea or want + HEADER_BYTES + size > _memoryArea + DYNAMIC_BYTES ) {
+            dbg_assert( false, "Claiming memory outside the heap" );
+            return false;
+        }
+
+        // find the block that the chunk's header would start in
+        Block* b{ _firstBlock };
+
+        while ( getSize( b ) and (uint8_t*) getNextPhys( b ) <= want ) {
+            b = getNextPhys( b );
+        }
+
+        uint8_t* const start{ (uint8_t*) b };
+        uint8_t* const end{ (uint8_t*) getNextPhys( b ) };
+
+        if ( !isFree( b ) or want + HEADER_BYTES + size > end ) {
+            return false;
+        }
+
+        // any part of the free block in front of the chunk has to stay a block
+        if ( ( want - start ) % GRANULE_BYTES ) {
+            return false;
+        }
+
+        if ( want != start and want - start < HEADER_BYTES + MIN_PAYLOAD_BYTES ) {
+            return false;
+        }
+
+        removeFree( b );
+
+        Block* const claimed{ (Block*) want };
+
+        if ( claimed != b ) {
+            claimed->prevPhys = b;
+            claimed->size = end - want - HEADER_BYTES;
+            ( (Block*) end )->prevPhys = claimed;
+
+            b->size = ( want - start - HEADER_BYTES ) | BLOCK_FREE;
+            insertFree( b );
+        }
+        else {
+            claimed->size &= ~BLOCK_FREE;
+        }
+
+        trim( claimed, size );
+        noteLowWater();
+
+        #ifdef ZERO_HEAP_ACCOUNTING
+            // claimed memory is put back on behalf of someone else, so nobody pays
+            charge( 0, getSize( claimed ) );
+            claimed->owner = 0;
+        #endif
+
+        HEAP_TRACE( Claim, address, getSize( claimed ) );
+    }
+
+    return true;
+}
+
+
+#ifdef ZERO_HEAP_MOVABLE
+
+/// @private
+/// @brief Moves a block down into the free block just below it, if there is one
+/// @param address The address of the start of the block.
+/// @returns The new address of the block, which is `address` if it didn't move.
+void* memory::slideDown( const void* const address )
+{
+    Block* const b{ (Block*) ( (uint8_t*) address - HEADER_BYTES ) };
+    void* rc{ (void*) address };
+
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        Block* const prev{ b->prevPhys };
+
+        if ( isFree( b ) or !prev or !isFree( prev ) ) {
+            return rc;
+        }
+
+        // the block's header may be overwritten by the move
+        const uint16_t usedSize{ b->size };
+        const uint16_t gap{ getSize( prev ) };
+        Block* const next{ getNextPhys( b ) };
+
+        #ifdef ZERO_HEAP_ACCOUNTING
+            const uint8_t owner{ b->owner };
+        #endif
+
+        removeFree( prev );
+
+        // the free block's header becomes the moved block's header
+        Block* const moved{ prev };
+        rc = (uint8_t*) moved + HEADER_BYTES;
+        memmove( rc, address, getSize( b ) );
+        moved->size = usedSize;
+
+        #ifdef ZERO_HEAP_ACCOUNTING
+            moved->owner = owner;
+        #endif
+
+        HEAP_TRACE( Free, address, usedSize );
+        HEAP_TRACE( Allocate, rc, usedSize );
+
+        // ... and the free space ends up above it
+        Block* const rest{ getNextPhys( moved ) };
+        rest->prevPhys = moved;
+        rest->size = gap | BLOCK_FREE;
+
+        if ( isFree( next ) ) {
+            removeFree( next );
+            rest->size += HEADER_BYTES + getSize( next );
+        }
+
+        getNextPhys( rest )->prevPhys = rest;
+        insertFree( rest );
+    }
+
+    return rc;
+}
+
+#endif
+
+
+#ifdef ZERO_HEAP_ACCOUNTING
+
+/// @private
+/// @brief Moves a block out of its Thread's account, into the unowned account
+/// @param address The address of the start of the block.
+void memory::disown( const void* const address )
+{
+    if ( !address ) return;
+
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        Block* const b{ (Block*) ( (uint8_t*) address - HEADER_BYTES ) };
+
+        refund( b->owner, getSize( b ) );
+        charge( 0, getSize( b ) );
+        b->owner = 0;
+    }
+}
+
+#endif
+
+
+/// @brief Gets the amount of SRAM not currently allocated
+/// @returns The number of free bytes, some of which may be in separate blocks.
+uint16_t memory::getFreeBytes()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( !_firstBlock ) {
+            initHeap();
+        }
+
+        return _freeBytes;
+    }
+}
+
+
+/// @brief Gets the size of the biggest block that can be allocated right now
+/// @returns The payload size of the largest free block. Only the highest non-empty
+/// free list is looked through.
+uint16_t memory::getLargestFreeBlock()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( !_firstBlock ) {
+            initHeap();
+        }
+
+        uint16_t rc{ 0 };
+
+        if ( _flBitmap ) {
+            const uint8_t fl{ getMsb( _flBitmap ) };
+
+            for ( Block* b = _freeLists[ fl ][ getMsb( _slBitmap[ fl ] ) ]; b; b = b->nextFree ) {
+                rc = MAX( rc, getSize( b ) );
+            }
+        }
+
+        return rc;
+    }
+}
+
+
+/// @brief Gets a measure of how broken up the free memory is
+/// @returns 0 when all the free memory is in a single block (or there is none), rising
+/// towards 100 as the free memory is split into more, smaller blocks.
+uint8_t memory::getFragmentation()
+{
+    const uint16_t largest{ getLargestFreeBlock() };
+
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( !_freeBytes ) {
+            return 0;
+        }
+
+        return 100 - (uint8_t) ( ( 100UL * largest ) / _freeBytes );
+    }
+}
+
+
+/// @brief Gets the low-water mark of free memory
+/// @returns The fewest free bytes there have been since the system started, or since
+/// resetLowestFreeBytes() was last called.
+uint16_t memory::getLowestFreeBytes()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( !_firstBlock ) {
+            initHeap();
+        }
+
+        return _lowestFreeBytes;
+    }
+}
+
+
+/// @brief Starts a new low-water mark from the amount of memory free right now
+void memory::resetLowestFreeBytes()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( !_firstBlock ) {
+            initHeap();
+        }
+
+        _lowestFreeBytes = _freeBytes;
+    }
+}
+
+
+#endif
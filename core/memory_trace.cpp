@@ -0,0 +1,118 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+/// @file
+/// @brief Contains the heap trace ring
+/// @details Built with `HEAP_TRACE = 1` in the `makefile`. Every allocate, free and
+/// claim is recorded into a small ring in SRAM. Send the records to a host, raw, and
+/// `tools/heapviz.py` will replay them to show how the heap filled up over time, what
+/// leaked, and where it fragments.
+
+
+#ifdef ZERO_HEAP_TRACE
+
+
+#include <stdint.h>
+
+#include "memory.h"
+#include "thread.h"
+#include "util.h"
+
+
+using namespace zero;
+using namespace zero::memory;
+
+
+namespace {
+
+    static_assert( HEAP_TRACE_RECORDS > 0 and HEAP_TRACE_RECORDS < 256, "HEAP_TRACE_RECORDS must be 1-255" );
+
+    TraceRecord _trace[ HEAP_TRACE_RECORDS ];
+    uint8_t _traceHead{ 0 };                            // where the next record goes
+    uint8_t _traceCount{ 0 };
+    uint8_t _sequence{ 0 };
+    uint16_t _dropped{ 0 };
+
+}    // namespace
+
+
+/// @private
+/// @brief Records a heap operation in the trace ring
+/// @details Called by the heap with context switching off. When the ring is full the
+/// new record is dropped, so that what's already there still replays correctly.
+void memory::trace(
+    const TraceOp op,
+    const void* const address,
+    const uint16_t numBytes,
+    const void* const caller )
+{
+    // the sequence number counts dropped records too, so the host can see the gap
+    const uint8_t sequence{ _sequence++ };
+
+    if ( _traceCount == HEAP_TRACE_RECORDS ) {
+        _dropped++;
+        return;
+    }
+
+    const Thread* const t{ Thread::getCurrentOrNull() };
+    TraceRecord& rec{ _trace[ _traceHead ] };
+
+    rec.op = op;
+    rec.sequence = sequence;
+    rec.threadId = t ? (uint8_t) t->getThreadId() : 0xFF;
+    rec.address = (uint16_t) (uintptr_t) address;
+    rec.numBytes = numBytes;
+    rec.caller = (uint16_t) (uintptr_t) caller;
+
+    if ( ++_traceHead == HEAP_TRACE_RECORDS ) {
+        _traceHead = 0;
+    }
+
+    _traceCount++;
+}
+
+
+/// @brief Takes records out of the heap trace ring, oldest first
+/// @details Call this often enough that the ring doesn't fill, and send the records
+/// somewhere they can be kept, such as out of a `UsartTx`. Don't allocate any memory
+/// between reading the records and sending them, or the trace will mostly be about
+/// itself.
+/// @param dest Where to put the records.
+/// @param maxRecords The most records to take.
+/// @returns The number of records taken.
+uint8_t memory::readTrace( TraceRecord* const dest, const uint8_t maxRecords )
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        const uint8_t numRecords{ (uint8_t) ( MIN( maxRecords, _traceCount ) ) };
+        uint8_t tail{ (uint8_t) ( ( _traceHead + HEAP_TRACE_RECORDS - _traceCount ) % HEAP_TRACE_RECORDS ) };
+
+        for ( uint8_t i = 0; i < numRecords; i++ ) {
+            dest[ i ] = _trace[ tail ];
+
+            if ( ++tail == HEAP_TRACE_RECORDS ) {
+                tail = 0;
+            }
+        }
+
+        _traceCount -= numRecords;
+
+        return numRecords;
+    }
+}
+
+
+/// @brief Gets the number of heap operations left out of the trace because it was full
+uint16_t memory::getTraceDroppedCount()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        return _dropped;
+    }
+}
+
+
+#endif
@@ -31,6 +31,10 @@
 #include "util.h"
 #include "attrs.h"
 
+#ifdef ZERO_DRIVERS_STACKSWAP
+    #include "stackswap.h"
+#endif
+
 
 using namespace zero;
 
@@ -79,6 +83,16 @@ namespace {
 
     #define MIN_STACK_BYTES 128
 
+    #ifdef ZERO_DRIVERS_STACKSWAP
+        // Thread::_swapState values
+        const uint8_t SWAP_DISABLED{ 0 };               // not managed by the StackSwapper
+        const uint8_t SWAP_RESIDENT{ 1 };               // stack in SRAM, running or ready to
+        const uint8_t SWAP_BLOCKED{ 2 };                // stack in SRAM, blocked in wait()
+        const uint8_t SWAP_WRITING{ 3 };                // stack being written out
+        const uint8_t SWAP_OUT{ 4 };                    // stack in SPI memory, still blocked
+        const uint8_t SWAP_WOKEN{ 5 };                  // stack in SPI memory, signalled
+    #endif
+
 
     // the offsets from the stack top (as seen AFTER all the registers have been pushed onto
     // the stack already) of each of the nine (9) parameters that are register-passed by GCC
@@ -178,6 +192,13 @@ void WEAK onStackOverflow( Thread& )
 int WEAK idleThreadEntry()
 {
     while ( true ) {
+        #ifdef ZERO_HEAP_MOVABLE
+            // tidy the heap a chunk at a time, and only sleep once it's tidy
+            if ( memory::compact() ) {
+                continue;
+            }
+        #endif
+
         Power::sleep( SLEEP_MODE_IDLE );
     }
 }
@@ -244,6 +265,19 @@ void Thread::globalThreadEntry(
     // call global Thread termination handler
     onThrexit( t, ec );
 
+    #ifdef ZERO_HEAP_ACCOUNTING
+        // report anything the Thread didn't free
+        memory::closeAccount( t );
+    #endif
+
+    #ifdef ZERO_DRIVERS_STACKSWAP
+        // the StackSwapper mustn't hang on to us
+        if ( t._swapState != SWAP_DISABLED ) {
+            onSwappableThreadExit( t );
+            t._swapState = SWAP_DISABLED;
+        }
+    #endif
+
     // Pool Threads get returned to the pool, and
     // other Threads get cleaned up
     if ( flags & TF_POOL_THREAD ) {
@@ -267,6 +301,16 @@ Thread& Thread::getCurrent()
 }
 
 
+/// @private
+/// @brief Gets the currently executing Thread, if there is one
+/// @returns A pointer to the currently executing Thread, or `nullptr` before the
+/// scheduler starts and while a Thread is exiting.
+Thread* Thread::getCurrentOrNull()
+{
+    return _currentThread;
+}
+
+
 /// @brief Gets the number of milliseconds since the MCU started
 /// @returns The number milliseconds since the last reset event.
 /// @note Wraps around after approximately 49 continuous days.
@@ -450,6 +494,11 @@ Thread::Thread(
 {
     dbg_assert( _stackBottom and _stackSize, "No stack memory" );
 
+    #ifdef ZERO_HEAP_ACCOUNTING
+        // the stack belongs to the new Thread, not the one creating it
+        memory::disown( _stackBottom );
+    #endif
+
     ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
         // Pool Threads get stored away, ready for use
         if ( flags & TF_POOL_THREAD ) {
@@ -949,6 +998,14 @@ SignalBitField Thread::wait( const SignalBitField sigs, const Duration timeout )
 
         // if there aren't any, block to wait for them
         if ( !rc ) {
+            #ifdef ZERO_DRIVERS_STACKSWAP
+                // from here on, our stack may be swapped out
+                if ( _swapState == SWAP_RESIDENT ) {
+                    _swapState = SWAP_BLOCKED;
+                    _swapTime = _milliseconds;
+                }
+            #endif
+
             // this will block until at least one signal is
             // received that we are waiting for. Execution
             // will resume immediately following the yield()
@@ -1002,6 +1059,24 @@ void Thread::signal( const SignalBitField sigs )
                 this->_timeoutOffset = 0UL;
             }
 
+            #ifdef ZERO_DRIVERS_STACKSWAP
+                // if our stack isn't in SRAM, the StackSwapper has to bring
+                // it back first, and it'll put us in the active list after
+                if ( _swapState >= SWAP_WRITING ) {
+                    if ( _swapState != SWAP_WOKEN ) {
+                        _swapState = SWAP_WOKEN;
+                        _swapTime = _milliseconds;
+                        onSwappedThreadWake( *this );
+                    }
+
+                    return;
+                }
+
+                if ( _swapState == SWAP_BLOCKED ) {
+                    _swapState = SWAP_RESIDENT;
+                }
+            #endif
+
             // put it at the top of the active list, ready to go
             ACTIVE_LIST.remove( *this );
             ACTIVE_LIST.prepend( *this );
@@ -1010,6 +1085,109 @@ void Thread::signal( const SignalBitField sigs )
 }
 
 
+#ifdef ZERO_DRIVERS_STACKSWAP
+
+// Lets the StackSwapper take over (or give up) the Thread's stack. A Thread
+// can't be handed back while its stack is out in SPI memory.
+bool Thread::setSwappable( const bool swappable )
+{
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        if ( _swapState >= SWAP_WRITING ) {
+            return false;
+        }
+
+        if ( !swappable ) {
+            _swapState = SWAP_DISABLED;
+        }
+        else if ( _swapState == SWAP_DISABLED ) {
+            // we can't tell how long it's been waiting, if it is,
+            // so it only becomes a candidate from its next wait()
+            _swapState = SWAP_RESIDENT;
+        }
+    }
+
+    return true;
+}
+
+
+// Claims the Thread for swapping out, if it's been blocked for at least idleMs.
+// Until endSwapOut(), the Thread won't run even if it's signalled.
+bool Thread::beginSwapOut( const uint32_t idleMs )
+{
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        if ( _swapState == SWAP_BLOCKED and _milliseconds - _swapTime >= idleMs ) {
+            _swapState = SWAP_WRITING;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// Called once the stack image has been written out. If the Thread was signalled
+// meanwhile, it's made ready again and `false` returned, otherwise its stack is
+// freed.
+bool Thread::endSwapOut()
+{
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        if ( _swapState == SWAP_WOKEN ) {
+            _swapState = SWAP_RESIDENT;
+            ACTIVE_LIST.prepend( *this );
+            return false;
+        }
+
+        memory::free( _stackBottom, _stackSize );
+        _swapState = SWAP_OUT;
+    }
+
+    return true;
+}
+
+
+// Determines if the Thread has been signalled while its stack was swapped out
+bool Thread::isAwaitingSwapIn() const
+{
+    return _swapState == SWAP_WOKEN;
+}
+
+
+// Takes back the Thread's stack memory, at the same address as before, because the
+// image is full of pointers into itself. Fails if any of it has been allocated since.
+bool Thread::beginSwapIn()
+{
+    if ( _swapState < SWAP_OUT ) {
+        return false;
+    }
+
+    return memory::claim( _stackBottom, _stackSize );
+}
+
+
+// Called once the stack image has been read back in. If the Thread was signalled
+// while it was out, it's made ready, wakeMs is set to how long that took, and `true`
+// is returned.
+bool Thread::endSwapIn( uint32_t& wakeMs )
+{
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        if ( _swapState == SWAP_WOKEN ) {
+            wakeMs = _milliseconds - _swapTime;
+            _swapState = SWAP_RESIDENT;
+            ACTIVE_LIST.prepend( *this );
+            return true;
+        }
+
+        // still waiting - with a fresh idle time
+        _swapState = SWAP_BLOCKED;
+        _swapTime = _milliseconds;
+    }
+
+    return false;
+}
+
+#endif
+
+
 // Creates the Thread pool
 static void createPoolThreads()
 {
@@ -154,6 +154,26 @@ namespace zero {
         Thread* _prev;
         Thread* _next;
 
+        #ifdef ZERO_DRIVERS_STACKSWAP
+            // stack swapping, driven by the StackSwapper
+            volatile uint8_t _swapState{ 0 };
+            uint32_t _swapTime;
+
+            bool setSwappable( const bool swappable );
+            bool beginSwapOut( const uint32_t idleMs );
+            bool endSwapOut();
+            bool isAwaitingSwapIn() const;
+            bool beginSwapIn();
+            bool endSwapIn( uint32_t& wakeMs );
+        #endif
+
+        #ifdef ZERO_HEAP_ACCOUNTING
+            // the account this Thread's heap allocations are charged to, or zero (0)
+            uint8_t _heapAccount{ 0 };
+        #endif
+
+        static Thread* getCurrentOrNull();
+
     private:
         friend class Synapse;
 
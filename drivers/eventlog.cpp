@@ -0,0 +1,258 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_SPIMEM
+
+
+#include <stdint.h>
+
+#include <util/atomic.h>
+
+#include "eventlog.h"
+#include "memory.h"
+#include "util.h"
+
+
+using namespace zero;
+
+
+namespace {
+
+    // records in each half of the export buffer
+    const uint8_t EXPORT_RECORDS{ 4 };
+
+}    // namespace
+
+
+/// @brief Creates a new EventLog
+/// @param mem The SpiMemory holding the ring.
+/// @param baseAddr The address in the chip at which the ring starts.
+/// @param ringBytes The size of the ring in the chip. Only whole records are used.
+/// @param stagedSyn The Synapse to signal when the staging ring is half full. It
+/// should belong to the Thread that calls drain().
+/// @param stagingRecords The number of records the staging ring in local SRAM holds.
+/// Make this big enough to ride out the longest burst between drains.
+EventLog::EventLog(
+    SpiMemory& mem,
+    const uint32_t baseAddr,
+    const uint32_t ringBytes,
+    const Synapse& stagedSyn,
+    const uint8_t stagingRecords )
+:
+    _mem{ mem },
+    _baseAddr{ baseAddr },
+    _stagedSyn{ stagedSyn }
+{
+    if ( !mem or !stagedSyn ) return;
+    if ( stagingRecords < 2 ) return;
+    if ( ringBytes < sizeof( EventRecord ) ) return;
+
+    _staging = (EventRecord*) memory::allocate(
+        ( stagingRecords + 2 * EXPORT_RECORDS ) * sizeof( EventRecord ),
+        &_allocatedBytes );
+
+    if ( _staging ) {
+        _stagingRecords = stagingRecords;
+        _ringRecords = ringBytes / sizeof( EventRecord );
+    }
+}
+
+
+// dtor
+EventLog::~EventLog()
+{
+    if ( *this ) {
+        _mem.waitUntilIdle();
+
+        ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+            memory::free( _staging, _allocatedBytes );
+            _staging = nullptr;
+        }
+    }
+}
+
+
+/// @brief Determines if the EventLog initialized correctly
+/// @returns `true` if the EventLog initialized correctly, `false` otherwise.
+EventLog::operator bool() const
+{
+    return _staging;
+}
+
+
+/// @brief Logs an event
+/// @param code What happened.
+/// @param value Optional. Default: 0. Any detail that goes with the event.
+/// @returns `true` if the event was staged, `false` if the staging ring was full and
+/// the event was dropped.
+/// @note log() never blocks, and may be called from within an ISR.
+bool EventLog::log( const uint16_t code, const uint16_t value )
+{
+    const uint32_t timestamp{ Thread::now() };
+
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        if ( !_staging ) {
+            return false;
+        }
+
+        if ( _stagedCount == _stagingRecords ) {
+            _dropped++;
+            return false;
+        }
+
+        EventRecord& rec{ _staging[ _stagedHead ] };
+        rec.timestamp = timestamp;
+        rec.code = code;
+        rec.value = value;
+
+        if ( ++_stagedHead == _stagingRecords ) {
+            _stagedHead = 0;
+        }
+
+        // time for the drainer to get busy
+        if ( ++_stagedCount == _stagingRecords / 2 ) {
+            _stagedSyn.signal();
+        }
+    }
+
+    return true;
+}
+
+
+/// @brief Writes all the staged records out to the chip
+/// @details Records are written straight from the staging ring, a contiguous run at a
+/// time, while producers carry on logging into the rest of it.
+void EventLog::drain()
+{
+    if ( !*this ) return;
+
+    while ( true ) {
+        uint8_t tail;
+        uint8_t numRecords;
+
+        // the staged records up to the end of the staging ring
+        ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+            tail = _stagedTail;
+            numRecords = MIN( _stagedCount, _stagingRecords - tail );
+        }
+
+        if ( !numRecords ) break;
+
+        // ... and the chip's ring might wrap in the middle of them
+        const uint32_t first{ MIN( (uint32_t) numRecords, _ringRecords - _writeIndex ) };
+
+        _mem.write(
+            &_staging[ tail ],
+            getAddressForRecord( _writeIndex ),
+            first * sizeof( EventRecord ) );
+
+        if ( numRecords > first ) {
+            _mem.write(
+                &_staging[ tail + first ],
+                getAddressForRecord( 0 ),
+                ( numRecords - first ) * sizeof( EventRecord ) );
+        }
+
+        _mem.waitUntilIdle();
+
+        _writeIndex = ( _writeIndex + numRecords ) % _ringRecords;
+        _storedRecords = MIN( _storedRecords + numRecords, _ringRecords );
+
+        // hand the slots back to the producers
+        ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+            _stagedTail = ( tail + numRecords ) % _stagingRecords;
+            _stagedCount -= numRecords;
+        }
+    }
+}
+
+
+/// @brief Gets the number of records held in the chip's ring
+/// @returns The number of drained records that haven't been overwritten yet.
+uint32_t EventLog::getRecordCount() const
+{
+    return _storedRecords;
+}
+
+
+/// @brief Gets the number of events dropped because the staging ring was full
+/// @returns The number of events lost since the EventLog was created.
+uint32_t EventLog::getDroppedCount() const
+{
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        return _dropped;
+    }
+}
+
+
+#ifdef ZERO_DRIVERS_USART
+#ifdef UCSR0B
+
+/// @brief Sends the contents of the ring, oldest record first, over a UsartTx
+/// @details Anything still staged is drained first. The records are sent as raw
+/// EventRecords, little-endian, with no framing. Reading the next few records from
+/// the chip overlaps with sending the previous few. It returns once the last of them
+/// has gone, as they're sent from the EventLog's own staging buffer.
+/// @param tx The transmitter to send the records with. Its ready Synapse must belong
+/// to the calling Thread.
+/// @returns The number of records sent.
+uint32_t EventLog::exportTo( UsartTx& tx )
+{
+    if ( !*this or !tx ) return 0;
+
+    drain();
+
+    EventRecord* const exportBuffer{ _staging + _stagingRecords };
+    const uint32_t numRecords{ _storedRecords };
+    uint32_t index{ ( _writeIndex + _ringRecords - _storedRecords ) % _ringRecords };
+    uint32_t sent{ 0UL };
+
+    while ( sent < numRecords ) {
+        const uint8_t chunk{ (uint8_t) ( MIN( numRecords - sent, (uint32_t) EXPORT_RECORDS ) ) };
+        const uint8_t first{ (uint8_t) ( MIN( (uint32_t) chunk, _ringRecords - index ) ) };
+
+        // the last transmit() only started once the one before it, from
+        // this half of the buffer, had finished, so this half is free
+        EventRecord* const half{ exportBuffer + _exportHalf * EXPORT_RECORDS };
+
+        _mem.read( half, getAddressForRecord( index ), first * sizeof( EventRecord ) );
+
+        if ( chunk > first ) {
+            _mem.read( half + first, getAddressForRecord( 0 ), ( chunk - first ) * sizeof( EventRecord ) );
+        }
+
+        _mem.waitUntilIdle();
+
+        if ( !tx.transmit( half, chunk * sizeof( EventRecord ), true ) ) {
+            break;
+        }
+
+        _exportHalf ^= 1;
+        index = ( index + chunk ) % _ringRecords;
+        sent += chunk;
+    }
+
+    // the export buffer is part of the EventLog's own allocation, which could be
+    // freed as soon as this returns
+    tx.waitUntilIdle();
+
+    return sent;
+}
+
+#endif
+#endif
+
+
+// Returns the address in the chip of a record in the ring
+uint32_t EventLog::getAddressForRecord( const uint32_t index ) const
+{
+    return _baseAddr + index * sizeof( EventRecord );
+}
+
+
+#endif
@@ -0,0 +1,108 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_SPIMEM
+
+
+#ifndef TCRI_ZERO_EVENTLOG_H
+#define TCRI_ZERO_EVENTLOG_H
+
+
+#include <stdint.h>
+
+#include "thread.h"
+#include "sram.h"
+
+#ifdef ZERO_DRIVERS_USART
+    #include "usart.h"
+#endif
+
+
+namespace zero {
+
+    /// @brief One entry in an EventLog
+    struct EventRecord {
+        uint32_t timestamp;                             // milliseconds since boot, from Thread::now()
+        uint16_t code;                                  // what happened
+        uint16_t value;                                 // event-specific detail
+    };
+
+
+    /// @brief Captures bursts of events into a ring in external SPI memory
+    /// @details log() may be called from any Thread or ISR. It stamps the event with
+    /// the time and drops it into a small staging ring in local SRAM, without ever
+    /// waiting on the SPI bus. When the staging ring is half full, the EventLog
+    /// signals `stagedSyn`, and the Thread that owns it calls drain() to write the
+    /// staged records to the chip in as few transfers as possible. The region of
+    /// the chip is itself a ring, so once it's full the oldest records are
+    /// overwritten. Events logged while the staging ring is full are counted, and
+    /// dropped.
+    ///
+    /// drain() and exportTo() must be called from the Thread that owns the
+    /// SpiMemory's ready Synapse.
+    /// @par Example
+    /// @code
+    /// EventLog* events;
+    ///
+    /// int eventDrainer()
+    /// {
+    ///     Synapse memReadySyn;
+    ///     Synapse stagedSyn;
+    ///     Gpio memCs{ ZERO_PINB2 };
+    ///     SpiMemory mem{ 128 * 1024UL, memCs, memReadySyn };
+    ///     EventLog log{ mem, 0UL, 64 * 1024UL, stagedSyn };
+    ///
+    ///     events = &log;
+    ///
+    ///     while ( true ) {
+    ///         stagedSyn.wait( 100_ms );
+    ///         log.drain();
+    ///     }
+    /// }
+    ///
+    /// ISR( INT0_vect )
+    /// {
+    ///     events->log( EVENT_BUTTON, PIND );
+    /// }
+    /// @endcode
+    class EventLog {
+    public:
+        EventLog(
+            SpiMemory& mem,                             // the memory holding the ring
+            const uint32_t baseAddr,                    // where in the chip the ring starts
+            const uint32_t ringBytes,                   // size of the ring in the chip
+            const Synapse& stagedSyn,                   // signalled when the staging ring is half full
+            const uint8_t stagingRecords = 16 );        // size of the staging ring, in records
+
+        bool log(
+            const uint16_t code,                        // what happened
+            const uint16_t value = 0 );                 // event-specific detail
+
+        void drain();                                   // Writes the staged records to the chip
+
+        uint32_t getRecordCount() const;                // Records held in the chip's ring
+        uint32_t getDroppedCount() const;               // Records lost to a full staging ring
+
+        #ifdef ZERO_DRIVERS_USART
+            #ifdef UCSR0B
+                uint32_t exportTo( UsartTx& tx );       // Sends the ring, oldest first
+            #endif
+        #endif
+
+        explicit operator bool() const;
+
+        #include "eventlog_private.h"
+    };
+
+}    // namespace zero
+
+
+#endif
+
+
+#endif
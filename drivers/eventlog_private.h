@@ -0,0 +1,38 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~EventLog();
+
+private:
+    EventLog( const EventLog& l ) = delete;
+    void operator=( const EventLog& l ) = delete;
+
+    uint32_t getAddressForRecord( const uint32_t index ) const;
+
+    SpiMemory& _mem;
+    const uint32_t _baseAddr{ 0UL };
+    const Synapse& _stagedSyn;
+
+    // staging ring, in local SRAM, followed by the export buffer
+    EventRecord* _staging{ nullptr };
+    uint16_t _allocatedBytes{ 0 };
+    uint8_t _stagingRecords{ 0 };
+    volatile uint8_t _stagedHead{ 0 };                  // where the next event goes
+    volatile uint8_t _stagedTail{ 0 };                  // the oldest staged event
+    volatile uint8_t _stagedCount{ 0 };
+    volatile uint32_t _dropped{ 0UL };
+
+    // the ring in the chip
+    uint32_t _ringRecords{ 0UL };
+    uint32_t _writeIndex{ 0UL };                        // where the next drained record goes
+    uint32_t _storedRecords{ 0UL };
+
+    // which half of the export buffer is next to be filled
+    uint8_t _exportHalf{ 0 };
@@ -0,0 +1,272 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_FARHEAP
+
+
+#include <stdint.h>
+
+#include "farheap.h"
+#include "memory.h"
+#include "thread.h"
+
+
+using namespace zero;
+
+
+namespace {
+
+    static_assert( FAR_PAGE_BYTES > 0, "Far pages must have at least one (1) byte each" );
+    static_assert( FAR_PAGES > 0, "Far heap cannot be zero (0) pages in size" );
+    static_assert( FAR_PAGES <= 0x7FFF, "Far heap has too many pages - increase FAR_PAGE_BYTES" );
+
+
+    // Returns the number of far pages needed to store the supplied number of bytes
+    constexpr uint32_t getNumPagesForBytes( const uint32_t bytes )
+    {
+        return ( bytes + ( FAR_PAGE_BYTES - 1 ) ) / FAR_PAGE_BYTES;
+    }
+
+}    // namespace
+
+
+/// @brief Determines if the FarHandle refers to an allocated block
+/// @returns `true` if the handle is for an allocated block, `false` otherwise.
+FarHandle::operator bool() const
+{
+    return _numPages;
+}
+
+
+/// @brief Returns the usable size of the block
+/// @returns The number of bytes in the block. This is always a whole number of far
+/// pages, so may be more than was asked for.
+uint32_t FarHandle::getSize() const
+{
+    return (uint32_t) _numPages * FAR_PAGE_BYTES;
+}
+
+
+/// @brief Creates a new FarHeap
+/// @param mem The SpiMemory chip whose pages are to be managed.
+/// @param baseAddr The address in the chip at which the heap starts. Anything below
+/// this is left alone, for the application to use directly.
+/// @note The FarHeap has to be used by the same Thread that owns the SpiMemory's ready
+/// Synapse.
+FarHeap::FarHeap(
+    SpiMemory& mem,
+    const uint32_t baseAddr )
+:
+    _mem{ mem },
+    _baseAddr{ baseAddr }
+{
+    // empty - a new PageManager starts with every page free
+}
+
+
+/// @brief Determines if the FarHeap initialized correctly
+/// @returns `true` if the FarHeap initialized correctly, `false` otherwise.
+FarHeap::operator bool() const
+{
+    return (bool) _mem;
+}
+
+
+/// @brief Allocates a block of external memory
+/// @param bytesReqd The minimum number of bytes required.
+/// @param strategy Optional. Default: SearchStrategy::BottomUp. The method used to
+/// search the heap for free pages.
+/// @returns A FarHandle for the block. This tests `false` if the allocation failed.
+FarHandle FarHeap::allocate(
+    const uint32_t bytesReqd,
+    const memory::SearchStrategy strategy )
+{
+    FarHandle rc;
+    const uint32_t numPages{ getNumPagesForBytes( bytesReqd ) };
+
+    if ( !*this or !numPages or numPages > FAR_PAGES ) {
+        return rc;
+    }
+
+    // one Thread allocating at a time, thank you
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        const int16_t startPage{ _pages.findFreePages( numPages, strategy ) };
+
+        if ( startPage >= 0 ) {
+            for ( uint16_t curPage = startPage; curPage < startPage + numPages; curPage++ ) {
+                _pages.markAsUsed( curPage );
+            }
+
+            rc._startPage = startPage;
+            rc._numPages = numPages;
+        }
+    }
+
+    return rc;
+}
+
+
+/// @brief Returns a block to the FarHeap
+/// @param handle The handle of the block to free. It's cleared afterwards.
+void FarHeap::free( FarHandle& handle )
+{
+    if ( !handle ) return;
+
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        for ( uint16_t curPage = handle._startPage;
+            curPage < handle._startPage + handle._numPages;
+            curPage++ )
+        {
+            _pages.markAsFree( curPage );
+        }
+    }
+
+    handle = FarHandle();
+}
+
+
+/// @brief Reads part of a block into local SRAM
+/// @param handle The block to read from.
+/// @param offset The offset into the block of the first byte to read.
+/// @param dest A pointer to local SRAM where the data should be placed.
+/// @param numBytes The number of bytes to read.
+/// @returns `true` if the data was read, `false` if the range falls outside the block.
+bool FarHeap::read(
+    const FarHandle& handle,
+    const uint32_t offset,
+    void* dest,
+    const uint16_t numBytes )
+{
+    if ( !isInRange( handle, offset, numBytes ) ) {
+        return false;
+    }
+
+    _mem.read( dest, getAddressForPage( handle._startPage ) + offset, numBytes );
+    _mem.waitUntilIdle();
+
+    return true;
+}
+
+
+/// @brief Writes local SRAM into part of a block
+/// @param handle The block to write to.
+/// @param offset The offset into the block of the first byte to write.
+/// @param src A pointer to the data, in local SRAM.
+/// @param numBytes The number of bytes to write.
+/// @returns `true` if the data was written, `false` if the range falls outside the
+/// block.
+bool FarHeap::write(
+    const FarHandle& handle,
+    const uint32_t offset,
+    const void* src,
+    const uint16_t numBytes )
+{
+    if ( !isInRange( handle, offset, numBytes ) ) {
+        return false;
+    }
+
+    _mem.write( src, getAddressForPage( handle._startPage ) + offset, numBytes );
+    _mem.waitUntilIdle();
+
+    return true;
+}
+
+
+/// @brief Brings part of a block into local SRAM, to be worked on directly
+/// @param handle The block to pin.
+/// @param offset The offset into the block of the first byte to pin.
+/// @param numBytes The number of bytes to pin.
+/// @returns A pointer to the bytes in local SRAM, or `nullptr` if the range falls
+/// outside the block or there's not enough SRAM.
+/// @note Every successful pin() must be matched with a call to unpin(). The pinned
+/// bytes are a copy - changes only reach the chip when they're unpinned.
+void* FarHeap::pin(
+    const FarHandle& handle,
+    const uint32_t offset,
+    const uint16_t numBytes )
+{
+    if ( !isInRange( handle, offset, numBytes ) or !numBytes ) {
+        return nullptr;
+    }
+
+    // the header goes in front, and the two together must still fit in 16 bits
+    if ( numBytes > 0xFFFF - sizeof( PinHeader ) ) {
+        return nullptr;
+    }
+
+    uint16_t allocatedBytes;
+    PinHeader* const hdr{ (PinHeader*) memory::allocate( sizeof( PinHeader ) + numBytes, &allocatedBytes ) };
+
+    if ( !hdr ) {
+        return nullptr;
+    }
+
+    hdr->farAddr = getAddressForPage( handle._startPage ) + offset;
+    hdr->numBytes = numBytes;
+    hdr->allocatedBytes = allocatedBytes;
+
+    _mem.read( hdr + 1, hdr->farAddr, numBytes );
+    _mem.waitUntilIdle();
+
+    return hdr + 1;
+}
+
+
+/// @brief Releases bytes pinned by pin(), optionally writing them back to the chip
+/// @param pinned The pointer returned by pin().
+/// @param writeBack Optional. Default: `true`. Pass `false` if the bytes weren't
+/// changed, to save the write.
+void FarHeap::unpin( void* pinned, const bool writeBack )
+{
+    if ( !pinned ) return;
+
+    PinHeader* const hdr{ ( (PinHeader*) pinned ) - 1 };
+
+    if ( writeBack ) {
+        _mem.write( pinned, hdr->farAddr, hdr->numBytes );
+        _mem.waitUntilIdle();
+    }
+
+    memory::free( hdr, hdr->allocatedBytes );
+}
+
+
+/// @brief Returns the number of bytes in the FarHeap that are free
+/// @returns The number of free bytes. They may not all be contiguous.
+uint32_t FarHeap::getFreeBytes() const
+{
+    return (uint32_t) _pages.getFreePageCount() * FAR_PAGE_BYTES;
+}
+
+
+/// @brief Returns the number of bytes in the FarHeap that are allocated
+/// @returns The number of allocated bytes.
+uint32_t FarHeap::getUsedBytes() const
+{
+    return (uint32_t) _pages.getUsedPageCount() * FAR_PAGE_BYTES;
+}
+
+
+// determines if an access falls entirely inside a block
+bool FarHeap::isInRange(
+    const FarHandle& handle,
+    const uint32_t offset,
+    const uint16_t numBytes ) const
+{
+    return handle and offset <= handle.getSize() and numBytes <= handle.getSize() - offset;
+}
+
+
+// returns the address in the chip of a given far page
+uint32_t FarHeap::getAddressForPage( const uint16_t pageNumber ) const
+{
+    return _baseAddr + ( (uint32_t) pageNumber * FAR_PAGE_BYTES );
+}
+
+
+#endif
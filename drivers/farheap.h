@@ -0,0 +1,121 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_FARHEAP
+
+
+#ifndef TCRI_ZERO_FARHEAP_H
+#define TCRI_ZERO_FARHEAP_H
+
+
+#ifndef ZERO_DRIVERS_SPIMEM
+    #error "ZERO_DRIVERS_FARHEAP requires ZERO_DRIVERS_SPIMEM"
+#endif
+
+
+#include <stdint.h>
+
+#include "pagemanager.h"
+#include "sram.h"
+
+
+namespace zero {
+
+    /// @brief An opaque reference to a block of memory in a FarHeap
+    class FarHandle {
+    public:
+        explicit operator bool() const;                 // Determines if the handle refers to a block
+        uint32_t getSize() const;                       // Usable size of the block, in bytes
+
+    private:
+        friend class FarHeap;
+
+        uint16_t _startPage{ 0 };
+        uint16_t _numPages{ 0 };
+    };
+
+
+    /// @brief Provides page-based dynamic allocation of external SPI memory
+    /// @details FarHeap manages the pages of an SpiMemory chip with the same
+    /// PageManager the SRAM allocator uses, so big buffers like sample histories and
+    /// lookup tables can live off-chip. The heap's size and page size are set in the
+    /// `makefile` - search for `FAR_HEAP_BYTES` and `FAR_PAGE_BYTES`. Blocks are
+    /// reached with read() and write(), or by pinning part of a block into local SRAM,
+    /// working on it there, and unpinning it to write it back. All calls block the
+    /// calling Thread until the transfer is done.
+    /// @par Example
+    /// @code
+    /// int farHeapDemo()
+    /// {
+    ///     Synapse memReadySyn;
+    ///     Gpio memCs{ ZERO_PINB2 };
+    ///     SpiMemory mem{ 128 * 1024UL, memCs, memReadySyn };
+    ///     FarHeap far{ mem };
+    ///
+    ///     FarHandle history{ far.allocate( 8192 ) };
+    ///
+    ///     if ( history ) {
+    ///         uint16_t* samples{ (uint16_t*) far.pin( history, 0, 64 ) };
+    ///
+    ///         if ( samples ) {
+    ///             samples[ 0 ] = 42;
+    ///             far.unpin( samples );
+    ///         }
+    ///
+    ///         far.free( history );
+    ///     }
+    /// }
+    /// @endcode
+    class FarHeap {
+    public:
+        FarHeap(
+            SpiMemory& mem,                             // the memory chip to manage
+            const uint32_t baseAddr = 0UL );            // where in the chip the heap starts
+
+        FarHandle allocate(
+            const uint32_t bytesReqd,
+            const memory::SearchStrategy strategy = memory::SearchStrategy::BottomUp );
+
+        void free( FarHandle& handle );
+
+        bool read(
+            const FarHandle& handle,                    // the block to read from
+            const uint32_t offset,                      // offset into the block
+            void* dest,                                 // destination address, in local SRAM
+            const uint16_t numBytes );                  // number of bytes to read
+
+        bool write(
+            const FarHandle& handle,                    // the block to write to
+            const uint32_t offset,                      // offset into the block
+            const void* src,                            // source data address, in local SRAM
+            const uint16_t numBytes );                  // number of bytes to write
+
+        void* pin(
+            const FarHandle& handle,                    // the block to pin
+            const uint32_t offset,                      // offset into the block
+            const uint16_t numBytes );                  // number of bytes to bring into SRAM
+
+        void unpin(
+            void* pinned,                               // the pointer returned by pin()
+            const bool writeBack = true );              // copy the changes back to the chip?
+
+        uint32_t getFreeBytes() const;
+        uint32_t getUsedBytes() const;
+
+        explicit operator bool() const;
+
+        #include "farheap_private.h"
+    };
+
+}    // namespace zero
+
+
+#endif
+
+
+#endif
@@ -0,0 +1,33 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~FarHeap() = default;
+
+private:
+    FarHeap( const FarHeap& h ) = delete;
+    void operator=( const FarHeap& h ) = delete;
+
+    // sits in local SRAM just in front of the bytes handed out by pin()
+    struct PinHeader {
+        uint32_t farAddr;                               // where the bytes came from
+        uint16_t numBytes;                              // how many of them
+        uint16_t allocatedBytes;                        // size of the SRAM block, header included
+    };
+
+    bool isInRange(
+        const FarHandle& handle,
+        const uint32_t offset,
+        const uint16_t numBytes ) const;
+
+    uint32_t getAddressForPage( const uint16_t pageNumber ) const;
+
+    SpiMemory& _mem;
+    const uint32_t _baseAddr{ 0UL };
+    PageManager<FAR_PAGES> _pages;
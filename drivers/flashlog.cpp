@@ -0,0 +1,316 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_SPIFLASH
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "flashlog.h"
+
+
+using namespace zero;
+
+
+namespace {
+
+    const uint16_t SECTOR_MAGIC{ 0x4C47 };              // 'LG'
+    const uint16_t END_OF_SECTOR{ 0xFFFF };             // an erased record length
+    const uint8_t RECORD_COMMITTED{ 0x00 };
+    const uint8_t STAGING_BYTES{ 32 };                  // records up to this, header included, go in one program
+
+}    // namespace
+
+
+/// @brief Creates a new FlashLog
+/// @param flash The SpiFlash that holds the log.
+/// @param firstSector The number of the first flash sector that belongs to the log.
+/// @param numSectors The number of sectors that belong to the log. This must be at
+/// least two, so there's always a full sector of history when the log wraps.
+/// @note Call mount() before using the log.
+FlashLog::FlashLog(
+    SpiFlash& flash,
+    const uint16_t firstSector,
+    const uint16_t numSectors )
+:
+    _flash{ flash },
+    _firstSector{ firstSector },
+    _numSectors{ numSectors }
+{
+    // empty
+}
+
+
+/// @brief Determines if the FlashLog is ready for use
+/// @returns `true` if the log has been successfully mounted, `false` otherwise.
+FlashLog::operator bool() const
+{
+    return _mounted;
+}
+
+
+/// @brief Returns the size of the largest record that can be appended
+/// @returns The maximum record size, in bytes.
+uint16_t FlashLog::getMaxRecordBytes() const
+{
+    return SPI_FLASH_SECTOR_BYTES - sizeof( SectorHeader ) - sizeof( RecordHeader );
+}
+
+
+/// @brief Finds the end of the log, ready for appending
+/// @details Each sector's header is read to find the newest, and then that sector's
+/// records are walked to find where the next record should go. If there's no log in
+/// the sectors yet, a fresh one is started.
+/// @returns `true` if the log is ready to use, `false` otherwise.
+bool FlashLog::mount()
+{
+    _mounted = false;
+
+    if ( !_flash ) return false;
+    if ( _numSectors < 2 ) return false;
+    if ( getSectorAddress( _numSectors ) > _flash.getCapacity() ) return false;
+
+    // find the newest sector
+    bool found{ false };
+
+    for ( uint16_t s = 0; s < _numSectors; s++ ) {
+        SectorHeader hdr;
+
+        if ( readSectorHeader( s, hdr ) ) {
+            if ( !found or hdr.sequence > _headSequence ) {
+                _headSector = s;
+                _headSequence = hdr.sequence;
+                found = true;
+            }
+        }
+    }
+
+    if ( !found ) {
+        return format();
+    }
+
+    // and then the end of it
+    _headOffset = sizeof( SectorHeader );
+
+    while ( true ) {
+        RecordHeader hdr;
+
+        if ( !readRecordHeader( _headSector, _headOffset, hdr ) ) {
+            // no room for anything else - the next append moves on
+            _headOffset = SPI_FLASH_SECTOR_BYTES;
+            break;
+        }
+
+        if ( hdr.length == END_OF_SECTOR ) {
+            break;
+        }
+
+        _headOffset += sizeof( RecordHeader ) + hdr.length;
+    }
+
+    _mounted = true;
+
+    return true;
+}
+
+
+/// @brief Erases the whole log, and starts a fresh one
+/// @returns `true` if the log was formatted, `false` otherwise.
+bool FlashLog::format()
+{
+    _mounted = false;
+
+    if ( !_flash ) return false;
+    if ( _numSectors < 2 ) return false;
+
+    for ( uint16_t s = 0; s < _numSectors; s++ ) {
+        if ( !_flash.eraseSector( getSectorAddress( s ) ) ) {
+            return false;
+        }
+    }
+
+    _mounted = startSector( 0, 0UL );
+
+    return _mounted;
+}
+
+
+/// @brief Appends a record to the log
+/// @param data A pointer to the record, in local SRAM.
+/// @param numBytes The size of the record, up to getMaxRecordBytes().
+/// @returns `true` if the record was appended, `false` otherwise. A record that fails
+/// part way is never committed, so readers skip it.
+/// @note If the record won't fit in the current sector, the log moves on to the next,
+/// erasing whatever was there.
+bool FlashLog::append( const void* data, const uint16_t numBytes )
+{
+    if ( !_mounted ) return false;
+    if ( !data ) return false;
+    if ( numBytes > getMaxRecordBytes() ) return false;
+
+    if ( _headOffset + sizeof( RecordHeader ) + numBytes > SPI_FLASH_SECTOR_BYTES ) {
+        if ( !startSector( ( _headSector + 1 ) % _numSectors, _headSequence + 1 ) ) {
+            _mounted = false;
+            return false;
+        }
+    }
+
+    const uint32_t addr{ getSectorAddress( _headSector ) + _headOffset };
+    const RecordHeader hdr{ numBytes, (uint8_t) ~RECORD_COMMITTED };
+    const uint8_t committed{ RECORD_COMMITTED };
+
+    // length and data first, and only then mark it as good. Small records are put
+    // together on the stack, so the two go in one page program unless they cross a page.
+    bool lengthOk;
+    bool dataOk;
+
+    if ( sizeof( hdr ) + numBytes <= STAGING_BYTES ) {
+        uint8_t staging[ STAGING_BYTES ];
+
+        memcpy( staging, &hdr, sizeof( hdr ) );
+        memcpy( staging + sizeof( hdr ), data, numBytes );
+        lengthOk = dataOk = _flash.program( staging, addr, sizeof( hdr ) + numBytes );
+    }
+    else {
+        lengthOk = _flash.program( &hdr, addr, sizeof( hdr ) );
+        dataOk = lengthOk and _flash.program( data, addr + sizeof( hdr ), numBytes );
+    }
+
+    // a program that fails writes nothing, so without the length the space is still free
+    if ( !lengthOk ) {
+        return false;
+    }
+
+    // with it, the space is used either way. Readers skip records that aren't committed.
+    _headOffset += sizeof( RecordHeader ) + numBytes;
+
+    return dataOk
+        and _flash.program( &committed, addr + offsetof( RecordHeader, committed ), sizeof( committed ) );
+}
+
+
+/// @brief Points a cursor at the oldest record in the log
+/// @param cursor The cursor to set up.
+void FlashLog::rewind( FlashLogCursor& cursor ) const
+{
+    cursor.sector = ( _headSector + 1 ) % _numSectors;
+    cursor.offset = sizeof( SectorHeader );
+    cursor.sectorsLeft = _numSectors;
+}
+
+
+/// @brief Reads the record at a cursor, and moves the cursor on to the next
+/// @param cursor The cursor, from rewind() or a previous call to next().
+/// @param dest A pointer to local SRAM where the record should be placed.
+/// @param destBytes The room available at dest. Longer records are truncated.
+/// @param recordBytes Set to the full size of the record.
+/// @returns `true` if a record was read, `false` if there are no more.
+bool FlashLog::next(
+    FlashLogCursor& cursor,
+    void* dest,
+    const uint16_t destBytes,
+    uint16_t& recordBytes )
+{
+    recordBytes = 0;
+
+    if ( !_mounted ) return false;
+
+    while ( cursor.sectorsLeft ) {
+        RecordHeader hdr;
+        SectorHeader sectorHdr;
+
+        // sectors that were never used, or whose records have run out, are skipped
+        const bool sectorValid{
+            cursor.offset != sizeof( SectorHeader ) or readSectorHeader( cursor.sector, sectorHdr ) };
+
+        if ( !sectorValid
+            or !readRecordHeader( cursor.sector, cursor.offset, hdr )
+            or hdr.length == END_OF_SECTOR )
+        {
+            cursor.sector = ( cursor.sector + 1 ) % _numSectors;
+            cursor.offset = sizeof( SectorHeader );
+            cursor.sectorsLeft--;
+            continue;
+        }
+
+        const uint32_t addr{ getSectorAddress( cursor.sector ) + cursor.offset + sizeof( RecordHeader ) };
+
+        cursor.offset += sizeof( RecordHeader ) + hdr.length;
+
+        // torn by a power failure
+        if ( hdr.committed != RECORD_COMMITTED ) {
+            continue;
+        }
+
+        recordBytes = hdr.length;
+
+        if ( dest and destBytes ) {
+            _flash.read( dest, addr, destBytes < hdr.length ? destBytes : hdr.length );
+            _flash.waitUntilIdle();
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+
+// returns the flash address of one of the log's sectors
+uint32_t FlashLog::getSectorAddress( const uint16_t sector ) const
+{
+    return (uint32_t) ( _firstSector + sector ) * SPI_FLASH_SECTOR_BYTES;
+}
+
+
+// reads a sector's header, returning `true` if it's one of ours
+bool FlashLog::readSectorHeader( const uint16_t sector, SectorHeader& hdr )
+{
+    _flash.read( &hdr, getSectorAddress( sector ), sizeof( hdr ) );
+    _flash.waitUntilIdle();
+
+    return hdr.magic == SECTOR_MAGIC and hdr.sequence != 0xFFFFFFFFUL;
+}
+
+
+// reads a record's header, returning `false` if it couldn't possibly be one
+bool FlashLog::readRecordHeader( const uint16_t sector, const uint16_t offset, RecordHeader& hdr )
+{
+    if ( offset + sizeof( RecordHeader ) > SPI_FLASH_SECTOR_BYTES ) {
+        return false;
+    }
+
+    _flash.read( &hdr, getSectorAddress( sector ) + offset, sizeof( hdr ) );
+    _flash.waitUntilIdle();
+
+    // an erased length marks the end, but anything else has to fit
+    return hdr.length == END_OF_SECTOR
+        or offset + sizeof( RecordHeader ) + hdr.length <= SPI_FLASH_SECTOR_BYTES;
+}
+
+
+// erases a sector and stamps it as the new head of the log
+bool FlashLog::startSector( const uint16_t sector, const uint32_t sequence )
+{
+    const SectorHeader hdr{ SECTOR_MAGIC, sequence };
+    const uint32_t addr{ getSectorAddress( sector ) };
+
+    if ( !_flash.eraseSector( addr ) ) return false;
+    if ( !_flash.program( &hdr, addr, sizeof( hdr ) ) ) return false;
+
+    _headSector = sector;
+    _headOffset = sizeof( SectorHeader );
+    _headSequence = sequence;
+
+    return true;
+}
+
+
+#endif
@@ -0,0 +1,89 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_SPIFLASH
+
+
+#ifndef TCRI_ZERO_FLASHLOG_H
+#define TCRI_ZERO_FLASHLOG_H
+
+
+#include <stdint.h>
+
+#include "spiflash.h"
+
+
+namespace zero {
+
+    /// @brief A position in a FlashLog, for reading records back oldest-first
+    struct FlashLogCursor {
+        uint16_t sector;                                // sector index within the log
+        uint16_t offset;                                // offset of the next record in that sector
+        uint16_t sectorsLeft;                           // sectors still to visit
+    };
+
+
+    /// @brief An append-only record log, kept in a range of SPI flash sectors
+    /// @details Records are appended to the current sector until it's full, and then
+    /// the log moves on to the next sector, erasing it first. When the range is used
+    /// up it wraps around and erases the oldest sector, so every sector sees the same
+    /// number of erase cycles. Each sector is stamped with a sequence number, so
+    /// mount() finds the newest sector and the end of the log with one scan when the
+    /// system starts. A record only counts once it's fully programmed, so a record
+    /// torn by a power failure is skipped.
+    /// @par Example
+    /// @code
+    /// int flashLogDemo()
+    /// {
+    ///     Synapse flashReadySyn;
+    ///     Gpio flashCs{ ZERO_PINB1 };
+    ///     HardwareSpi spi;
+    ///     SpiFlash flash{ flashCs, flashReadySyn, spi };
+    ///     FlashLog log{ flash, 0, 16 };
+    ///
+    ///     if ( log.mount() ) {
+    ///         log.append( &telemetry, sizeof( telemetry ) );
+    ///     }
+    /// }
+    /// @endcode
+    class FlashLog {
+    public:
+        FlashLog(
+            SpiFlash& flash,                            // the flash chip holding the log
+            const uint16_t firstSector,                 // first flash sector of the log
+            const uint16_t numSectors );                // number of sectors, at least two
+
+        bool mount();                                   // Finds the end of the log, or starts a fresh one
+        bool format();                                  // Erases the whole log
+
+        bool append(
+            const void* data,                           // the record, in local SRAM
+            const uint16_t numBytes );                  // the record's size
+
+        void rewind( FlashLogCursor& cursor ) const;    // Points the cursor at the oldest record
+
+        bool next(
+            FlashLogCursor& cursor,                     // where to read from, updated on return
+            void* dest,                                 // where to put the record, in local SRAM
+            const uint16_t destBytes,                   // how much room there is at dest
+            uint16_t& recordBytes );                    // the full size of the record
+
+        uint16_t getMaxRecordBytes() const;             // Largest record that can be appended
+
+        explicit operator bool() const;
+
+        #include "flashlog_private.h"
+    };
+
+}    // namespace zero
+
+
+#endif
+
+
+#endif
@@ -0,0 +1,42 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~FlashLog() = default;
+
+private:
+    FlashLog( const FlashLog& l ) = delete;
+    void operator=( const FlashLog& l ) = delete;
+
+    // the first bytes of every sector in the log
+    struct SectorHeader {
+        uint16_t magic;
+        uint32_t sequence;                              // bigger is newer
+    };
+
+    // the first bytes of every record
+    struct RecordHeader {
+        uint16_t length;                                // 0xFFFF means the end of the sector
+        uint8_t committed;                              // programmed to zero once the data is in
+    };
+
+    uint32_t getSectorAddress( const uint16_t sector ) const;
+    bool readSectorHeader( const uint16_t sector, SectorHeader& hdr );
+    bool readRecordHeader( const uint16_t sector, const uint16_t offset, RecordHeader& hdr );
+    bool startSector( const uint16_t sector, const uint32_t sequence );
+
+    SpiFlash& _flash;
+    const uint16_t _firstSector{ 0 };
+    const uint16_t _numSectors{ 0 };
+
+    // where the next record goes
+    bool _mounted{ false };
+    uint16_t _headSector{ 0 };
+    uint16_t _headOffset{ 0 };
+    uint32_t _headSequence{ 0UL };
@@ -0,0 +1,15 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~HardwareSpi();
+
+private:
+    HardwareSpi( const HardwareSpi& s ) = delete;
+    void operator=( const HardwareSpi& s ) = delete;
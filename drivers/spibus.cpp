@@ -0,0 +1,510 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_SPI
+
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include <util/atomic.h>
+
+#include "spi.h"
+#include "spibus.h"
+#include "thread.h"
+#include "resource.h"
+
+
+using namespace zero;
+
+
+namespace {
+
+    HardwareSpi* _hardwareSpi{ nullptr };
+
+
+    // Works out the SPCR and SPSR bits for a set of device settings. The clock is
+    // the fastest of F_CPU/2 to F_CPU/128 that doesn't exceed clockHz.
+    void encodeHardwareSpi(
+        const uint32_t clockHz,
+        const SpiMode mode,
+        const SpiBitOrder order,
+        SpiConfig& config )
+    {
+        // SPR1:SPR0 and SPI2X for dividers of 2, 4, 8, ... 128
+        const uint8_t SPR_BITS[]{ 0, 0, 1, 1, 2, 2, 3 };
+        const uint8_t SPI2X_BITS[]{ 1, 0, 1, 0, 1, 0, 0 };
+
+        uint8_t i{ 0 };
+
+        while ( i < 6 and ( F_CPU / ( 2UL << i ) ) > clockHz ) {
+            i++;
+        }
+
+        config.values[ 0 ] = SPR_BITS[ i ];
+
+        if ( (uint8_t) mode & 2 ) config.values[ 0 ] |= ( 1 << CPOL );
+        if ( (uint8_t) mode & 1 ) config.values[ 0 ] |= ( 1 << CPHA );
+        if ( order == SpiBitOrder::LsbFirst ) config.values[ 0 ] |= ( 1 << DORD );
+
+        config.values[ 1 ] = SPI2X_BITS[ i ] << SPI2X;
+        config.values[ 2 ] = 0;
+    }
+
+}    // namespace
+
+
+// Hooks up the hardware registers that the transfer engine drives
+void SpiBus::attach(
+    volatile uint8_t* const dataReg,
+    volatile uint8_t* const ctrlReg,
+    const uint8_t isrMask,
+    volatile uint8_t* const statusReg,
+    const uint8_t txReadyMask,
+    const uint8_t depth )
+{
+    _ctrlReg = ctrlReg;
+    _isrMask = isrMask;
+    _statusReg = statusReg;
+    _txReadyMask = txReadyMask;
+    _depth = depth;
+
+    // make sure ISRs are off
+    setIsrEnable( false );
+
+    // validity is determined by this one, so it goes last
+    _dataReg = dataReg;
+}
+
+
+// Hooks up the registers that hold the per-device settings
+void SpiBus::attachConfig(
+    volatile uint8_t* const reg0,
+    const uint8_t mask0,
+    volatile uint8_t* const reg1,
+    const uint8_t mask1,
+    volatile uint8_t* const reg2,
+    const uint8_t mask2,
+    const SpiEncoder encoder,
+    const SpiConfig& defaultConfig )
+{
+    _cfgRegs[ 0 ] = reg0;
+    _cfgRegs[ 1 ] = reg1;
+    _cfgRegs[ 2 ] = reg2;
+
+    _cfgMasks[ 0 ] = mask0;
+    _cfgMasks[ 1 ] = mask1;
+    _cfgMasks[ 2 ] = mask2;
+
+    _encoder = encoder;
+    _defaultConfig = defaultConfig;
+
+    // start off with the bus's own settings
+    for ( uint8_t i = 0; i < 3; i++ ) {
+        _activeConfig.values[ i ] = ~_defaultConfig.values[ i ];
+    }
+
+    applyConfig( _defaultConfig );
+}
+
+
+// Turns device settings into register values for this bus
+void SpiBus::encode(
+    const uint32_t clockHz,
+    const SpiMode mode,
+    const SpiBitOrder order,
+    SpiConfig& config ) const
+{
+    if ( _encoder ) {
+        _encoder( clockHz, mode, order, config );
+    }
+    else {
+        config = _defaultConfig;
+    }
+}
+
+
+// Loads a device's settings into the bus, if they're not already there
+void SpiBus::applyConfig( const SpiConfig& config )
+{
+    for ( uint8_t i = 0; i < 3; i++ ) {
+        if ( _cfgRegs[ i ] and config.values[ i ] != _activeConfig.values[ i ] ) {
+            *_cfgRegs[ i ] = ( *_cfgRegs[ i ] & ~_cfgMasks[ i ] ) | config.values[ i ];
+        }
+    }
+
+    _activeConfig = config;
+}
+
+
+// dtor
+SpiBus::~SpiBus()
+{
+    if ( *this ) {
+        setIsrEnable( false );
+        _dataReg = nullptr;
+    }
+}
+
+
+/// @brief Determines if the SpiBus initialized correctly
+/// @returns `true` if the SpiBus initialized correctly, `false` otherwise.
+SpiBus::operator bool() const
+{
+    return _dataReg;
+}
+
+
+/// @brief Determines if the SpiBus is currently transferring data
+/// @returns `true` if a transfer is underway or queued, `false` otherwise.
+bool SpiBus::isBusy() const
+{
+    return _queue.getHead();
+}
+
+
+// switches the transfer-complete ISR on and off
+void SpiBus::setIsrEnable( const bool en )
+{
+    if ( en ) {
+        *_ctrlReg |= _isrMask;
+    }
+    else {
+        *_ctrlReg &= ~_isrMask;
+    }
+}
+
+
+/// @brief Queues a transfer on the bus
+/// @param xfer The transfer to run. It must stay put, untouched, until its `pending`
+/// flag clears and its `doneSyn` is signalled.
+/// @note This doesn't block. If the bus is busy, the transfer is started by the bus's
+/// ISR as soon as those ahead of it are done.
+void SpiBus::submit( SpiTransfer& xfer )
+{
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        xfer.pending = true;
+
+        // make sure no-one falls through while we're working
+        if ( xfer.doneSyn ) {
+            xfer.doneSyn->clearSignals();
+        }
+
+        const bool idle{ !_queue.getHead() };
+
+        _queue.append( xfer );
+
+        if ( idle ) {
+            startNext();
+        }
+    }
+}
+
+
+// Starts the transfer at the head of the queue, if there is one
+void SpiBus::startNext()
+{
+    SpiTransfer* const xfer{ _queue.getHead() };
+
+    if ( !xfer ) {
+        return;
+    }
+
+    // the header goes out ahead of the data, and what comes back
+    // while it's being sent is of no interest to anyone
+    _hdrCursor = xfer->header;
+    _hdrBytes = _rxSkip = xfer->headerBytes;
+
+    _txCursor = (const uint8_t*) xfer->src;
+    _txRepeat = xfer->repeatSrc and xfer->src;
+    _rxCursor = (uint8_t*) xfer->dest;
+    _txBytes = _rxBytes = xfer->headerBytes + xfer->numBytes;
+
+    if ( xfer->circular and _rxCursor and xfer->numBytes >= 2 ) {
+        _ringStart = _rxCursor;
+        _ringHalf = _ringStart + ( xfer->numBytes / 2 );
+        _ringEnd = _ringHalf + ( xfer->numBytes / 2 );
+    }
+    else {
+        _ringStart = nullptr;
+    }
+
+    if ( !_txBytes ) {
+        finish();
+        return;
+    }
+
+    // set the bus up the way the device likes it, before selecting it
+    applyConfig( xfer->config ? *xfer->config : _defaultConfig );
+
+    // tell the device that we want to talk to it
+    xfer->chipSelect->switchOff();
+
+    setIsrEnable( true );
+
+    // fill the pipeline to kickstart it - one byte for the SPI peripheral, two
+    // for the double-buffered USART - and the ISR does the rest
+    for ( uint8_t i = 0; i < _depth and _txBytes; i++ ) {
+        while ( i and !( *_statusReg & _txReadyMask ) ) {
+            // empty
+        }
+
+        sendNext();
+    }
+}
+
+
+// pushes the next byte of the transfer out onto the bus
+void SpiBus::sendNext()
+{
+    if ( _hdrBytes ) {
+        *_dataReg = *_hdrCursor++;
+        _hdrBytes--;
+    }
+    else if ( _txRepeat ) {
+        *_dataReg = *_txCursor;
+    }
+    else if ( _txCursor ) {
+        *_dataReg = *_txCursor++;
+    }
+    else {
+        *_dataReg = 0;
+    }
+
+    _txBytes--;
+}
+
+
+// Called from the bus's ISR whenever a byte has finished being exchanged
+void SpiBus::onXferComplete()
+{
+    // capture the input
+    const uint8_t rxByte{ *_dataReg };
+
+    // keep the bus busy before doing anything else
+    if ( _txBytes ) {
+        sendNext();
+    }
+
+    // remember the received byte, unless it arrived during the header
+    if ( _rxSkip ) {
+        _rxSkip--;
+    }
+    else if ( _rxCursor ) {
+        *_rxCursor++ = rxByte;
+
+        if ( _ringStart ) {
+            onRingByte();
+        }
+    }
+
+    // another 1 bytes the dust
+    if ( !--_rxBytes ) {
+        finish();
+    }
+}
+
+
+// Keeps a circular transfer going round, once a byte has been stored
+void SpiBus::onRingByte()
+{
+    const bool atEnd{ _rxCursor == _ringEnd };
+
+    if ( !atEnd and _rxCursor != _ringHalf ) {
+        return;
+    }
+
+    SpiTransfer* const xfer{ _queue.getHead() };
+    const uint16_t halfBytes{ (uint16_t) ( _ringHalf - _ringStart ) };
+
+    if ( atEnd ) {
+        _rxCursor = _ringStart;
+    }
+
+    xfer->halvesDone++;
+
+    if ( xfer->doneSyn ) {
+        xfer->doneSyn->signal();
+    }
+
+    if ( xfer->stopCircular ) {
+        // send nothing more, and throw away whatever's still in flight
+        _rxBytes -= _txBytes;
+        _txBytes = 0;
+        _rxCursor = nullptr;
+    }
+    else {
+        // another half's worth, to keep the bus busy
+        _txBytes += halfBytes;
+        _rxBytes += halfBytes;
+    }
+}
+
+
+// Wraps up the current transfer, and chains into the next one
+void SpiBus::finish()
+{
+    SpiTransfer* const xfer{ _queue.getHead() };
+
+    setIsrEnable( false );
+
+    xfer->chipSelect->switchOn();
+
+    _queue.remove( *xfer );
+
+    // multi-step transfers go to the back of the queue for their next step,
+    // so they don't hog the bus
+    if ( xfer->onDone and xfer->onDone( *xfer ) ) {
+        _queue.append( *xfer );
+    }
+    else {
+        xfer->pending = false;
+
+        if ( xfer->doneSyn ) {
+            xfer->doneSyn->signal();
+        }
+    }
+
+    startNext();
+}
+
+
+/// @brief Creates a new SpiDevice object
+/// @param bus The SpiBus (HardwareSpi or UsartSpi) that the device is attached to.
+/// @param chipSelect A Gpio object representing the chip select line of the device.
+/// @param clockHz The fastest SPI clock the device can take. The bus runs at the
+/// fastest speed it can manage that doesn't exceed this.
+/// @param mode The SPI mode (clock polarity and phase) of the device.
+/// @param order The order in which the device expects the bits of each byte.
+SpiDevice::SpiDevice(
+    SpiBus& bus,
+    Gpio& chipSelect,
+    const uint32_t clockHz,
+    const SpiMode mode,
+    const SpiBitOrder order )
+:
+    _bus{ bus }
+{
+    if ( !bus ) {
+        return;
+    }
+
+    _bus.encode( clockHz, mode, order, _config );
+
+    _chipSelectPin = &chipSelect;
+    _chipSelectPin->setAsOutput();
+
+    // make sure it's not selected
+    _chipSelectPin->switchOn();
+}
+
+
+// dtor
+SpiDevice::~SpiDevice()
+{
+    if ( *this ) {
+        // return the CS line to floating
+        _chipSelectPin->reset();
+        _chipSelectPin = nullptr;
+    }
+}
+
+
+/// @brief Determines if the SpiDevice initialized correctly
+/// @returns `true` if the SpiDevice initialized correctly, `false` otherwise.
+SpiDevice::operator bool() const
+{
+    return _chipSelectPin;
+}
+
+
+/// @brief Returns the bus that the device is attached to
+/// @returns The device's SpiBus.
+SpiBus& SpiDevice::getBus() const
+{
+    return _bus;
+}
+
+
+/// @brief Queues a transfer for this device
+/// @param xfer The transfer to run. Its chip select and bus settings are filled in
+/// from the device.
+/// @see SpiBus::submit()
+void SpiDevice::submit( SpiTransfer& xfer )
+{
+    xfer.chipSelect = _chipSelectPin;
+    xfer.config = &_config;
+
+    _bus.submit( xfer );
+}
+
+
+/// @brief Creates a new HardwareSpi object
+/// @param clockHz The SPI clock for transfers that aren't made through an SpiDevice.
+/// @param mode The SPI mode for transfers that aren't made through an SpiDevice.
+/// @param order The bit order for transfers that aren't made through an SpiDevice.
+/// @note Only one HardwareSpi can exist at a time, as it obtains exclusive access to the
+/// SPI peripheral. Share it between all the devices on the bus.
+HardwareSpi::HardwareSpi(
+    const uint32_t clockHz,
+    const SpiMode mode,
+    const SpiBitOrder order )
+{
+    if ( !resource::obtain( resource::ResourceId::Spi ) ) {
+        return;
+    }
+
+    _hardwareSpi = this;
+
+    // setup the SPI GPIO
+    SPI_DDR |= ( SCLK | MOSI );
+    SPI_DDR &= ~MISO;
+
+    // MASTER mode SPI, kkplzthx
+    SPCR = ( 1 << SPE ) | ( 1 << MSTR );
+
+    // each device brings its own speed, mode and bit order
+    SpiConfig defaultConfig;
+    encodeHardwareSpi( clockHz, mode, order, defaultConfig );
+
+    attachConfig(
+        &SPCR, ( 1 << CPOL ) | ( 1 << CPHA ) | ( 1 << DORD ) | ( 1 << SPR1 ) | ( 1 << SPR0 ),
+        &SPSR, ( 1 << SPI2X ),
+        nullptr, 0,
+        encodeHardwareSpi,
+        defaultConfig );
+
+    // the SPI peripheral is single-buffered, so only one byte in flight
+    attach( &SPDR, &SPCR, ( 1 << SPIE ), &SPSR, ( 1 << SPIF ), 1 );
+}
+
+
+// dtor
+HardwareSpi::~HardwareSpi()
+{
+    if ( _hardwareSpi == this ) {
+        // switch off the SPI hardware
+        SPCR = 0;
+        SPSR = 0;
+
+        _hardwareSpi = nullptr;
+        resource::release( resource::ResourceId::Spi );
+    }
+}
+
+
+// This ISR is run whenever the SPI hardware finishes exchanging a single byte
+ISR( SPI_STC_vect )
+{
+    if ( _hardwareSpi ) {
+        _hardwareSpi->onXferComplete();
+    }
+}
+
+
+#endif
@@ -0,0 +1,179 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_SPI
+
+
+#ifndef TCRI_ZERO_SPIBUS_H
+#define TCRI_ZERO_SPIBUS_H
+
+
+#include <stdint.h>
+
+#include "thread.h"
+#include "gpio.h"
+#include "list.h"
+
+
+namespace zero {
+
+    /// @brief The most command/address bytes an SpiTransfer can send ahead of its data
+    const uint8_t SPI_MAX_HEADER_BYTES{ 5 };
+
+
+    /// @brief SPI clock polarity and phase
+    enum class SpiMode {
+        /// Clock idles low, data sampled on the rising edge
+        Mode0 = 0,
+
+        /// Clock idles low, data sampled on the falling edge
+        Mode1,
+
+        /// Clock idles high, data sampled on the falling edge
+        Mode2,
+
+        /// Clock idles high, data sampled on the rising edge
+        Mode3,
+    };
+
+
+    /// @brief The order in which the bits of each byte are sent
+    enum class SpiBitOrder {
+        /// Most significant bit first
+        MsbFirst = 0,
+
+        /// Least significant bit first
+        LsbFirst,
+    };
+
+
+    /// @brief Bus settings for one device, ready to be loaded into the bus's registers
+    /// @details The values are specific to the kind of SpiBus that encoded them.
+    struct SpiConfig {
+        uint8_t values[ 3 ];
+    };
+
+
+    /// @brief Describes a single transfer on an SpiBus
+    /// @details Devices fill one of these in and hand it to SpiBus::submit(). The bus
+    /// selects the device, sends the header bytes, then exchanges `numBytes` of data,
+    /// deselects the device and signals `doneSyn`. A transfer must not be touched
+    /// again until `pending` goes back to `false`. If `onDone` is set, it's called from
+    /// the bus's ISR when the transfer finishes. It may rewrite the transfer and return
+    /// `true` to have it queued again, in which case `doneSyn` isn't signalled yet.
+    /// A `circular` transfer keeps the device selected and refills `dest` as a ring
+    /// of `numBytes` (an even number), signalling `doneSyn` and bumping `halvesDone`
+    /// each time half of it fills. It runs until `stopCircular` is set, holding the bus
+    /// the whole time.
+    struct SpiTransfer {
+        Gpio* chipSelect{ nullptr };                    // the device's CS line
+        const SpiConfig* config{ nullptr };             // the device's bus settings, or the bus's own
+        const Synapse* doneSyn{ nullptr };              // signalled when the transfer completes
+        uint8_t header[ SPI_MAX_HEADER_BYTES ];         // command/address bytes to send first
+        uint8_t headerBytes{ 0 };                       // number of bytes in header
+        const void* src{ nullptr };                     // data to send, or nullptr to send zeroes
+        void* dest{ nullptr };                          // where to put received data, or nullptr
+        uint32_t numBytes{ 0UL };                       // number of data bytes to exchange
+        bool repeatSrc{ false };                        // send the byte at src over and over
+        bool ( *onDone )( SpiTransfer& xfer ){ nullptr };    // ISR callback, `true` to go again
+        void* context{ nullptr };                       // for onDone's use
+        bool circular{ false };                         // refill dest as a ring until stopped
+        volatile bool stopCircular{ false };            // ask a circular transfer to wind down
+        volatile uint8_t halvesDone{ 0 };               // halves of the ring filled so far
+        volatile bool pending{ false };                 // queued or underway
+
+        /// @privatesection
+        SpiTransfer* _prev;
+        SpiTransfer* _next;
+    };
+
+
+    /// @brief An interrupt-driven SPI bus, shared by one or more SPI devices
+    /// @details SpiBus is the transfer engine common to all SPI masters. Create one
+    /// of HardwareSpi or UsartSpi, and hand it to the devices that live on that bus.
+    /// Each bus runs its transfers independently, so devices on different buses
+    /// can transfer in parallel. Transfers submitted while the bus is busy are queued,
+    /// and the bus's ISR runs them back-to-back.
+    class SpiBus {
+    public:
+        explicit operator bool() const;                 // Determines if the SpiBus initialized correctly
+        bool isBusy() const;                            // Determines if a transfer is underway
+
+        void submit( SpiTransfer& xfer );               // Queues a transfer on the bus
+
+        #include "spibus_private.h"
+    };
+
+
+    /// @brief A device on an SpiBus, with its own clock speed, mode and bit order
+    /// @details Transfers submitted through an SpiDevice carry the device's settings,
+    /// and the bus reprograms itself whenever it switches between devices whose
+    /// settings differ, so slow or mode 3 peripherals can share a bus with fast ones.
+    /// @par Example
+    /// @code
+    /// int spiDeviceDemo()
+    /// {
+    ///     Synapse memReadySyn;
+    ///     Gpio memCs{ ZERO_PINB2 };
+    ///     Gpio adcCs{ ZERO_PINB1 };
+    ///     HardwareSpi spi;
+    ///     SpiDevice memDevice{ spi, memCs };
+    ///     SpiDevice adcDevice{ spi, adcCs, 1000000UL, SpiMode::Mode3 };
+    ///     SpiMemory mem{ 128 * 1024UL, memDevice, memReadySyn };
+    ///
+    ///     // ...
+    /// }
+    /// @endcode
+    class SpiDevice {
+    public:
+        SpiDevice(
+            SpiBus& bus,                                // the bus the device is attached to
+            Gpio& chipSelect,                           // Gpio object for the CS line
+            const uint32_t clockHz = F_CPU / 2,         // fastest clock the device can take
+            const SpiMode mode = SpiMode::Mode0,        // clock polarity and phase
+            const SpiBitOrder order = SpiBitOrder::MsbFirst );
+
+        void submit( SpiTransfer& xfer );               // Queues a transfer for this device
+        SpiBus& getBus() const;                         // The bus the device is attached to
+
+        explicit operator bool() const;
+
+        #include "spidevice_private.h"
+    };
+
+
+    /// @brief Provides an SpiBus using the MCU's hardware SPI peripheral
+    /// @par Example
+    /// @code
+    /// int spiBusDemo()
+    /// {
+    ///     Synapse memReadySyn;
+    ///     Gpio memCs{ ZERO_PINB2 };
+    ///     HardwareSpi spi;
+    ///     SpiMemory mem{ 128 * 1024UL, memCs, memReadySyn, spi };
+    ///
+    ///     // ...
+    /// }
+    /// @endcode
+    class HardwareSpi : public SpiBus {
+    public:
+        HardwareSpi(
+            const uint32_t clockHz = F_CPU / 2,         // settings for transfers without an SpiDevice
+            const SpiMode mode = SpiMode::Mode0,
+            const SpiBitOrder order = SpiBitOrder::MsbFirst );
+
+        #include "hardwarespi_private.h"
+    };
+
+}    // namespace zero
+
+
+#endif
+
+
+#endif
@@ -0,0 +1,91 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~SpiBus();
+
+    void onXferComplete();
+
+    void encode(
+        const uint32_t clockHz,
+        const SpiMode mode,
+        const SpiBitOrder order,
+        SpiConfig& config ) const;
+
+protected:
+    SpiBus() = default;
+
+    void attach(
+        volatile uint8_t* const dataReg,                // register that sends/receives a byte
+        volatile uint8_t* const ctrlReg,                // register holding the ISR enable bit
+        const uint8_t isrMask,                          // the ISR enable bit(s) in ctrlReg
+        volatile uint8_t* const statusReg,              // register holding the status flags
+        const uint8_t txReadyMask,                      // the transmitter can take another byte
+        const uint8_t depth );                          // bytes that may be in flight at once
+
+    // the function that turns device settings into register values for this bus
+    typedef void ( *SpiEncoder )(
+        const uint32_t clockHz,
+        const SpiMode mode,
+        const SpiBitOrder order,
+        SpiConfig& config );
+
+    void attachConfig(
+        volatile uint8_t* const reg0,                   // registers holding the bus settings,
+        const uint8_t mask0,                            // and the bits of each that the
+        volatile uint8_t* const reg1,                   // settings own (nullptr if unused)
+        const uint8_t mask1,
+        volatile uint8_t* const reg2,
+        const uint8_t mask2,
+        const SpiEncoder encoder,                       // bus-specific encoder
+        const SpiConfig& defaultConfig );               // settings for transfers without a device
+
+private:
+    SpiBus( const SpiBus& b ) = delete;
+    void operator=( const SpiBus& b ) = delete;
+
+    void setIsrEnable( const bool en );
+    void startNext();
+    void sendNext();
+    void onRingByte();
+    void applyConfig( const SpiConfig& config );
+    void finish();
+
+    // hardware
+    volatile uint8_t* _dataReg{ nullptr };
+    volatile uint8_t* _ctrlReg{ nullptr };
+    volatile uint8_t* _statusReg{ nullptr };
+    uint8_t _isrMask{ 0 };
+    uint8_t _txReadyMask{ 0 };
+    uint8_t _depth{ 1 };
+
+    // device settings
+    volatile uint8_t* _cfgRegs[ 3 ]{ nullptr, nullptr, nullptr };
+    uint8_t _cfgMasks[ 3 ]{ 0, 0, 0 };
+    SpiEncoder _encoder{ nullptr };
+    SpiConfig _defaultConfig{ { 0, 0, 0 } };
+    SpiConfig _activeConfig{ { 0, 0, 0 } };
+
+    // the transfer at the head is underway
+    List<SpiTransfer> _queue;
+
+    // current transfer
+    const uint8_t* _hdrCursor{ nullptr };
+    uint8_t _hdrBytes{ 0 };
+    uint8_t _rxSkip{ 0 };
+    const uint8_t* _txCursor{ nullptr };
+    uint8_t* _rxCursor{ nullptr };
+    bool _txRepeat{ false };
+
+    // circular transfer
+    uint8_t* _ringStart{ nullptr };
+    uint8_t* _ringHalf{ nullptr };
+    uint8_t* _ringEnd{ nullptr };
+    uint32_t _txBytes{ 0UL };
+    uint32_t _rxBytes{ 0UL };
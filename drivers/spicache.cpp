@@ -0,0 +1,255 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_SPIMEM
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include "memory.h"
+#include "spicache.h"
+#include "util.h"
+
+
+using namespace zero;
+
+
+/// @brief Creates a new SpiMemoryCache
+/// @param mem The SpiMemory to sit in front of.
+/// @param numLines The number of cache lines to keep.
+/// @param lineBytes The size of each cache line, in bytes. This must be a power of two.
+/// @note The SpiMemoryCache has to be used by the same Thread that owns the SpiMemory's
+/// ready Synapse, and while it's in use the SpiMemory shouldn't be accessed directly.
+SpiMemoryCache::SpiMemoryCache(
+    SpiMemory& mem,
+    const uint8_t numLines,
+    const uint16_t lineBytes )
+:
+    _mem{ mem }
+{
+    if ( !mem ) return;
+    if ( !numLines ) return;
+    if ( !lineBytes or ( lineBytes & ( lineBytes - 1 ) ) ) return;
+
+    // worked out in 32 bits, as big lines can overflow a 16-bit int
+    const uint32_t numBytes{ numLines * ( (uint32_t) sizeof( LineInfo ) + lineBytes ) };
+
+    if ( numBytes > 0xFFFF ) return;
+
+    _lines = (LineInfo*) memory::allocate( numBytes, &_allocatedBytes );
+
+    if ( _lines ) {
+        _numLines = numLines;
+        _lineBytes = lineBytes;
+
+        invalidate();
+    }
+}
+
+
+// dtor
+SpiMemoryCache::~SpiMemoryCache()
+{
+    if ( *this ) {
+        flush();
+        _mem.waitUntilIdle();
+
+        memory::free( _lines, _allocatedBytes );
+        _lines = nullptr;
+    }
+}
+
+
+/// @brief Determines if the SpiMemoryCache initialized correctly
+/// @returns `true` if the SpiMemoryCache initialized correctly, `false` otherwise.
+SpiMemoryCache::operator bool() const
+{
+    return _lines;
+}
+
+
+/// @brief Reads data through the cache into local SRAM
+/// @param dest A pointer to local SRAM where the data should be placed.
+/// @param srcAddr The address in external memory for the source of the copy.
+/// @param numBytes The total number of bytes to copy.
+void SpiMemoryCache::read(
+    void* dest,
+    const uint32_t srcAddr,
+    const uint32_t numBytes )
+{
+    if ( !*this ) return;
+
+    uint8_t* out{ (uint8_t*) dest };
+    uint32_t addr{ srcAddr };
+    uint32_t remaining{ numBytes };
+
+    while ( remaining ) {
+        const uint16_t offset{ (uint16_t) ( addr & ( _lineBytes - 1 ) ) };
+        const uint16_t chunk{ (uint16_t) ( MIN( remaining, (uint32_t) ( _lineBytes - offset ) ) ) };
+        const uint8_t line{ getLine( addr - offset, true ) };
+
+        memcpy( out, getData( line ) + offset, chunk );
+
+        out += chunk;
+        addr += chunk;
+        remaining -= chunk;
+    }
+}
+
+
+/// @brief Writes data from local SRAM into the cache
+/// @param src A pointer to local SRAM for the source of the copy.
+/// @param destAddr The address in external memory to which the data should be copied.
+/// @param numBytes The total number of bytes to copy.
+/// @note The data only reaches the chip when its line is evicted, or on flush().
+void SpiMemoryCache::write(
+    const void* src,
+    const uint32_t destAddr,
+    const uint32_t numBytes )
+{
+    if ( !*this ) return;
+
+    const uint8_t* in{ (const uint8_t*) src };
+    uint32_t addr{ destAddr };
+    uint32_t remaining{ numBytes };
+
+    while ( remaining ) {
+        const uint16_t offset{ (uint16_t) ( addr & ( _lineBytes - 1 ) ) };
+        const uint16_t chunk{ (uint16_t) ( MIN( remaining, (uint32_t) ( _lineBytes - offset ) ) ) };
+
+        // no need to fetch a line that's about to be completely overwritten
+        const uint8_t line{ getLine( addr - offset, chunk != _lineBytes ) };
+
+        memcpy( getData( line ) + offset, in, chunk );
+        _lines[ line ].dirty = true;
+
+        in += chunk;
+        addr += chunk;
+        remaining -= chunk;
+    }
+}
+
+
+/// @brief Writes all dirty lines back to the chip
+/// @note The lines stay in the cache, and are now clean.
+void SpiMemoryCache::flush()
+{
+    if ( !*this ) return;
+
+    for ( uint8_t i = 0; i < _numLines; i++ ) {
+        if ( _lines[ i ].valid and _lines[ i ].dirty ) {
+            writeBack( i );
+        }
+    }
+}
+
+
+/// @brief Forgets the contents of all lines, without writing anything back
+/// @note Use this if the memory has been changed behind the cache's back.
+void SpiMemoryCache::invalidate()
+{
+    for ( uint8_t i = 0; i < _numLines; i++ ) {
+        _lines[ i ].base = 0UL;
+        _lines[ i ].rank = i;
+        _lines[ i ].valid = false;
+        _lines[ i ].dirty = false;
+    }
+}
+
+
+/// @brief Returns the cache's hit and miss counters
+/// @returns A snapshot of the counters.
+SpiMemoryCacheStats SpiMemoryCache::getStats() const
+{
+    return _stats;
+}
+
+
+/// @brief Resets the cache's hit and miss counters
+void SpiMemoryCache::clearStats()
+{
+    _stats = { 0UL, 0UL, 0UL };
+}
+
+
+// returns a pointer to the data for a given line
+uint8_t* SpiMemoryCache::getData( const uint8_t line ) const
+{
+    return ( (uint8_t*) &_lines[ _numLines ] ) + ( line * _lineBytes );
+}
+
+
+// makes a line the most recently used
+void SpiMemoryCache::touch( const uint8_t line )
+{
+    const uint8_t oldRank{ _lines[ line ].rank };
+
+    for ( uint8_t i = 0; i < _numLines; i++ ) {
+        if ( _lines[ i ].rank < oldRank ) {
+            _lines[ i ].rank++;
+        }
+    }
+
+    _lines[ line ].rank = 0;
+}
+
+
+// sends a line's data to the chip, and waits for it to get there
+void SpiMemoryCache::writeBack( const uint8_t line )
+{
+    _mem.write( getData( line ), _lines[ line ].base, _lineBytes );
+    _mem.waitUntilIdle();
+
+    _lines[ line ].dirty = false;
+    _stats.writeBacks++;
+}
+
+
+// Finds the line caching a given address, loading it in over the
+// least-recently used line if it isn't there. Returns the line's number.
+uint8_t SpiMemoryCache::getLine( const uint32_t base, const bool fetch )
+{
+    uint8_t victim{ 0 };
+
+    for ( uint8_t i = 0; i < _numLines; i++ ) {
+        if ( _lines[ i ].valid and _lines[ i ].base == base ) {
+            _stats.hits++;
+            touch( i );
+
+            return i;
+        }
+
+        if ( _lines[ i ].rank == _numLines - 1 ) {
+            victim = i;
+        }
+    }
+
+    // miss, so make room
+    _stats.misses++;
+
+    if ( _lines[ victim ].valid and _lines[ victim ].dirty ) {
+        writeBack( victim );
+    }
+
+    _lines[ victim ].base = base;
+    _lines[ victim ].valid = true;
+    _lines[ victim ].dirty = false;
+
+    if ( fetch ) {
+        _mem.read( getData( victim ), base, _lineBytes );
+        _mem.waitUntilIdle();
+    }
+
+    touch( victim );
+
+    return victim;
+}
+
+
+#endif
@@ -0,0 +1,94 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_SPIMEM
+
+
+#ifndef TCRI_ZERO_SPICACHE_H
+#define TCRI_ZERO_SPICACHE_H
+
+
+#include <stdint.h>
+
+#include "sram.h"
+
+
+namespace zero {
+
+    /// @brief Hit and miss counters for an SpiMemoryCache
+    struct SpiMemoryCacheStats {
+        uint32_t hits;                                  // line accesses satisfied from the cache
+        uint32_t misses;                                // line accesses that went to the chip
+        uint32_t writeBacks;                            // dirty lines written back to the chip
+    };
+
+
+    /// @brief A write-back cache in local SRAM, in front of an SpiMemory
+    /// @details Reads and writes are served from a handful of cache lines, allocated
+    /// with the memory manager. Lines are replaced least-recently-used first, and
+    /// written lines are only sent to the chip when they're evicted, or on flush().
+    /// Unlike SpiMemory, the calls are synchronous - the calling Thread blocks while
+    /// any lines are fetched or written back.
+    /// @note The cache only pays off when accesses stay within a few lines at a time, as
+    /// with a log written sequentially, or a working buffer. Every miss moves a whole
+    /// line, and a dirty victim moves another, so small accesses spread across the chip
+    /// come out several times slower than calling SpiMemory directly. `make cachebench`
+    /// in `tools/hosttest` compares the two for different access patterns.
+    /// @par Example
+    /// @code
+    /// int cacheDemo()
+    /// {
+    ///     Synapse memReadySyn;
+    ///     Gpio memCs{ ZERO_PINB2 };
+    ///     SpiMemory mem{ 128 * 1024UL, memCs, memReadySyn };
+    ///     SpiMemoryCache cache{ mem, 4, 32 };
+    ///     uint16_t sample;
+    ///
+    ///     for ( uint32_t addr = 0; addr < 1024; addr += 2 ) {
+    ///         sample = readSensor();
+    ///         cache.write( &sample, addr, 2 );
+    ///     }
+    ///
+    ///     cache.flush();
+    /// }
+    /// @endcode
+    class SpiMemoryCache {
+    public:
+        SpiMemoryCache(
+            SpiMemory& mem,                             // the memory to cache
+            const uint8_t numLines = 4,                 // how many lines to keep
+            const uint16_t lineBytes = 32 );            // bytes per line (a power of two)
+
+        void read(
+            void* dest,                                 // destination address, in local SRAM
+            const uint32_t srcAddr,                     // source address for the data, in external SPI memory
+            const uint32_t numBytes );                  // number of bytes to read
+
+        void write(
+            const void* src,                            // source data address, in local SRAM
+            const uint32_t destAddr,                    // destination address, in external SPI memory
+            const uint32_t numBytes );                  // number of bytes to write
+
+        void flush();                                   // Writes back all dirty lines
+        void invalidate();                              // Forgets all lines, without writing back
+
+        SpiMemoryCacheStats getStats() const;
+        void clearStats();
+
+        explicit operator bool() const;
+
+        #include "spicache_private.h"
+    };
+
+}    // namespace zero
+
+
+#endif
+
+
+#endif
@@ -0,0 +1,35 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~SpiMemoryCache();
+
+private:
+    SpiMemoryCache( const SpiMemoryCache& c ) = delete;
+    void operator=( const SpiMemoryCache& c ) = delete;
+
+    // bookkeeping for one cache line
+    struct LineInfo {
+        uint32_t base;                                  // address in the chip of the line's first byte
+        uint8_t rank;                                   // 0 = most recently used
+        bool valid;
+        bool dirty;
+    };
+
+    uint8_t getLine( const uint32_t base, const bool fetch );
+    uint8_t* getData( const uint8_t line ) const;
+    void touch( const uint8_t line );
+    void writeBack( const uint8_t line );
+
+    SpiMemory& _mem;
+    LineInfo* _lines{ nullptr };                        // numLines LineInfos, then the line data
+    uint16_t _allocatedBytes{ 0 };
+    uint16_t _lineBytes{ 0 };
+    uint8_t _numLines{ 0 };
+    SpiMemoryCacheStats _stats{ 0UL, 0UL, 0UL };
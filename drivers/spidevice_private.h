@@ -0,0 +1,19 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~SpiDevice();
+
+private:
+    SpiDevice( const SpiDevice& d ) = delete;
+    void operator=( const SpiDevice& d ) = delete;
+
+    SpiBus& _bus;
+    Gpio* _chipSelectPin{ nullptr };
+    SpiConfig _config{ { 0, 0, 0 } };
@@ -0,0 +1,300 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_SPIFLASH
+
+
+#include <stdint.h>
+
+#include "spiflash.h"
+#include "thread.h"
+
+
+using namespace zero;
+
+
+namespace {
+
+    const uint8_t CMD_READ{ 0x03 };
+    const uint8_t CMD_PAGE_PROGRAM{ 0x02 };
+    const uint8_t CMD_SECTOR_ERASE{ 0x20 };
+    const uint8_t CMD_WRITE_ENABLE{ 0x06 };
+    const uint8_t CMD_READ_STATUS{ 0x05 };
+    const uint8_t CMD_READ_JEDEC_ID{ 0x9F };
+
+    const uint8_t STATUS_WIP{ 1 << 0 };                 // write/erase in progress
+
+    // 3-byte addressing tops out at 16MB
+    const uint8_t MIN_CAPACITY_BITS{ 16 };
+    const uint8_t MAX_CAPACITY_BITS{ 24 };
+
+}    // namespace
+
+
+/// @brief Creates a new SpiFlash object
+/// @param chipSelect A Gpio object representing the chip select line of the flash chip.
+/// @param readySyn The Synapse to signal when a transfer is complete.
+/// @param bus The SpiBus (HardwareSpi or UsartSpi) that the flash chip is attached to.
+/// @note The chip's JEDEC ID is read here, and the SpiFlash only initializes if the
+/// ID looks like a 25-series part of up to 16MB.
+SpiFlash::SpiFlash(
+    Gpio& chipSelect,
+    const Synapse& readySyn,
+    SpiBus& bus )
+{
+    if ( !bus ) {
+        return;
+    }
+
+    _bus = &bus;
+
+    _chipSelectPin = &chipSelect;
+    _chipSelectPin->setAsOutput();
+
+    // make sure it's not selected
+    _chipSelectPin->switchOn();
+
+    _readySyn = &readySyn;
+
+    // the transfer descriptors we hand to the bus
+    _xfer.chipSelect = _chipSelectPin;
+    _xfer.doneSyn = _readySyn;
+
+    _wrenXfer.chipSelect = _chipSelectPin;
+    _wrenXfer.header[ 0 ] = CMD_WRITE_ENABLE;
+    _wrenXfer.headerBytes = 1;
+
+    // who are you?
+    uint8_t id[ 3 ];
+
+    _xfer.header[ 0 ] = CMD_READ_JEDEC_ID;
+    _xfer.headerBytes = 1;
+    _xfer.src = nullptr;
+    _xfer.dest = id;
+    _xfer.numBytes = sizeof( id );
+
+    _bus->submit( _xfer );
+    waitForTransfer();
+
+    _jedecId = ( (uint32_t) id[ 0 ] << 16 ) | ( (uint16_t) id[ 1 ] << 8 ) | id[ 2 ];
+
+    // no chip there, or not one we understand
+    if ( id[ 0 ] == 0x00 or id[ 0 ] == 0xFF ) return;
+    if ( id[ 2 ] < MIN_CAPACITY_BITS or id[ 2 ] > MAX_CAPACITY_BITS ) return;
+
+    _capacityBytes = 1UL << id[ 2 ];
+
+    // signal the Synapse that we're ready to go
+    _readySyn->signal();
+}
+
+
+// dtor
+SpiFlash::~SpiFlash()
+{
+    if ( _chipSelectPin ) {
+        // let the bus finish with us
+        waitForTransfer();
+
+        // return the CS line to floating
+        _chipSelectPin->reset();
+
+        // clear signals and forget
+        _readySyn->clearSignals();
+        _readySyn = nullptr;
+    }
+}
+
+
+/// @brief Determines if the SpiFlash initialized correctly
+/// @returns `true` if a supported flash chip was found, `false` otherwise.
+SpiFlash::operator bool() const
+{
+    return _capacityBytes;
+}
+
+
+/// @brief Returns the JEDEC ID read from the chip
+/// @returns The manufacturer ID in bits 16-23, the memory type in bits 8-15 and the
+/// capacity code in bits 0-7.
+uint32_t SpiFlash::getJedecId() const
+{
+    return _jedecId;
+}
+
+
+/// @brief Returns the size of the chip
+/// @returns The capacity of the chip, in bytes.
+uint32_t SpiFlash::getCapacity() const
+{
+    return _capacityBytes;
+}
+
+
+/// @brief Reads data from flash into local SRAM
+/// @param dest A pointer to local SRAM where the incoming data should be placed.
+/// @param srcAddr The address in flash for the source of the copy.
+/// @param numBytes The total number of bytes to transfer.
+/// @note This returns once the transfer has started. The ready Synapse is signalled
+/// when it's done. If the chip is busy programming or erasing, the calling Thread
+/// blocks until it's finished.
+void SpiFlash::read(
+    void* dest,
+    const uint32_t srcAddr,
+    const uint32_t numBytes )
+{
+    if ( !*this ) return;
+
+    waitUntilIdle();
+
+    setHeader( CMD_READ, srcAddr );
+    _xfer.src = nullptr;
+    _xfer.dest = dest;
+    _xfer.numBytes = numBytes;
+
+    _bus->submit( _xfer );
+}
+
+
+/// @brief Programs data from local SRAM into flash
+/// @param src A pointer to local SRAM for the source of the copy.
+/// @param destAddr The address in flash to which the data should be copied.
+/// @param numBytes The total number of bytes to program.
+/// @returns `true` if the data was programmed, `false` otherwise.
+/// @note Programming can only clear bits, so the destination must have been erased
+/// first. The data is split at page boundaries, and the calling Thread blocks until
+/// it has all been programmed.
+bool SpiFlash::program(
+    const void* src,
+    const uint32_t destAddr,
+    const uint32_t numBytes )
+{
+    if ( !*this ) return false;
+    if ( !src ) return false;
+    if ( destAddr >= _capacityBytes or numBytes > _capacityBytes - destAddr ) return false;
+
+    const uint8_t* cursor{ (const uint8_t*) src };
+    uint32_t addr{ destAddr };
+    uint32_t remaining{ numBytes };
+
+    while ( remaining ) {
+        // a page program wraps around within the page, so stop at the end of it
+        const uint16_t pageLeft{ (uint16_t) ( SPI_FLASH_PAGE_BYTES - ( addr & ( SPI_FLASH_PAGE_BYTES - 1 ) ) ) };
+        const uint16_t chunk{ remaining < pageLeft ? (uint16_t) remaining : pageLeft };
+
+        waitUntilIdle();
+
+        setHeader( CMD_PAGE_PROGRAM, addr );
+        _xfer.src = cursor;
+        _xfer.dest = nullptr;
+        _xfer.numBytes = chunk;
+
+        submitWithWriteEnable();
+
+        cursor += chunk;
+        addr += chunk;
+        remaining -= chunk;
+    }
+
+    waitUntilIdle();
+
+    return true;
+}
+
+
+/// @brief Erases a sector of flash, setting all of its bytes to 0xFF
+/// @param addr Any address in the sector to be erased.
+/// @returns `true` if the sector was erased, `false` otherwise.
+/// @note Erasing a sector can take hundreds of milliseconds, during which the calling
+/// Thread sleeps.
+bool SpiFlash::eraseSector( const uint32_t addr )
+{
+    if ( !*this ) return false;
+    if ( addr >= _capacityBytes ) return false;
+
+    waitUntilIdle();
+
+    setHeader( CMD_SECTOR_ERASE, addr & ~( (uint32_t) SPI_FLASH_SECTOR_BYTES - 1 ) );
+    _xfer.src = nullptr;
+    _xfer.dest = nullptr;
+    _xfer.numBytes = 0;
+
+    submitWithWriteEnable();
+    _erasing = true;
+    waitUntilIdle();
+
+    return true;
+}
+
+
+/// @brief Blocks the calling Thread until the chip is ready for another operation
+/// @details This waits for any transfer on the bus to finish, and then polls the
+/// chip's status register until it's no longer programming or erasing. Page programs
+/// are polled back to back, as each poll is a bus transfer the Thread sleeps through.
+/// Erases sleep for a millisecond between polls as well.
+void SpiFlash::waitUntilIdle()
+{
+    if ( !*this ) return;
+
+    while ( readStatus() & STATUS_WIP ) {
+        if ( _erasing ) {
+            me.delay( 1_ms );
+        }
+    }
+
+    _erasing = false;
+}
+
+
+// blocks the caller until our last transfer is out of the bus's queue
+void SpiFlash::waitForTransfer() const
+{
+    while ( _xfer.pending ) {
+        _readySyn->wait();
+    }
+}
+
+
+// reads the chip's status register
+uint8_t SpiFlash::readStatus()
+{
+    waitForTransfer();
+
+    _xfer.header[ 0 ] = CMD_READ_STATUS;
+    _xfer.headerBytes = 1;
+    _xfer.src = nullptr;
+    _xfer.dest = &_status;
+    _xfer.numBytes = 1;
+
+    _bus->submit( _xfer );
+    waitForTransfer();
+
+    return _status;
+}
+
+
+// fills in the command and 3-byte address that precede the data
+void SpiFlash::setHeader( const uint8_t cmd, const uint32_t addr )
+{
+    _xfer.header[ 0 ] = cmd;
+    _xfer.header[ 1 ] = addr >> 16;
+    _xfer.header[ 2 ] = addr >> 8;
+    _xfer.header[ 3 ] = addr >> 0;
+    _xfer.headerBytes = 4;
+}
+
+
+// queues a write-enable, immediately followed by our transfer
+void SpiFlash::submitWithWriteEnable()
+{
+    _bus->submit( _wrenXfer );
+    _bus->submit( _xfer );
+}
+
+
+#endif
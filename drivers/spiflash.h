@@ -0,0 +1,94 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_SPIFLASH
+
+
+#ifndef TCRI_ZERO_SPIFLASH_H
+#define TCRI_ZERO_SPIFLASH_H
+
+
+#ifndef ZERO_DRIVERS_SPI
+    #error "ZERO_DRIVERS_SPIFLASH requires ZERO_DRIVERS_SPI"
+#endif
+
+
+#include <stdint.h>
+
+#include "thread.h"
+#include "gpio.h"
+#include "spibus.h"
+
+
+namespace zero {
+
+    /// @brief Bytes in an SPI flash program page
+    const uint16_t SPI_FLASH_PAGE_BYTES{ 256 };
+
+    /// @brief Bytes in an SPI flash erase sector
+    const uint16_t SPI_FLASH_SECTOR_BYTES{ 4096 };
+
+
+    /// @brief Provides access to 25-series SPI NOR flash chips
+    /// @details The chip is identified by its JEDEC ID when the SpiFlash is created.
+    /// All transfers, including the status polls while the chip is busy programming or
+    /// erasing, go through the SpiBus's interrupt-driven queue, so the calling Thread
+    /// sleeps on its ready Synapse rather than spinning. A page program finishes in
+    /// under a millisecond, so it's polled back to back. An erase takes far longer, so
+    /// the Thread also sleeps for a millisecond between polls.
+    /// @par Example
+    /// @code
+    /// int flashDemo()
+    /// {
+    ///     Synapse flashReadySyn;
+    ///     Gpio flashCs{ ZERO_PINB1 };
+    ///     HardwareSpi spi;
+    ///     SpiFlash flash{ flashCs, flashReadySyn, spi };
+    ///
+    ///     if ( flash ) {
+    ///         flash.eraseSector( 0 );
+    ///         flash.program( "Hello", 0, 5 );
+    ///     }
+    /// }
+    /// @endcode
+    class SpiFlash {
+    public:
+        SpiFlash(
+            Gpio& chipSelect,                           // Gpio object for the CS line
+            const Synapse& readySyn,                    // Synapse to fire when a transfer completes
+            SpiBus& bus );                              // the SPI bus the chip is attached to
+
+        void read(
+            void* dest,                                 // destination address, in local SRAM
+            const uint32_t srcAddr,                     // source address for the data, in flash
+            const uint32_t numBytes );                  // number of bytes to read
+
+        bool program(
+            const void* src,                            // source data address, in local SRAM
+            const uint32_t destAddr,                    // destination address, in flash
+            const uint32_t numBytes );                  // number of bytes to program
+
+        bool eraseSector( const uint32_t addr );        // Erases the sector holding addr
+
+        void waitUntilIdle();                           // Blocks until the chip is ready for more
+
+        uint32_t getJedecId() const;                    // Manufacturer, type and capacity bytes
+        uint32_t getCapacity() const;                   // Size of the chip, in bytes
+
+        explicit operator bool() const;
+
+        #include "spiflash_private.h"
+    };
+
+}    // namespace zero
+
+
+#endif
+
+
+#endif
@@ -0,0 +1,30 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~SpiFlash();
+
+private:
+    SpiFlash( const SpiFlash& f ) = delete;
+    void operator=( const SpiFlash& f ) = delete;
+
+    void waitForTransfer() const;
+    void setHeader( const uint8_t cmd, const uint32_t addr );
+    void submitWithWriteEnable();
+    uint8_t readStatus();
+
+    Gpio* _chipSelectPin{ nullptr };
+    const Synapse* _readySyn{ nullptr };
+    SpiBus* _bus{ nullptr };
+    uint32_t _jedecId{ 0UL };
+    uint32_t _capacityBytes{ 0UL };
+    uint8_t _status{ 0 };
+    bool _erasing{ false };                             // busy for long enough to sleep between polls
+    SpiTransfer _xfer;
+    SpiTransfer _wrenXfer;
@@ -14,10 +14,10 @@
 
 #include <util/atomic.h>
 
-#include "spi.h"
+#include "memory.h"
+#include "spibus.h"
 #include "sram.h"
 #include "thread.h"
-#include "resource.h"
 
 
 using namespace zero;
@@ -25,55 +25,22 @@ using namespace zero;
 
 namespace {
 
-    enum class SpiXferMode {
-        Tx,
-        Rx,
-    };
-
-
     const uint8_t CMD_READ{ 3 };
     const uint8_t CMD_WRITE{ 2 };
 
-    auto _spiXferMode{ SpiXferMode::Tx };
-    volatile uint8_t* _txCursor{ nullptr };
-    volatile uint8_t* _rxCursor{ nullptr };
-    volatile uint32_t _xferBytes{ 0UL };
-
-    const Synapse* _spiReadySyn{ nullptr };
-    SpiMemory* _curController{ nullptr };
-
-
-    // switches the SPI transfer-complete ISR on and off
-    void setSpiIsrEnable( const bool en )
-    {
-        if ( en ) {
-            SPCR |= ( 1 << SPIE );
-        }
-        else {
-            SPCR &= ~( 1 << SPIE );
-        }
-    }
-
-
-    // busy-poll exchanges one byte over SPI
-    uint8_t spiXfer( const uint8_t c )
-    {
-        SPDR = c;
-
-        while ( !( SPSR & ( 1 << SPIF ) ) ) {
-            // empty
-        }
-
-        return SPDR;
-    }
+    // SRAM borrowed for the duration of a copy()
+    const uint16_t COPY_BOUNCE_BYTES{ 32 };
 
 }    // namespace
 
 
-/// @brief Creates a new SpiMemory object
+/// @brief Creates a new SpiMemory object on the hardware SPI bus
 /// @param capacityBytes The total size of the external memory chip, in bytes.
 /// @param chipSelect A Gpio object representing the chip select line of the memory chip.
 /// @param readySyn The Synapse to signal when a memory transfer is complete.
+/// @note This takes exclusive ownership of the hardware SPI. To put more than one
+/// device on the bus, create a HardwareSpi yourself and use one of the constructors
+/// that takes an SpiBus or an SpiDevice.
 SpiMemory::SpiMemory(
     const uint32_t capacityBytes,                       // how many bytes does the chip hold?
     Gpio& chipSelect,                                   // Gpio object for the CS line
@@ -81,30 +48,62 @@ SpiMemory::SpiMemory(
 :
     _capacityBytes{ capacityBytes }
 {
-    if ( !resource::obtain( resource::ResourceId::Spi ) ) {
-        return;
+    if ( ( _ownedBus = new HardwareSpi ) ) {
+        attach( new SpiDevice{ *_ownedBus, chipSelect }, true, readySyn );
     }
+}
 
-    _chipSelectPin = &chipSelect;
-    _chipSelectPin->setAsOutput();
 
-    // setup the SPI GPIO
-    SPI_DDR |= ( SCLK | MOSI );
-    SPI_DDR &= ~MISO;
+/// @brief Creates a new SpiMemory object on a given SPI bus
+/// @param capacityBytes The total size of the external memory chip, in bytes.
+/// @param chipSelect A Gpio object representing the chip select line of the memory chip.
+/// @param readySyn The Synapse to signal when a memory transfer is complete.
+/// @param bus The SpiBus (HardwareSpi or UsartSpi) that the memory chip is attached to.
+/// @note The chip runs with the bus's own clock, mode and bit order.
+SpiMemory::SpiMemory(
+    const uint32_t capacityBytes,                       // how many bytes does the chip hold?
+    Gpio& chipSelect,                                   // Gpio object for the CS line
+    const Synapse& readySyn,                            // Synapse to fire when ready to transfer
+    SpiBus& bus )                                       // the SPI bus the chip is attached to
+:
+    _capacityBytes{ capacityBytes }
+{
+    attach( new SpiDevice{ bus, chipSelect }, true, readySyn );
+}
 
-    // make sure it's not selected
-    deselect();
 
-    // make sure ISRs for SPI are off
-    setSpiIsrEnable( false );
+/// @brief Creates a new SpiMemory object for a given SpiDevice
+/// @param capacityBytes The total size of the external memory chip, in bytes.
+/// @param device The SpiDevice for the memory chip, with its bus settings.
+/// @param readySyn The Synapse to signal when a memory transfer is complete.
+SpiMemory::SpiMemory(
+    const uint32_t capacityBytes,                       // how many bytes does the chip hold?
+    SpiDevice& device,                                  // the chip's CS line and bus settings
+    const Synapse& readySyn )                           // Synapse to fire when ready to transfer
+:
+    _capacityBytes{ capacityBytes }
+{
+    attach( &device, false, readySyn );
+}
+
+
+// gets the chip ready to go, if the device is
+void SpiMemory::attach( SpiDevice* const device, const bool ownsDevice, const Synapse& readySyn )
+{
+    _device = device;
+    _ownsDevice = ownsDevice;
 
-    // full-speed MASTER mode SPI, kkplzthx
-    SPCR = ( 1 << SPE ) | ( 1 << MSTR );
-    SPSR |= ( 1 << SPI2X );
+    if ( !_device or !*_device ) {
+        return;
+    }
+
+    // the transfer descriptor we hand to the device
+    _xfer.doneSyn = &readySyn;
+    _xfer.context = this;
 
     // signal the Synapse that we're ready to go
-    _spiReadySyn = &readySyn;
-    _spiReadySyn->signal();
+    _readySyn = &readySyn;
+    _readySyn->signal();
 }
 
 
@@ -112,28 +111,19 @@ SpiMemory::SpiMemory(
 SpiMemory::~SpiMemory()
 {
     if ( *this ) {
-        // stop interrupting me!
-        setSpiIsrEnable( false );
-
-        // switch off the SPI hardware
-        SPCR = 0;
-        SPSR = 0;
-
-        // return the CS line to floating
-        if ( _chipSelectPin ) {
-            _chipSelectPin->reset();
-        }
-
+        // let the bus finish with us
+        waitUntilIdle();
 
         // clear signals and forget
-        if ( _spiReadySyn ) {
-            _spiReadySyn->clearSignals();
-            _spiReadySyn = nullptr;
-        }
+        _readySyn->clearSignals();
+        _readySyn = nullptr;
+    }
 
-        // free the resource
-        resource::release( resource::ResourceId::Spi );
+    if ( _ownsDevice ) {
+        delete _device;
     }
+
+    delete _ownedBus;
 }
 
 
@@ -141,21 +131,7 @@ SpiMemory::~SpiMemory()
 /// @returns `true` if the SpiMemory correctly initialized, `false` otherwise.
 SpiMemory::operator bool() const
 {
-    return _chipSelectPin;
-}
-
-
-// select the chip, by pulling CS low
-void SpiMemory::select() const
-{
-    _chipSelectPin->switchOff();
-}
-
-
-// deselect the chip, by pulling CS high
-void SpiMemory::deselect() const
-{
-    _chipSelectPin->switchOn();
+    return _readySyn;
 }
 
 
@@ -163,164 +139,304 @@ void SpiMemory::deselect() const
 /// @param dest A pointer to local SRAM where the incoming should be placed.
 /// @param srcAddr The address in external memory for the source of the copy.
 /// @param numBytes The total number of bytes to transfer.
+/// @note If a previous transfer for this chip hasn't finished yet, the calling Thread
+/// will block until it has.
 void SpiMemory::read(
     void* dest,                                         // destination address, in local SRAM
     const uint32_t srcAddr,                             // source address for the data, in external SPI memory
     const uint32_t numBytes )                           // number of bytes to read
 {
-    // wait until there's no controller using the SPI
-    while ( _curController ) {
-        // empty
-    }
+    waitUntilIdle();
+
+    // tell it that we want to read data from srcAddress
+    setHeader( CMD_READ, srcAddr );
+    _xfer.src = nullptr;
+    _xfer.dest = dest;
+    _xfer.numBytes = numBytes;
+    _xfer.repeatSrc = false;
+    _xfer.circular = false;
+
+    // the rest is up to the bus
+    _device->submit( _xfer );
+}
 
-    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
-        // tell the ISR who we are
-        _curController = this;
 
-        // make sure no-one falls through while we're working
-        if ( _spiReadySyn ) {
-            _spiReadySyn->clearSignals();
-        }
+/// @brief Write data to external memory from local SRAM
+/// @param src A pointer to local SRAM for the source of the copy.
+/// @param destAddr The address in external memory to which the data should be copied.
+/// @param numBytes The total number of bytes to transfer.
+/// @note If a previous transfer for this chip hasn't finished yet, the calling Thread
+/// will block until it has.
+void SpiMemory::write(
+    const void* src,                                    // source data address, in local SRAM
+    const uint32_t destAddr,                            // destination address, in external SPI memory
+    const uint32_t numBytes )                           // number of the bytes to write
+{
+    waitUntilIdle();
+
+    // tell it that we want to write data to destAddress
+    setHeader( CMD_WRITE, destAddr );
+    _xfer.src = src;
+    _xfer.dest = nullptr;
+    _xfer.numBytes = numBytes;
+    _xfer.repeatSrc = false;
+    _xfer.circular = false;
+
+    // the rest is up to the bus
+    _device->submit( _xfer );
+}
 
-        // set up the housekeeping
-        _txCursor = nullptr;                            // we are reading data, so no TX buffer
-        _rxCursor = (uint8_t*) dest;
-        _xferBytes = numBytes;
-        _spiXferMode = SpiXferMode::Rx;
 
-        // tell the SPI chip that we want to talk to it
-        select();
+/// @brief Copies data from one place in external memory to another
+/// @param srcAddr The address in external memory for the source of the copy.
+/// @param destAddr The address in external memory to which the data should be copied.
+/// @param numBytes The total number of bytes to copy.
+/// @returns `true` if the copy was started, `false` if there wasn't enough SRAM for
+/// the bounce buffer.
+/// @note The data is moved through a small bounce buffer in local SRAM, one chunk at a
+/// time, entirely from the bus's ISR. The ready Synapse is signalled once, when the
+/// whole copy is done. Overlapping ranges are handled.
+bool SpiMemory::copy(
+    const uint32_t srcAddr,                             // source address, in external SPI memory
+    const uint32_t destAddr,                            // destination address, in external SPI memory
+    const uint32_t numBytes )                           // number of bytes to copy
+{
+    waitUntilIdle();
 
-        // tell it that we want to read data from srcAddress
-        sendReadCommand( srcAddr );
+    if ( !numBytes or srcAddr == destAddr ) {
+        _readySyn->signal();
+        return true;
+    }
 
-        // enable the ISR
-        setSpiIsrEnable( true );
+    _bounce = (uint8_t*) memory::allocate(
+        numBytes < COPY_BOUNCE_BYTES ? (uint16_t) numBytes : COPY_BOUNCE_BYTES,
+        &_bounceBytes );
 
-        // push the first one out to kickstart it
-        SPDR = 0;
+    if ( !_bounce ) {
+        return false;
     }
+
+    // copying up into an overlapping range has to start at the top
+    _copySrc = srcAddr;
+    _copyDest = destAddr;
+    _copyRemaining = numBytes;
+    _copyBackwards = ( destAddr > srcAddr ) and ( destAddr < srcAddr + numBytes );
+
+    // the first chunk's read, and the ISR takes it from there
+    _xfer.onDone = onCopyStep;
+    _xfer.repeatSrc = false;
+    _xfer.circular = false;
+    setCopyStep( false );
+
+    _device->submit( _xfer );
+
+    return true;
 }
 
 
-/// @brief Write data to external memory from local SRAM
-/// @param src A pointer to local SRAM for the source of the copy.
-/// @param destAddr The address in external memory to which the data should be copied.
-/// @param numBytes The total number of bytes to transfer.
-void SpiMemory::write(
-    const void* src,                                    // source data address, in local SRAM
+/// @brief Sets a range of external memory to a single value
+/// @param destAddr The address in external memory of the first byte to set.
+/// @param value The value to set the bytes to.
+/// @param numBytes The total number of bytes to set.
+/// @note This is a single transfer, with the one byte sent over and over, so it needs
+/// no buffer.
+void SpiMemory::fill(
     const uint32_t destAddr,                            // destination address, in external SPI memory
-    const uint32_t numBytes )                           // number of the bytes to write
+    const uint8_t value,                                // the value to write
+    const uint32_t numBytes )                           // number of bytes to set
 {
-    // wait until there's no controller using the SPI
-    while ( _curController ) {
-        // empty
+    waitUntilIdle();
+
+    _fillValue = value;
+
+    setHeader( CMD_WRITE, destAddr );
+    _xfer.src = &_fillValue;
+    _xfer.dest = nullptr;
+    _xfer.numBytes = numBytes;
+    _xfer.repeatSrc = true;
+    _xfer.circular = false;
+
+    // the rest is up to the bus
+    _device->submit( _xfer );
+}
+
+
+/// @brief Starts reading external memory continuously into a double buffer
+/// @param buffer A pointer to local SRAM for the two halves of the buffer.
+/// @param bufferBytes The size of the whole buffer. This must be even.
+/// @param srcAddr The address in external memory to start reading from.
+/// @returns `true` if the stream was started, `false` otherwise.
+/// @note The chip stays selected, in sequential mode, for the whole stream, so the
+/// command and address are only sent once. The ready Synapse is signalled each time a
+/// half of the buffer fills - pick it up with getStreamHalf() while the other half
+/// fills. The stream holds the bus until endStream() is called.
+bool SpiMemory::beginStream(
+    void* buffer,                                       // the double buffer, in local SRAM
+    const uint16_t bufferBytes,                         // size of both halves together
+    const uint32_t srcAddr )                            // where to start reading, in external SPI memory
+{
+    if ( !buffer or bufferBytes < 2 or ( bufferBytes & 1 ) ) {
+        return false;
     }
 
-    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
-        // tell the ISR who we are
-        _curController = this;
+    waitUntilIdle();
 
-        // make sure no-one falls through while we're working
-        if ( _spiReadySyn ) {
-            _spiReadySyn->clearSignals();
-        }
+    setHeader( CMD_READ, srcAddr );
+    _xfer.src = nullptr;
+    _xfer.dest = buffer;
+    _xfer.numBytes = bufferBytes;
+    _xfer.repeatSrc = false;
+    _xfer.circular = true;
+    _xfer.stopCircular = false;
+    _xfer.halvesDone = 0;
 
-        // set up the housekeeping
-        _rxCursor = nullptr;                            // writing means no RX buffer
-        _txCursor = (uint8_t*) src;
-        _xferBytes = numBytes;
-        _spiXferMode = SpiXferMode::Tx;
+    _streamHalvesSeen = 0;
+    _streamOverruns = 0;
 
-        // tell the SPI chip that we want to talk to it
-        select();
+    _device->submit( _xfer );
 
-        // tell it that we want to write data to destAddress
-        sendWriteCommand( destAddr );
+    return true;
+}
 
-        // enable the ISR
-        setSpiIsrEnable( true );
 
-        // push the first one out to kickstart it
-        SPDR = *_txCursor++;
+/// @brief Returns the half of the stream buffer that has most recently filled
+/// @returns A pointer to the half that's ready to be consumed, or `nullptr` if no
+/// half has filled since the last call.
+/// @note The returned half is only safe to use until the other half fills. If the
+/// caller falls a whole half or more behind, the skipped halves are counted by
+/// getStreamOverruns().
+const uint8_t* SpiMemory::getStreamHalf()
+{
+    const uint8_t done{ _xfer.halvesDone };
+
+    if ( !_xfer.circular or done == _streamHalvesSeen ) {
+        return nullptr;
     }
+
+    _streamOverruns += (uint8_t) ( done - _streamHalvesSeen ) - 1;
+    _streamHalvesSeen = done;
+
+    return ( (const uint8_t*) _xfer.dest ) + ( ( ( done - 1 ) & 1 ) ? _xfer.numBytes / 2 : 0 );
 }
 
 
-// This ISR is run whenever the SPI hardware finishes exchanging a single byte
-ISR( SPI_STC_vect )
+/// @brief Returns the number of buffer halves that filled without being consumed
+/// @returns The number of skipped halves since the stream began.
+uint16_t SpiMemory::getStreamOverruns() const
 {
-    uint8_t rxByte{ 0 };
-    bool storeRxByte{ false };
+    return _streamOverruns;
+}
+
 
-    // capture the input
-    if ( _spiXferMode == SpiXferMode::Rx ) {
-        rxByte = SPDR;
-        storeRxByte = true;
+/// @brief Stops a stream started with beginStream()
+/// @note The stream stops at the next half boundary. This blocks until it has, and
+/// the bus has been released.
+void SpiMemory::endStream()
+{
+    if ( !_xfer.circular ) {
+        return;
     }
 
-    // another 1 bytes the dust
-    _xferBytes--;
-
-    // if there's more data to transfer...
-    if ( _xferBytes ) {
-        // send the correct output
-        if ( _spiXferMode == SpiXferMode::Tx ) {
-            SPDR = *_txCursor++;
-        }
-        else {
-            SPDR = 0;
-        }
+    _xfer.stopCircular = true;
+    waitUntilIdle();
+
+    _xfer.circular = false;
+    _xfer.stopCircular = false;
+}
+
+
+/// @brief Blocks the calling Thread until this chip's most recent transfer completes
+/// @note The data from a read() is only in place once this returns, or the ready
+/// Synapse has been signalled.
+void SpiMemory::waitUntilIdle()
+{
+    while ( _xfer.pending ) {
+        _readySyn->wait();
     }
 
-    // remember the received byte
-    if ( storeRxByte ) {
-        *_rxCursor++ = rxByte;
+    // the bounce buffer from a copy can only go back to the heap from a Thread
+    if ( _bounce ) {
+        memory::free( _bounce, _bounceBytes );
+        _bounce = nullptr;
     }
+}
 
-    // disable things if we're done
-    if ( !_xferBytes ) {
-        setSpiIsrEnable( false );
 
-        if ( _spiReadySyn ) {
-            _spiReadySyn->signal();
-        }
+// sets the transfer up for the read or write half of the next chunk of a copy
+void SpiMemory::setCopyStep( const bool writing )
+{
+    const uint16_t chunk{ _copyRemaining < _bounceBytes ? (uint16_t) _copyRemaining : _bounceBytes };
+    const uint32_t offset{ _copyBackwards ? _copyRemaining - chunk : 0UL };
 
-        _curController->deselect();
-        _curController = nullptr;
+    if ( writing ) {
+        setHeader( CMD_WRITE, _copyDest + offset );
+        _xfer.src = _bounce;
+        _xfer.dest = nullptr;
+    }
+    else {
+        setHeader( CMD_READ, _copySrc + offset );
+        _xfer.src = nullptr;
+        _xfer.dest = _bounce;
     }
+
+    _xfer.numBytes = chunk;
+    _copyWriting = writing;
 }
 
 
-// sends an address to the memory chip
-void SpiMemory::sendAddress( const uint32_t addr ) const
+// Called from the bus's ISR as each step of a copy finishes. Returns `true` to have
+// the bus run the next step.
+bool SpiMemory::onCopyStep( SpiTransfer& xfer )
 {
-    if ( _capacityBytes > ( 1UL << 24 ) ) {
-        spiXfer( addr >> 24 );
+    SpiMemory& m{ *(SpiMemory*) xfer.context };
+
+    // a chunk has been read, so write it out
+    if ( !m._copyWriting ) {
+        m.setCopyStep( true );
+        return true;
     }
 
-    if ( _capacityBytes > ( 1UL << 16 ) ) {
-        spiXfer( addr >> 16 );
+    // a chunk has been written, so move along
+    const uint16_t chunk{ (uint16_t) xfer.numBytes };
+
+    m._copyRemaining -= chunk;
+
+    if ( !m._copyBackwards ) {
+        m._copySrc += chunk;
+        m._copyDest += chunk;
     }
 
-    spiXfer( addr >> 8 );
-    spiXfer( addr >> 0 );
-}
+    if ( m._copyRemaining ) {
+        m.setCopyStep( false );
+        return true;
+    }
 
+    // all done
+    xfer.onDone = nullptr;
 
-// sends a CMD_READ to the memory chip
-void SpiMemory::sendReadCommand( const uint32_t addr ) const
-{
-    spiXfer( CMD_READ );
-    sendAddress( addr );
+    return false;
 }
 
 
-// sends a CMD_WRITE to the memory chip
-void SpiMemory::sendWriteCommand( const uint32_t addr ) const
+// fills in the command and address bytes that precede the data
+void SpiMemory::setHeader( const uint8_t cmd, const uint32_t addr )
 {
-    spiXfer( CMD_WRITE );
-    sendAddress( addr );
+    uint8_t i{ 0 };
+
+    _xfer.header[ i++ ] = cmd;
+
+    if ( _capacityBytes > ( 1UL << 24 ) ) {
+        _xfer.header[ i++ ] = addr >> 24;
+    }
+
+    if ( _capacityBytes > ( 1UL << 16 ) ) {
+        _xfer.header[ i++ ] = addr >> 16;
+    }
+
+    _xfer.header[ i++ ] = addr >> 8;
+    _xfer.header[ i++ ] = addr >> 0;
+
+    _xfer.headerBytes = i;
 }
 
 
@@ -13,10 +13,16 @@
 #define TCRI_ZERO_SRAM_H
 
 
+#ifndef ZERO_DRIVERS_SPI
+    #error "ZERO_DRIVERS_SPIMEM requires ZERO_DRIVERS_SPI"
+#endif
+
+
 #include <stdint.h>
 
 #include "thread.h"
 #include "gpio.h"
+#include "spibus.h"
 
 
 namespace zero {
@@ -30,6 +36,17 @@ namespace zero {
             Gpio& chipSelect,                           // Gpio object for the CS line
             const Synapse& readySyn );                  // Synapse to fire when ready to transfer
 
+        SpiMemory(
+            const uint32_t capacityBytes,               // how many bytes does the chip hold?
+            Gpio& chipSelect,                           // Gpio object for the CS line
+            const Synapse& readySyn,                    // Synapse to fire when ready to transfer
+            SpiBus& bus );                              // the SPI bus the chip is attached to
+
+        SpiMemory(
+            const uint32_t capacityBytes,               // how many bytes does the chip hold?
+            SpiDevice& device,                          // the chip's CS line and bus settings
+            const Synapse& readySyn );                  // Synapse to fire when ready to transfer
+
         void read(
             void* dest,                                 // destination address, in local SRAM
             const uint32_t srcAddr,                     // source address for the data, in external SPI memory
@@ -40,6 +57,27 @@ namespace zero {
             const uint32_t destAddress,                 // destination address, in external SPI memory
             const uint32_t numBytes );                  // number of the bytes to write
 
+        bool copy(
+            const uint32_t srcAddr,                     // source address, in external SPI memory
+            const uint32_t destAddr,                    // destination address, in external SPI memory
+            const uint32_t numBytes );                  // number of bytes to copy
+
+        void fill(
+            const uint32_t destAddr,                    // destination address, in external SPI memory
+            const uint8_t value,                        // the value to write
+            const uint32_t numBytes );                  // number of bytes to set
+
+        bool beginStream(
+            void* buffer,                               // the double buffer, in local SRAM
+            const uint16_t bufferBytes,                 // size of both halves together
+            const uint32_t srcAddr );                   // where to start reading, in external SPI memory
+
+        const uint8_t* getStreamHalf();                 // The half that's just been filled, if any
+        uint16_t getStreamOverruns() const;             // Halves that filled without being consumed
+        void endStream();                               // Stops the stream, and releases the bus
+
+        void waitUntilIdle();                           // Blocks until the last transfer completes
+
         explicit operator bool() const;
 
         #include "sram_private.h"
@@ -9,16 +9,33 @@
 public:
     /// @privatesection
     ~SpiMemory();
-    void select() const;
-    void deselect() const;
 
 private:
     SpiMemory( const SpiMemory& m ) = delete;
     void operator=( const SpiMemory& m ) = delete;
 
-    void sendAddress( const uint32_t addr ) const;
-    void sendReadCommand( const uint32_t addr ) const;
-    void sendWriteCommand( const uint32_t addr ) const;
+    void attach( SpiDevice* const device, const bool ownsDevice, const Synapse& readySyn );
+    void setHeader( const uint8_t cmd, const uint32_t addr );
+    void setCopyStep( const bool writing );
+    static bool onCopyStep( SpiTransfer& xfer );
 
     const uint32_t _capacityBytes{ 0UL };
-    Gpio* _chipSelectPin{ nullptr };
+    const Synapse* _readySyn{ nullptr };
+    SpiDevice* _device{ nullptr };
+    bool _ownsDevice{ false };
+    HardwareSpi* _ownedBus{ nullptr };
+    SpiTransfer _xfer;
+
+    // copy() and fill()
+    uint8_t* _bounce{ nullptr };
+    uint16_t _bounceBytes{ 0 };
+    uint32_t _copySrc{ 0UL };
+    uint32_t _copyDest{ 0UL };
+    uint32_t _copyRemaining{ 0UL };
+    bool _copyBackwards{ false };
+    bool _copyWriting{ false };
+    uint8_t _fillValue{ 0 };
+
+    // beginStream()
+    uint8_t _streamHalvesSeen{ 0 };
+    uint16_t _streamOverruns{ 0 };
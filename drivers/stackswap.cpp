@@ -0,0 +1,362 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_STACKSWAP
+
+
+#include <stdint.h>
+
+#include <util/atomic.h>
+
+#include "stackswap.h"
+#include "memory.h"
+#include "util.h"
+
+
+using namespace zero;
+
+
+namespace {
+
+    // the one and only StackSwapper, for the kernel to notify
+    StackSwapper* _swapper{ nullptr };
+
+    // how long to wait before retrying a swap-in whose SRAM is in use
+    const Duration STALL_RETRY{ 10_ms };
+
+
+    // The live part of a stack starts just above the Thread's saved stack pointer
+    uint8_t* getImage( const Thread& t )
+    {
+        return (uint8_t*) ( t._sp + 1 );
+    }
+
+
+    // ... and runs up to the top of the stack
+    uint16_t getImageBytes( const Thread& t )
+    {
+        return ( (uint16_t) t._stackBottom + t.getStackSizeBytes() ) - ( t._sp + 1 );
+    }
+
+}    // namespace
+
+
+/// @private
+void zero::onSwappedThreadWake( Thread& )
+{
+    if ( _swapper ) {
+        _swapper->onThreadWake();
+    }
+}
+
+
+/// @private
+void zero::onSwappableThreadExit( Thread& t )
+{
+    if ( _swapper ) {
+        _swapper->onThreadExit( t );
+    }
+}
+
+
+/// @brief Creates a new StackSwapper
+/// @param mem The SpiMemory the stacks are swapped out to. The calling Thread must own
+/// its ready Synapse.
+/// @param baseAddr The address in the chip at which the swap area starts. The area
+/// needs room for the stacks of all the Threads added.
+/// @param maxThreads The most Threads that can be added at once.
+/// @param idleTime How long a Thread has to be blocked before its stack is swapped out.
+/// Must be more than zero.
+StackSwapper::StackSwapper(
+    SpiMemory& mem,
+    const uint32_t baseAddr,
+    const uint8_t maxThreads,
+    const Duration idleTime )
+:
+    _mem{ mem },
+    _idleTime{ idleTime },
+    _nextFarAddr{ baseAddr }
+{
+    if ( !mem or !_wakeSyn ) return;
+    if ( !maxThreads or !(uint32_t) idleTime ) return;
+
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        if ( _swapper ) return;
+    }
+
+    _slots = (Slot*) memory::allocate( maxThreads * sizeof( Slot ), &_allocatedBytes );
+
+    if ( _slots ) {
+        _maxSlots = maxThreads;
+
+        ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+            _swapper = this;
+        }
+    }
+}
+
+
+// dtor
+StackSwapper::~StackSwapper()
+{
+    if ( *this ) {
+        // every stack comes home
+        for ( uint8_t i = 0; i < _numSlots; i++ ) {
+            Thread* t;
+
+            ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+                t = _slots[ i ].thread;
+            }
+
+            if ( t ) {
+                remove( *t );
+            }
+        }
+
+        ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+            _swapper = nullptr;
+        }
+
+        memory::free( _slots, _allocatedBytes );
+        _slots = nullptr;
+    }
+}
+
+
+/// @brief Determines if the StackSwapper initialized correctly
+/// @returns `true` if the StackSwapper initialized correctly, `false` otherwise.
+StackSwapper::operator bool() const
+{
+    return _slots;
+}
+
+
+/// @brief Lets a Thread's stack be swapped out while it's blocked
+/// @param t The Thread. It can't be the StackSwapper's own Thread.
+/// @returns `true` if the Thread was added, `false` if there's no room for it.
+/// @note The Thread becomes a candidate for swapping from the next time it calls
+/// `wait()`. A Thread that exits is removed automatically.
+bool StackSwapper::add( Thread& t )
+{
+    if ( !*this or &t == &me ) {
+        return false;
+    }
+
+    const uint16_t stackBytes{ t.getStackSizeBytes() };
+
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        Slot* vacant{ nullptr };
+
+        for ( uint8_t i = 0; i < _numSlots; i++ ) {
+            if ( _slots[ i ].thread == &t ) {
+                return true;
+            }
+
+            // re-use the slot of a removed Thread, if the stack fits
+            if ( !vacant and !_slots[ i ].thread and _slots[ i ].bytes >= stackBytes ) {
+                vacant = &_slots[ i ];
+            }
+        }
+
+        if ( !vacant ) {
+            if ( _numSlots == _maxSlots ) {
+                return false;
+            }
+
+            vacant = &_slots[ _numSlots++ ];
+            vacant->farAddr = _nextFarAddr;
+            vacant->bytes = stackBytes;
+
+            _nextFarAddr += stackBytes;
+        }
+
+        if ( !t.setSwappable( true ) ) {
+            return false;
+        }
+
+        vacant->thread = &t;
+    }
+
+    return true;
+}
+
+
+/// @brief Stops a Thread's stack from being swapped out
+/// @param t The Thread. If its stack is out in the chip, it's brought back first,
+/// blocking the calling Thread until there's room.
+/// @returns `true` if the Thread was removed, `false` if it wasn't added.
+/// @note Call this from the StackSwapper's own Thread.
+bool StackSwapper::remove( Thread& t )
+{
+    while ( true ) {
+        Slot* slot;
+
+        ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+            if ( !( slot = findSlot( t ) ) ) {
+                return false;
+            }
+
+            // only refused while the stack is out
+            if ( t.setSwappable( false ) ) {
+                slot->thread = nullptr;
+                return true;
+            }
+        }
+
+        if ( !readBack( *slot, t ) ) {
+            me.delay( STALL_RETRY );
+        }
+    }
+}
+
+
+/// @brief Swaps stacks in and out, forever
+/// @details Stacks of signalled Threads are brought back as soon as the StackSwapper
+/// hears about them. The idle Threads are looked for every idle time, so a Thread's
+/// stack goes out between one and two idle times after it blocks.
+void StackSwapper::run()
+{
+    while ( true ) {
+        const bool stalled{ !swapIn() };
+
+        swapOut();
+
+        _wakeSyn.wait( stalled ? STALL_RETRY : _idleTime );
+    }
+}
+
+
+/// @brief Gets the swap traffic and wake latency counters
+/// @returns The counters since the StackSwapper was created or clearStats() was called.
+/// The average wake latency is `totalWakeMs / wakes`.
+StackSwapStats StackSwapper::getStats() const
+{
+    return _stats;
+}
+
+
+/// @brief Resets the swap traffic and wake latency counters to zero
+void StackSwapper::clearStats()
+{
+    _stats = StackSwapStats{ 0UL, 0UL, 0UL, 0UL, 0UL, 0UL, 0UL, 0UL };
+}
+
+
+// A swapped-out Thread has been signalled
+void StackSwapper::onThreadWake()
+{
+    _wakeSyn.signal();
+}
+
+
+// A Thread that was added is exiting
+void StackSwapper::onThreadExit( Thread& t )
+{
+    if ( Slot* const slot = findSlot( t ) ) {
+        slot->thread = nullptr;
+    }
+}
+
+
+// Finds the slot a Thread is using. Call with interrupts off.
+StackSwapper::Slot* StackSwapper::findSlot( const Thread& t ) const
+{
+    for ( uint8_t i = 0; i < _numSlots; i++ ) {
+        if ( _slots[ i ].thread == &t ) {
+            return &_slots[ i ];
+        }
+    }
+
+    return nullptr;
+}
+
+
+// Reads back the stacks of the signalled Threads. Returns `false` if any
+// of them couldn't come back yet.
+bool StackSwapper::swapIn()
+{
+    bool rc{ true };
+
+    for ( uint8_t i = 0; i < _numSlots; i++ ) {
+        Thread* t{ nullptr };
+
+        // a swapped-out Thread can't run, so it can't exit from under us
+        ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+            if ( _slots[ i ].thread and _slots[ i ].thread->isAwaitingSwapIn() ) {
+                t = _slots[ i ].thread;
+            }
+        }
+
+        if ( t and !readBack( _slots[ i ], *t ) ) {
+            _stats.stalls++;
+            rc = false;
+        }
+    }
+
+    return rc;
+}
+
+
+// Writes out the stacks of the Threads that have been blocked for long enough
+void StackSwapper::swapOut()
+{
+    for ( uint8_t i = 0; i < _numSlots; i++ ) {
+        Thread* t{ nullptr };
+
+        // once claimed, the Thread can't run, so it can't exit from under us
+        ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+            if ( _slots[ i ].thread and _slots[ i ].thread->beginSwapOut( (uint32_t) _idleTime ) ) {
+                t = _slots[ i ].thread;
+            }
+        }
+
+        if ( !t ) continue;
+
+        const uint16_t bytes{ getImageBytes( *t ) };
+
+        _mem.write( getImage( *t ), _slots[ i ].farAddr, bytes );
+        _mem.waitUntilIdle();
+
+        // if it was signalled meanwhile, its stack stays put
+        if ( t->endSwapOut() ) {
+            _stats.swapOuts++;
+            _stats.bytesOut += bytes;
+        }
+    }
+}
+
+
+// Brings a Thread's stack back from the chip, into the same SRAM it left.
+// Returns `false` if some of that SRAM is in use.
+bool StackSwapper::readBack( Slot& slot, Thread& t )
+{
+    if ( !t.beginSwapIn() ) {
+        return false;
+    }
+
+    const uint16_t bytes{ getImageBytes( t ) };
+
+    _mem.read( getImage( t ), slot.farAddr, bytes );
+    _mem.waitUntilIdle();
+
+    _stats.swapIns++;
+    _stats.bytesIn += bytes;
+
+    uint32_t wakeMs;
+
+    if ( t.endSwapIn( wakeMs ) ) {
+        _stats.wakes++;
+        _stats.totalWakeMs += wakeMs;
+        _stats.maxWakeMs = MAX( _stats.maxWakeMs, wakeMs );
+    }
+
+    return true;
+}
+
+
+#endif
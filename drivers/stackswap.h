@@ -0,0 +1,114 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_STACKSWAP
+
+
+#ifndef TCRI_ZERO_STACKSWAP_H
+#define TCRI_ZERO_STACKSWAP_H
+
+
+#ifndef ZERO_DRIVERS_SPIMEM
+    #error "ZERO_DRIVERS_STACKSWAP requires ZERO_DRIVERS_SPIMEM"
+#endif
+
+// the compactor would slide movable chunks into freed stacks, which never come back
+#ifdef ZERO_HEAP_MOVABLE
+    #error "ZERO_DRIVERS_STACKSWAP can't be used with ZERO_HEAP_MOVABLE"
+#endif
+
+
+#include <stdint.h>
+
+#include "thread.h"
+#include "sram.h"
+#include "time.h"
+
+
+namespace zero {
+
+    /// @brief Swap traffic and wake latency counters for a StackSwapper
+    struct StackSwapStats {
+        uint32_t swapOuts;                              // stacks written out to the chip
+        uint32_t swapIns;                               // stacks read back from the chip
+        uint32_t bytesOut;                              // stack bytes written out
+        uint32_t bytesIn;                               // stack bytes read back
+        uint32_t stalls;                                // swap-in attempts that found their SRAM in use
+        uint32_t wakes;                                 // swapped-out Threads that were signalled
+        uint32_t totalWakeMs;                           // summed signal-to-ready time of those Threads
+        uint32_t maxWakeMs;                             // worst signal-to-ready time
+    };
+
+
+    /// @brief Pages the stacks of long-blocked Threads out to external SPI memory
+    /// @details Threads added to the StackSwapper that stay blocked in `wait()` for
+    /// longer than the idle time have the live part of their stack written out to an
+    /// SpiMemory, and their stack's SRAM returned to the heap. When such a Thread is
+    /// signalled, the StackSwapper reads its stack back before the Thread is put in
+    /// the active list, so the Thread never knows it was gone.
+    ///
+    /// A stack image holds pointers into itself, so it has to come back to the very
+    /// same SRAM addresses. If something else has been allocated there meanwhile, the
+    /// swap-in is retried until that memory is freed again. The freed stacks are
+    /// therefore best used for short-lived buffers and Threads. For the same reason,
+    /// the StackSwapper can't be built with `HEAP_MOVABLE`: the compactor would slide
+    /// movable chunks down into the freed stacks, and they'd never move out again.
+    ///
+    /// The StackSwapper does its work from the Thread that creates it, which must
+    /// also own the SpiMemory's ready Synapse, and which then calls run(). That
+    /// Thread itself can't be swapped out. Only one StackSwapper may exist at a time.
+    /// The feature is enabled by `ZERO_DRIVERS_STACKSWAP` in the `makefile`.
+    /// @par Example
+    /// @code
+    /// int swapperThread()
+    /// {
+    ///     Synapse memReadySyn;
+    ///     Gpio memCs{ ZERO_PINB2 };
+    ///     SpiMemory mem{ 128 * 1024UL, memCs, memReadySyn };
+    ///     StackSwapper swapper{ mem, 0UL, 4, 500_ms };
+    ///
+    ///     swapper.add( *menuThread );
+    ///     swapper.add( *configThread );
+    ///
+    ///     swapper.run();
+    /// }
+    /// @endcode
+    class StackSwapper {
+    public:
+        StackSwapper(
+            SpiMemory& mem,                             // where the stacks are swapped out to
+            const uint32_t baseAddr,                    // where in the chip the swap area starts
+            const uint8_t maxThreads,                   // most Threads that can be added
+            const Duration idleTime );                  // how long a Thread waits before being swapped out
+
+        bool add( Thread& t );                          // Lets a Thread's stack be swapped out
+        bool remove( Thread& t );                       // Brings a Thread's stack back for good
+
+        void run();                                     // Services swapping forever
+
+        StackSwapStats getStats() const;
+        void clearStats();
+
+        explicit operator bool() const;
+
+        #include "stackswap_private.h"
+    };
+
+
+    /// @private
+    // called by the kernel, with interrupts off
+    void onSwappedThreadWake( Thread& t );
+    void onSwappableThreadExit( Thread& t );
+
+}    // namespace zero
+
+
+#endif
+
+
+#endif
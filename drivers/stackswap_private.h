@@ -0,0 +1,42 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~StackSwapper();
+
+    void onThreadWake();
+    void onThreadExit( Thread& t );
+
+private:
+    StackSwapper( const StackSwapper& s ) = delete;
+    void operator=( const StackSwapper& s ) = delete;
+
+    // a place in the chip for one Thread's stack
+    struct Slot {
+        Thread* thread;                                 // the Thread using the slot, or nullptr
+        uint32_t farAddr;                               // where the slot starts in the chip
+        uint16_t bytes;                                 // the biggest stack that fits
+    };
+
+    Slot* findSlot( const Thread& t ) const;
+    bool swapIn();
+    void swapOut();
+    bool readBack( Slot& slot, Thread& t );
+
+    SpiMemory& _mem;
+    const Duration _idleTime;
+    Synapse _wakeSyn;
+
+    Slot* _slots{ nullptr };
+    uint16_t _allocatedBytes{ 0 };
+    uint8_t _maxSlots{ 0 };
+    uint8_t _numSlots{ 0 };
+    uint32_t _nextFarAddr{ 0UL };
+
+    StackSwapStats _stats{ 0UL, 0UL, 0UL, 0UL, 0UL, 0UL, 0UL, 0UL };
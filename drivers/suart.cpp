@@ -21,43 +21,173 @@
 #include "memory.h"
 #include "doublebuffer.h"
 #include "suart.h"
+#include "list.h"
+#include "util.h"
 
 
 using namespace zero;
 
 
 namespace {
-    SuartTx* _suartTx{ nullptr };
+    List<SuartTx> _suartTxList;                         // all the transmit channels
+    uint32_t _suartBaud{ 0UL };                         // the one baud rate they share
+    uint8_t _suartTimerClock{ 0 };                      // Timer2's CS2n bits for that rate
+    uint8_t _suartTimerTop{ 0 };                        // and its OCR2A, one bit-time
+    uint8_t _pendingToggles[ ZERO_NUM_PORTS ];          // edges to output on the next tick
+    SuartRx* _suartRx{ nullptr };
+
+    // Timer1 ticks at F_CPU / 8 while receiving
+    const uint32_t RX_TIMER_PRESCALE{ 8UL };
+
+    // Roughly how many cycles pass between the falling edge of a start bit and the
+    // receiver starting the bit-timer - the pin change ISR, and the Gpio dispatch
+    const uint16_t RX_LATENCY_CYCLES{ 120 };
+    const uint16_t RX_LATENCY_TICKS{ RX_LATENCY_CYCLES / RX_TIMER_PRESCALE };
+
+
+    // Returns the PINx register for a given port number (0 = PINA, 1 = PINB etc)
+    volatile uint8_t* getPinRegister( const uint8_t portNumber )
+    {
+        switch ( portNumber ) {
+            #ifdef PINA
+                case 0: return &PINA;
+            #endif
+
+            #ifdef PINB
+                case 1: return &PINB;
+            #endif
+
+            #ifdef PINC
+                case 2: return &PINC;
+            #endif
+
+            #ifdef PIND
+                case 3: return &PIND;
+            #endif
+        }
+
+        return nullptr;
+    }
+
+
+    // Timer2's pre-scalers, in the order of their CS2n bit patterns, starting at 1
+    const uint16_t TX_TIMER_PRESCALES[]{ 1, 8, 32, 64, 128, 256, 1024 };
+
+
+    // Picks the smallest Timer2 pre-scaler whose bit-time fits in OCR2A, for the best
+    // accuracy. Returns false if the baud rate is too fast or too slow for Timer2.
+    bool setTxTimerBaud( const uint32_t baud )
+    {
+        if ( !baud ) return false;
+
+        for ( uint8_t i = 0; i < sizeof( TX_TIMER_PRESCALES ) / sizeof( TX_TIMER_PRESCALES[ 0 ] ); i++ ) {
+            const uint32_t ticks{ F_CPU / ( TX_TIMER_PRESCALES[ i ] * baud ) };
+
+            if ( !ticks ) return false;
+
+            if ( ticks <= 256UL ) {
+                _suartBaud = baud;
+                _suartTimerClock = i + 1;
+                _suartTimerTop = ticks - 1;
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    // starts the periodic bit-timer for transmission
+    void startTxTimer()
+    {
+        TCCR2B = 0;                                     // make sure timer is stopped
+        TCNT2 = 0;                                      // reset the counter
+        TCCR2A = ( 1 << WGM21 );                        // CTC
+        OCR2A = _suartTimerTop;                         // one bit-time at the chosen pre-scaler
+        TIMSK2 |= ( 1 << OCIE2A );                      // enable Timer2 ISR
+        TCCR2B = _suartTimerClock;                      // start Timer2 with that pre-scaler
+    }
+
+
+    // stops the bit-timer
+    void stopTxTimer()
+    {
+        TIMSK2 &= ~( 1 << OCIE2A );                     // disable Timer ISR
+        TCCR2B = 0;                                     // make sure timer is stopped
+        TCNT2 = 0;                                      // reset the counter
+    }
+
+
+    // determines if the bit-timer is running
+    bool isTxTimerRunning()
+    {
+        return TIMSK2 & ( 1 << OCIE2A );
+    }
+
+
+    // Returns the lowest bit number set in the PinField
+    uint8_t getLowestPin( const PinField pins )
+    {
+        uint8_t rc{ 0 };
+
+        while ( rc < 31 and !( pins & ( 1UL << rc ) ) ) {
+            rc++;
+        }
+
+        return rc;
+    }
 }
 
 
 /// @brief Creates a new SuartTx object
 /// @param baud The bitrate of the transmission.
 /// @param pin The pre-initialized Gpio object that owns the pin(s) you want the
-/// transmitter to send the data on.
+/// transmitter to send the data on. All of the pins must be on the same port.
 /// @param txReadySyn The Synapse to signal when the transmitter is ready to send new
 /// data.
+/// @note All SuartTx objects share Timer2 for their bit-clock, so they must all use the
+/// same baud rate. The first SuartTx created decides it. Timer2 can't count a bit-time
+/// longer than 262144 CPU cycles, so a baud rate below F_CPU / 262144 (61 at 16MHz)
+/// fails to initialize.
 SuartTx::SuartTx(
     const uint32_t baud,
     Gpio& pin,
     Synapse& txReadySyn )
 {
-    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
-        if ( resource::obtain( resource::ResourceId::Timer2 ) ) {
-            _baud = baud;
-            _gpio = &pin;
+    const PinField pins{ pin.getAllocatedPins() };
+    const uint8_t portNumber{ (uint8_t) ( getLowestPin( pins ) >> 3 ) };
+    const uint8_t pinMask{ (uint8_t) ( pins >> ( portNumber << 3 ) ) };
 
-            _gpio->setAsOutput();
-            _gpio->lock( GpioAspect::Direction );
-            _gpio->switchOn();
+    // all pins must be on the same port
+    if ( !pins or ( pins & ~( (PinField) pinMask << ( portNumber << 3 ) ) ) ) return;
+
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        if ( _suartTxList.getHead() ) {
+            // one bit-clock for all - so one baud rate for all
+            if ( baud != _suartBaud ) return;
+        }
+        else {
+            // first one in grabs the timer, if it can tick at that rate
+            if ( !setTxTimerBaud( baud ) ) return;
+            if ( !resource::obtain( resource::ResourceId::Timer2 ) ) return;
 
             power_timer2_enable();
+        }
 
-            _txReadySyn = &txReadySyn;
-            _txReadySyn->signal();
+        _gpio = &pin;
+        _portNumber = portNumber;
+        _pinMask = pinMask;
 
-            _suartTx = this;
-        }
+        _gpio->setAsOutput();
+        _gpio->lock( GpioAspect::Direction );
+        _gpio->switchOn();
+        _lineHigh = true;
+
+        _txReadySyn = &txReadySyn;
+        _txReadySyn->signal();
+
+        _suartTxList.append( *this );
     }
 }
 
@@ -65,18 +195,22 @@ SuartTx::SuartTx(
 // dtor
 SuartTx::~SuartTx()
 {
-    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
         if ( *this ) {
-            stopTxTimer();
-            power_timer2_disable();
+            _suartTxList.remove( *this );
+
+            // last one out turns off the lights
+            if ( !_suartTxList.getHead() ) {
+                stopTxTimer();
+                power_timer2_disable();
+                resource::release( resource::ResourceId::Timer2 );
+            }
 
             _gpio->reset();
+            _gpio = nullptr;
 
             _txReadySyn->clearSignals();
             _txReadySyn = nullptr;
-
-            _suartTx = nullptr;
-            resource::release( resource::ResourceId::Timer2 );
         }
     }
 }
@@ -86,30 +220,7 @@ SuartTx::~SuartTx()
 /// @returns `true` if the SuartTx initialized correctly, `false` otherwise.
 SuartTx::operator bool() const
 {
-    return ( _suartTx == this );
-}
-
-
-// starts the periodic bit-timer for transmission
-void SuartTx::startTxTimer() const
-{
-    const uint16_t scaledMs{ (uint16_t) ( F_CPU / ( 16UL * _baud ) ) - 1 };
-
-    TCCR2B = 0;                                         // make sure timer is stopped
-    TCNT2 = 0;                                          // reset the counter
-    TCCR2A = ( 1 << WGM21 );                            // CTC
-    OCR2A = ( scaledMs / 2 ) - 1;                       // scaled for F_CPU
-    TIMSK2 |= ( 1 << OCIE2A );                          // enable Timer2 ISR
-    TCCR2B = ( ( 1 << CS21 ) | ( 1 << CS20 ) );         // start Timer2 with pre-scaler 32
-}
-
-
-// stops the bit-timer
-void SuartTx::stopTxTimer() const
-{
-    TIMSK2 &= ~( 1 << OCIE2A );                         // disable Timer ISR
-    TCCR2B = 0;                                         // make sure timer is stopped
-    TCNT2 = 0;                                          // reset the counter
+    return _gpio;
 }
 
 
@@ -130,7 +241,8 @@ bool SuartTx::transmit(
         _txReadySyn->wait();
     }
 
-    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+    // the bit-clock may be running for other channels, so keep it out
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
         if ( _txBuffer ) return false;
         if ( !buffer ) return false;
         if ( !numBytes ) return false;
@@ -143,8 +255,10 @@ bool SuartTx::transmit(
         _txBuffer = (uint8_t*) buffer;
         _txBytesRemaining = numBytes;
 
-        // enable the ISR that starts the transmission
-        startTxTimer();
+        // the shared bit-clock picks it up on its next tick
+        if ( !isTxTimerRunning() ) {
+            startTxTimer();
+        }
 
         return true;
     }
@@ -169,57 +283,370 @@ bool SuartTx::getNextTxByte( uint8_t& data )
 }
 
 
-void SuartTx::onTick()
+// Works out this channel's next bit, adding any edge it needs into the per-port
+// toggle masks. Returns `true` if the channel still has bits to send.
+bool SuartTx::onTick( uint8_t* const toggleMasks )
 {
     // just in time fetch of data to send
     if ( !_txReg ) {
-        // Switch off transmission, even if there are more bytes. We will reset and
-        // restart the timer if we need to transmit more data. This improves transmission
-        // accuracy when the MCU is experiencing a lot of task switching and ISRs are
-        // being switched on and off and so on. This helps prevent bit errors under load,
-        // but doesn't completely eliminate them.
-        stopTxTimer();
-
         // the next byte to send is fetched by reference
         uint8_t nextByte;
 
         if ( !getNextTxByte( nextByte ) ) {
             // no more data to send? tidy up, and signal readiness to go again
-            _txBuffer = nullptr;
+            if ( _txBuffer ) {
+                _txBuffer = nullptr;
 
-            if ( _txReadySyn ) {
-                _txReadySyn->signal();
+                if ( _txReadySyn ) {
+                    _txReadySyn->signal();
+                }
             }
-        }
-        else {
-            // load next byte
-            _txReg = nextByte << 1;
-            _txReg &= ~( 1L << 0 );                     // force start bit low
-            _txReg |= ( 1L << 9 );                      // stop bit high (so it ends high)
 
-            startTxTimer();
+            return false;
         }
+
+        // load next byte
+        _txReg = nextByte << 1;
+        _txReg &= ~( 1L << 0 );                         // force start bit low
+        _txReg |= ( 1L << 9 );                          // stop bit high (so it ends high)
+    }
+
+    // we're mid-byte, keep pumping out the bits - we only need an edge when the
+    // bit differs from what's already on the line
+    const bool bit{ (bool) ( _txReg & 1 ) };
+
+    if ( bit != _lineHigh ) {
+        toggleMasks[ _portNumber ] |= _pinMask;
+        _lineHigh = bit;
+    }
+
+    _txReg >>= 1;
+
+    return true;
+}
+
+
+// Timer tick ISR for the shared bit-clock
+ISR( TIMER2_COMPA_vect )
+{
+    // Output the edges worked out on the last tick before doing anything else, so
+    // they land a fixed number of cycles after the compare match, no matter how many
+    // channels there are or what they're up to. Writing a 1 to a PINx bit toggles that
+    // pin in a single instruction, without disturbing the port's other pins.
+    #ifdef PINA
+        PINA = _pendingToggles[ 0 ];
+    #endif
+
+    #ifdef PINB
+        PINB = _pendingToggles[ 1 ];
+    #endif
+
+    #ifdef PINC
+        PINC = _pendingToggles[ 2 ];
+    #endif
+
+    #ifdef PIND
+        PIND = _pendingToggles[ 3 ];
+    #endif
+
+    // now work out everyone's edges for the next tick
+    bool busy{ false };
+
+    for ( uint8_t i = 0; i < ZERO_NUM_PORTS; i++ ) {
+        _pendingToggles[ i ] = 0;
     }
 
-    if ( _txReg ) {
-        // we're mid-byte, keep pumping out the bits
-        if ( _txReg & 1 ) {
+    for ( SuartTx* cur = _suartTxList.getHead(); cur; cur = cur->_next ) {
+        busy |= cur->onTick( _pendingToggles );
+    }
+
+    // nobody left talking? stop the clock until someone is
+    if ( !busy ) {
+        stopTxTimer();
+    }
+}
+
+
+/// @brief Creates a new SuartRx object
+/// @param baud The bitrate of the incoming data.
+/// @param pin The pin to receive on. It must be exactly one pin, and not already owned
+/// by another Gpio.
+/// @note SuartRx uses Timer1 for its bit-clock, so only one can exist at a time.
+SuartRx::SuartRx(
+    const uint32_t baud,
+    const PinField pin )
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        // exactly one pin, thanks
+        if ( !pin or ( pin & ( pin - 1 ) ) ) return;
+
+        if ( resource::obtain( resource::ResourceId::Timer1 ) ) {
+            _gpio = new Gpio{ pin, SuartRx::onPinChange };
+
+            if ( !_gpio or !*_gpio ) {
+                delete _gpio;
+                _gpio = nullptr;
+
+                resource::release( resource::ResourceId::Timer1 );
+                return;
+            }
+
+            // cache the input register and bit for fast sampling
+            const uint8_t pinNumber{ getLowestPin( pin ) };
+            _pinReg = getPinRegister( pinNumber >> 3 );
+            _pinMask = 1 << ( pinNumber & 7 );
+
+            _bitTicks = ( F_CPU / RX_TIMER_PRESCALE + ( baud / 2 ) ) / baud;
+
+            // idle line is high, so input with pull-up
+            _gpio->setAsInput();
+            _gpio->lock( GpioAspect::Direction );
             _gpio->switchOn();
+
+            power_timer1_enable();
+
+            _suartRx = this;
+        }
+    }
+}
+
+
+// dtor
+SuartRx::~SuartRx()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( *this ) {
+            disable();
+            power_timer1_disable();
+
+            _suartRx = nullptr;
+
+            _gpio->reset();
+            delete _gpio;
+            _gpio = nullptr;
+
+            resource::release( resource::ResourceId::Timer1 );
+        }
+    }
+}
+
+
+/// @brief Determines if the SuartRx initialized correctly.
+/// @returns `true` if the SuartRx initialized correctly, `false` otherwise.
+SuartRx::operator bool() const
+{
+    return ( _suartRx == this );
+}
+
+
+/// @brief Enables the receiver
+/// @param bufferSize The size of the buffer used to cache incoming data.
+/// @param rxSyn The Synapse to signal when new data has arrived.
+/// @param ovfSyn Optional. Default: `nullptr`. The Synapse to signal when the receive
+/// buffer is full and bytes are being lost.
+/// @returns `true` if the receiver was enabled, `false` otherwise.
+bool SuartRx::enable( const uint16_t bufferSize, Synapse& rxSyn, Synapse* ovfSyn )
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( !*this ) return false;
+
+        disable();
+
+        if ( ( _rxBuffer = new DoubleBuffer( bufferSize ) ) ) {
+            if ( *_rxBuffer ) {
+                _rxDataReceivedSyn = &rxSyn;
+                _rxOverflowSyn = ovfSyn;
+                return true;
+            }
+
+            delete _rxBuffer;
+            _rxBuffer = nullptr;
+        }
+
+        return false;
+    }
+}
+
+
+/// @brief Disables the receiver
+void SuartRx::disable()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        DoubleBuffer* rxBuffer;
+
+        // the pin-change and bit-timer ISRs use these, so stop them with interrupts off
+        ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+            stopRxTimer();
+            _receiving = false;
+
+            rxBuffer = _rxBuffer;
+            _rxBuffer = nullptr;
+        }
+
+        delete rxBuffer;
+
+        if ( _rxDataReceivedSyn ) {
+            _rxDataReceivedSyn->clearSignals();
+            _rxDataReceivedSyn = nullptr;
+        }
+
+        if ( _rxOverflowSyn ) {
+            _rxOverflowSyn->clearSignals();
+            _rxOverflowSyn = nullptr;
+        }
+    }
+}
+
+
+/// @brief Gets the current receive buffer
+/// @param numBytes A reference to a `uint16_t` to store the number of valid bytes in
+/// the buffer.
+/// @returns A pointer to the current receive buffer, or `nullptr` is the buffer is
+/// currently empty.
+uint8_t* SuartRx::getCurrentBuffer( uint16_t& numBytes )
+{
+    return _rxBuffer->getCurrentBuffer( numBytes );
+}
+
+
+/// @brief Discards the current contents of the receive buffer
+void SuartRx::flush()
+{
+    _rxBuffer->flush();
+}
+
+
+/// @brief Gets the receiver's error and throughput counters
+/// @returns A snapshot of the counters since the last call to clearStats().
+SuartRxStats SuartRx::getStats() const
+{
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        return _stats;
+    }
+}
+
+
+/// @brief Resets the receiver's error and throughput counters to zero
+void SuartRx::clearStats()
+{
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        _stats = SuartRxStats{ 0UL, 0, 0, 0 };
+    }
+}
+
+
+// starts the bit-timer so that the first tick lands in the middle of the start bit
+void SuartRx::startRxTimer() const
+{
+    const uint16_t halfBit{ _bitTicks / 2 };
+
+    TCCR1B = 0;                                         // make sure timer is stopped
+    TCCR1A = 0;
+    TCNT1 = MIN( RX_LATENCY_TICKS, halfBit - 1 );       // account for getting here
+    OCR1A = halfBit;                                    // middle of the start bit
+    TIFR1 = ( 1 << OCF1A );                             // forget any stale match
+    TIMSK1 |= ( 1 << OCIE1A );                          // enable Timer1 ISR
+    TCCR1B = ( 1 << WGM12 ) | ( 1 << CS11 );            // start Timer1, CTC, pre-scaler 8
+}
+
+
+// stops the bit-timer
+void SuartRx::stopRxTimer() const
+{
+    TIMSK1 &= ~( 1 << OCIE1A );                         // disable Timer ISR
+    TCCR1B = 0;                                         // make sure timer is stopped
+}
+
+
+// Called on every edge of the RX pin, and looks for the start of a start bit
+void SuartRx::onPinChange( const Gpio& )
+{
+    SuartRx* const rx{ _suartRx };
+
+    // only interested in falling edges while idle
+    if ( !rx or rx->_receiving or !rx->_rxBuffer ) return;
+    if ( *rx->_pinReg & rx->_pinMask ) return;
+
+    rx->startRxTimer();
+    rx->_receiving = true;
+    rx->_bitNum = 0;
+    rx->_rxReg = 0;
+}
+
+
+// Samples one bit, in the middle of its bit-time
+void SuartRx::onTick()
+{
+    // sample first, while we're closest to the middle of the bit
+    const bool bit{ *_pinReg & _pinMask };
+
+    if ( _bitNum == 0 ) {
+        // start bit - should still be low, or it was just noise
+        if ( bit ) {
+            stopRxTimer();
+            _stats.falseStarts++;
+            _receiving = false;
+            return;
+        }
+
+        // from here on, tick once per bit
+        OCR1A = _bitTicks - 1;
+    }
+    else if ( _bitNum <= 8 ) {
+        // data bits, LSB first
+        _rxReg >>= 1;
+
+        if ( bit ) {
+            _rxReg |= 0x80;
+        }
+    }
+    else {
+        // stop bit - should be high
+        stopRxTimer();
+        _receiving = false;
+
+        if ( bit ) {
+            deliver( _rxReg );
         }
         else {
-            _gpio->switchOff();
+            _stats.framingErrors++;
+        }
+
+        return;
+    }
+
+    _bitNum++;
+}
+
+
+// Stores a received byte and notifies the waiting Thread
+void SuartRx::deliver( const uint8_t data )
+{
+    // disabled while the byte was arriving
+    if ( !_rxBuffer ) return;
+
+    if ( _rxBuffer->write( data ) ) {
+        _stats.bytesReceived++;
+
+        if ( _rxDataReceivedSyn ) {
+            _rxDataReceivedSyn->signal();
         }
+    }
+    else {
+        _stats.overflows++;
 
-        _txReg >>= 1;
+        if ( _rxOverflowSyn ) {
+            _rxOverflowSyn->signal();
+        }
     }
 }
 
 
-// Timer tick ISR for the bit-clock
-ISR( TIMER2_COMPA_vect )
+// Timer tick ISR for the receiver's bit sampling
+ISR( TIMER1_COMPA_vect )
 {
-    if ( _suartTx ) {
-        _suartTx->onTick();
+    if ( _suartRx ) {
+        _suartRx->onTick();
     }
 }
 
@@ -17,11 +17,19 @@
 
 #include "thread.h"
 #include "gpio.h"
+#include "doublebuffer.h"
 
 
 namespace zero {
 
     /// @brief Provides software interrupt-driven UART transmission on any GPIO pin(s)
+    /// @details Any number of SuartTx channels can exist at once. They share a single
+    /// Timer2 bit-clock, so they must all use the same baud rate, and each channel's pins
+    /// must all be on the one port. Each tick outputs the edges for every channel at a
+    /// fixed point straight after the interrupt fires, and then works out the edges for
+    /// the next tick, so bit timing doesn't depend on the number of channels.
+    /// @note SuartTx toggles its pins rather than setting them, so don't drive a
+    /// SuartTx's pins from anywhere else.
     class SuartTx {
     public:
         SuartTx(
@@ -39,6 +47,68 @@ namespace zero {
         #include "suart_private.h"
     };
 
+
+    /// @brief Error and throughput counters for a SuartRx
+    struct SuartRxStats {
+        /// Bytes received and delivered to the receive buffer
+        uint32_t bytesReceived;
+
+        /// Bytes discarded because the stop bit was not high
+        uint16_t framingErrors;
+
+        /// Falling edges that were not still low by the middle of the start bit
+        uint16_t falseStarts;
+
+        /// Bytes lost because the receive buffer was full
+        uint16_t overflows;
+    };
+
+
+    /// @brief Provides software interrupt-driven UART reception on any GPIO pin
+    /// @details The start bit is detected with a pin-change interrupt, and each bit is
+    /// then sampled in the middle of its bit-time by Timer1. Received bytes are
+    /// delivered into a DoubleBuffer, in the same way as UsartRx.
+    /// @code
+    /// int softwareRxDemoThread()
+    /// {
+    ///     Synapse rxSyn;
+    ///     SuartRx rx{ 38400, ZERO_PIND2 };
+    ///
+    ///     if ( rx and rx.enable( 64, rxSyn ) ) {
+    ///         while ( true ) {
+    ///             rxSyn.wait();
+    ///
+    ///             uint16_t numBytes;
+    ///             uint8_t* data{ rx.getCurrentBuffer( numBytes ) };
+    ///
+    ///             // do something with the data
+    ///         }
+    ///     }
+    /// }
+    /// @endcode
+    class SuartRx {
+    public:
+        SuartRx(
+            const uint32_t baud,                        // the speed of the communications
+            const PinField pin );                       // the pin to use for the RX line
+
+        bool enable(
+            const uint16_t bufferSize,
+            Synapse& dataRecdSyn,
+            Synapse* overflowSyn = nullptr );
+
+        void disable();
+        uint8_t* getCurrentBuffer( uint16_t& numBytes );
+        void flush();
+
+        SuartRxStats getStats() const;
+        void clearStats();
+
+        explicit operator bool() const;
+
+        #include "suartrx_private.h"
+    };
+
 }    // namespace zero
 
 
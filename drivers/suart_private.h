@@ -9,15 +9,17 @@
 public:
     /// @privatesection
     ~SuartTx();
-    void onTick();
+    bool onTick( uint8_t* const toggleMasks );
+
+    // list membership
+    SuartTx* _prev;
+    SuartTx* _next;
 
 private:
     SuartTx( const SuartTx& s ) = delete;
     void operator=( const SuartTx& s ) = delete;
 
     bool getNextTxByte( uint8_t& data );
-    void startTxTimer() const;
-    void stopTxTimer() const;
 
     // buffer-level stuff
     uint8_t* _txBuffer{ nullptr };
@@ -27,6 +29,8 @@ private:
     // sub-byte management
     uint16_t _txReg{ 0 };
 
-    // GPIO and comms
-    uint32_t _baud{ 0UL };
+    // GPIO
     Gpio* _gpio{ nullptr };
+    uint8_t _portNumber{ 0 };                           // 0 = PORTA, 1 = PORTB etc
+    uint8_t _pinMask{ 0 };                              // our pins within that port
+    bool _lineHigh{ true };                             // what we last put on the line
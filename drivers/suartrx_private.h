@@ -0,0 +1,38 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~SuartRx();
+    static void onPinChange( const Gpio& pins );
+    void onTick();
+
+private:
+    SuartRx( const SuartRx& s ) = delete;
+    void operator=( const SuartRx& s ) = delete;
+
+    void startRxTimer() const;
+    void stopRxTimer() const;
+    void deliver( const uint8_t data );
+
+    // buffer-level stuff
+    DoubleBuffer* _rxBuffer{ nullptr };
+    Synapse* _rxDataReceivedSyn{ nullptr };
+    Synapse* _rxOverflowSyn{ nullptr };
+    SuartRxStats _stats{ 0UL, 0, 0, 0 };
+
+    // sub-byte management
+    uint8_t _rxReg{ 0 };
+    uint8_t _bitNum{ 0 };
+    bool _receiving{ false };
+
+    // GPIO and comms
+    uint16_t _bitTicks{ 0 };
+    Gpio* _gpio{ nullptr };
+    volatile uint8_t* _pinReg{ nullptr };
+    uint8_t _pinMask{ 0 };
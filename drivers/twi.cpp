@@ -0,0 +1,379 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_TWI
+
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/power.h>
+
+#include <util/atomic.h>
+#include <util/twi.h>
+
+#include "resource.h"
+#include "thread.h"
+#include "twi.h"
+
+
+#ifdef TWCR
+
+
+using namespace zero;
+
+
+namespace {
+
+    const uint32_t TWI_MAX_CLOCK{ 400000UL };
+
+    // TWCR values for each of the things we ask of the hardware
+    const uint8_t TWCR_NEXT{ ( 1 << TWINT ) | ( 1 << TWEN ) | ( 1 << TWIE ) };
+    const uint8_t TWCR_NEXT_ACK{ TWCR_NEXT | ( 1 << TWEA ) };
+    const uint8_t TWCR_START{ TWCR_NEXT | ( 1 << TWSTA ) };
+    const uint8_t TWCR_STOP{ ( 1 << TWINT ) | ( 1 << TWEN ) | ( 1 << TWSTO ) };
+
+    Twi* _twi{ nullptr };
+
+}    // namespace
+
+
+/// @brief Creates a new Twi object
+/// @param clockHz The SCL frequency, up to 400kHz.
+/// @note Only one Twi can exist at a time, as it obtains exclusive access to the TWI
+/// peripheral. Share it between all the TwiDevices on the bus.
+Twi::Twi( const uint32_t clockHz )
+{
+    if ( !clockHz ) {
+        return;
+    }
+
+    if ( !resource::obtain( resource::ResourceId::I2c ) ) {
+        return;
+    }
+
+    power_twi_enable();
+
+    // SCL = F_CPU / ( 16 + 2 * TWBR * prescaler ), so find the smallest
+    // prescaler (1, 4, 16, 64) that brings TWBR into range
+    const uint32_t hz{ clockHz > TWI_MAX_CLOCK ? TWI_MAX_CLOCK : clockHz };
+    uint32_t divisor{ ( F_CPU / hz ) > 16 ? ( ( F_CPU / hz ) - 16 ) / 2 : 0 };
+    uint8_t prescaleBits{ 0 };
+
+    while ( divisor > 255 and prescaleBits < 3 ) {
+        divisor = ( divisor + 3 ) / 4;
+        prescaleBits++;
+    }
+
+    TWSR = prescaleBits;
+    TWBR = divisor > 255 ? 255 : divisor;
+    TWCR = ( 1 << TWEN );
+
+    _twi = this;
+    _initialized = true;
+}
+
+
+// dtor
+Twi::~Twi()
+{
+    if ( *this ) {
+        TWCR = 0;
+        power_twi_disable();
+
+        _twi = nullptr;
+        _initialized = false;
+
+        resource::release( resource::ResourceId::I2c );
+    }
+}
+
+
+/// @brief Determines if the Twi initialized correctly
+/// @returns `true` if the Twi initialized correctly, `false` otherwise.
+Twi::operator bool() const
+{
+    return _initialized;
+}
+
+
+/// @brief Determines if the Twi is currently running a transaction
+/// @returns `true` if there is a transaction underway or queued, `false` otherwise.
+bool Twi::isBusy() const
+{
+    return _queue.getHead();
+}
+
+
+// Adds a device's transaction to the queue, starting the bus if it's idle
+void Twi::enqueue( TwiDevice& device )
+{
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        const bool idle{ !_queue.getHead() };
+
+        _queue.append( device );
+
+        if ( idle ) {
+            start( false );
+        }
+    }
+}
+
+
+// Kicks off the transaction at the head of the queue
+void Twi::start( const bool afterStop )
+{
+    if ( afterStop ) {
+        // the hardware sends the STOP for the last one, then our START
+        TWCR = TWCR_START | ( 1 << TWSTO );
+    }
+    else {
+        // the STOP that ended the previous transaction may still be going out
+        while ( TWCR & ( 1 << TWSTO ) ) {
+            // empty
+        }
+
+        TWCR = TWCR_START;
+    }
+}
+
+
+// Finishes the transaction at the head of the queue, and moves onto the next
+void Twi::complete( const TwiResult result )
+{
+    TwiDevice* const device{ _queue.getHead() };
+
+    _queue.remove( *device );
+
+    device->_result = result;
+    device->_readySyn->signal();
+
+    if ( _queue.getHead() ) {
+        start( true );
+    }
+    else {
+        TWCR = TWCR_STOP;
+    }
+}
+
+
+// Runs the transaction state machine each time the TWI hardware needs attention
+void Twi::onTwi()
+{
+    TwiDevice* const device{ _queue.getHead() };
+
+    if ( !device ) {
+        TWCR = TWCR_STOP;
+        return;
+    }
+
+    switch ( TW_STATUS ) {
+        case TW_START:
+        case TW_REP_START:
+            // writes go first, then a repeated start for the reads
+            if ( device->_txBytes or !device->_rxBytes ) {
+                TWDR = ( device->_address << 1 ) | TW_WRITE;
+            }
+            else {
+                TWDR = ( device->_address << 1 ) | TW_READ;
+            }
+
+            TWCR = TWCR_NEXT;
+            break;
+
+        case TW_MT_SLA_ACK:
+        case TW_MT_DATA_ACK:
+            if ( device->_txBytes ) {
+                TWDR = *device->_txCursor++;
+                device->_txBytes--;
+                TWCR = TWCR_NEXT;
+            }
+            else if ( device->_rxBytes ) {
+                TWCR = TWCR_START;
+            }
+            else {
+                complete( TwiResult::Ok );
+            }
+
+            break;
+
+        case TW_MR_DATA_ACK:
+            *device->_rxCursor++ = TWDR;
+            device->_rxBytes--;
+
+            // fall through
+
+        case TW_MR_SLA_ACK:
+            // ACK all but the last byte, to tell the device when to stop
+            TWCR = ( device->_rxBytes > 1 ) ? TWCR_NEXT_ACK : TWCR_NEXT;
+            break;
+
+        case TW_MR_DATA_NACK:
+            *device->_rxCursor++ = TWDR;
+            device->_rxBytes--;
+            complete( TwiResult::Ok );
+            break;
+
+        case TW_MT_SLA_NACK:
+        case TW_MR_SLA_NACK:
+            complete( TwiResult::AddressNack );
+            break;
+
+        case TW_MT_DATA_NACK:
+            // a NACK on the very last byte of a write is allowed
+            complete( ( device->_txBytes or device->_rxBytes ) ? TwiResult::DataNack : TwiResult::Ok );
+            break;
+
+        default:
+            complete( TwiResult::BusError );
+            break;
+    }
+}
+
+
+/// @brief Creates a new TwiDevice object
+/// @param bus The Twi that the device is attached to.
+/// @param address The 7-bit address of the device.
+/// @param readySyn The Synapse to signal when a transaction completes.
+TwiDevice::TwiDevice(
+    Twi& bus,
+    const uint8_t address,
+    const Synapse& readySyn )
+{
+    if ( !bus ) {
+        return;
+    }
+
+    _address = address & 0x7F;
+    _readySyn = &readySyn;
+    _readySyn->signal();
+
+    // validity is determined by this one, so it goes last
+    _bus = &bus;
+}
+
+
+// dtor
+TwiDevice::~TwiDevice()
+{
+    if ( *this ) {
+        // the ISR still has hold of us
+        while ( _result == TwiResult::Pending ) {
+            _readySyn->wait();
+        }
+
+        _readySyn->clearSignals();
+        _readySyn = nullptr;
+        _bus = nullptr;
+    }
+}
+
+
+/// @brief Determines if the TwiDevice initialized correctly
+/// @returns `true` if the TwiDevice initialized correctly, `false` otherwise.
+TwiDevice::operator bool() const
+{
+    return _bus;
+}
+
+
+/// @brief Returns the result of the most recent transaction
+/// @returns `TwiResult::Pending` until the transaction completes, and its outcome after
+/// that.
+TwiResult TwiDevice::getResult() const
+{
+    return _result;
+}
+
+
+/// @brief Reads data from the device into local SRAM
+/// @param dest A pointer to local SRAM where the incoming data should be placed.
+/// @param numBytes The number of bytes to read.
+/// @returns `true` if the transaction was queued, `false` otherwise.
+/// @note If a previous transaction on this device hasn't finished yet, the calling
+/// Thread will block until it does.
+bool TwiDevice::read( void* dest, const uint16_t numBytes )
+{
+    return submit( nullptr, 0, dest, numBytes );
+}
+
+
+/// @brief Writes data from local SRAM to the device
+/// @param src A pointer to the data in local SRAM.
+/// @param numBytes The number of bytes to write.
+/// @returns `true` if the transaction was queued, `false` otherwise.
+/// @note If a previous transaction on this device hasn't finished yet, the calling
+/// Thread will block until it does.
+bool TwiDevice::write( const void* src, const uint16_t numBytes )
+{
+    return submit( src, numBytes, nullptr, 0 );
+}
+
+
+/// @brief Writes data to the device, and then reads from it after a repeated start
+/// @param src A pointer to the data to write, in local SRAM.
+/// @param numTxBytes The number of bytes to write.
+/// @param dest A pointer to local SRAM where the incoming data should be placed.
+/// @param numRxBytes The number of bytes to read.
+/// @returns `true` if the transaction was queued, `false` otherwise.
+/// @note This is the usual way to read a device's registers - write the register
+/// number, then read back its contents, without releasing the bus in between.
+bool TwiDevice::writeRead(
+    const void* src,
+    const uint16_t numTxBytes,
+    void* dest,
+    const uint16_t numRxBytes )
+{
+    return submit( src, numTxBytes, dest, numRxBytes );
+}
+
+
+// queues a transaction on the bus
+bool TwiDevice::submit(
+    const void* src,
+    const uint16_t numTxBytes,
+    void* dest,
+    const uint16_t numRxBytes )
+{
+    if ( !*this ) return false;
+    if ( numTxBytes and !src ) return false;
+    if ( numRxBytes and !dest ) return false;
+
+    // one transaction at a time per device
+    while ( _result == TwiResult::Pending ) {
+        _readySyn->wait();
+    }
+
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        _txCursor = (const uint8_t*) src;
+        _txBytes = numTxBytes;
+        _rxCursor = (uint8_t*) dest;
+        _rxBytes = numRxBytes;
+        _result = TwiResult::Pending;
+
+        _readySyn->clearSignals();
+        _bus->enqueue( *this );
+    }
+
+    return true;
+}
+
+
+// TWI ISR
+ISR( TWI_vect )
+{
+    if ( _twi ) {
+        _twi->onTwi();
+    }
+}
+
+
+#endif
+
+
+#endif
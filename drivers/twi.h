@@ -0,0 +1,123 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifdef ZERO_DRIVERS_TWI
+
+
+#ifndef TCRI_ZERO_TWI_H
+#define TCRI_ZERO_TWI_H
+
+
+#include <stdint.h>
+#include <avr/io.h>
+
+
+#ifdef TWCR
+
+
+#include "thread.h"
+#include "list.h"
+
+
+namespace zero {
+
+    class TwiDevice;
+
+
+    /// @brief The outcome of a TwiDevice transaction
+    enum class TwiResult {
+        /// The transaction completed successfully
+        Ok,
+
+        /// The transaction is still queued or underway
+        Pending,
+
+        /// No device acknowledged the address
+        AddressNack,
+
+        /// The device refused a data byte
+        DataNack,
+
+        /// The bus was lost to another master, or a bus error occurred
+        BusError,
+    };
+
+
+    /// @brief Provides an interrupt-driven master for the hardware TWI (I2C) bus
+    /// @details Transactions from all of the TwiDevices on the bus are queued, and the
+    /// TWI ISR runs them back-to-back, signalling each device's Synapse as its
+    /// transaction completes. The SDA and SCL lines need external pull-up resistors.
+    /// @par Example
+    /// @code
+    /// int twiDemo()
+    /// {
+    ///     Synapse sensorReadySyn;
+    ///     Twi twi{ 400000UL };
+    ///     TwiDevice sensor{ twi, 0x48, sensorReadySyn };
+    ///     const uint8_t reg{ 0x00 };
+    ///     uint8_t temp[ 2 ];
+    ///
+    ///     // repeated-start register read
+    ///     sensor.writeRead( &reg, 1, temp, 2 );
+    ///     sensorReadySyn.wait();
+    ///
+    ///     if ( sensor.getResult() == TwiResult::Ok ) {
+    ///         // ...
+    ///     }
+    /// }
+    /// @endcode
+    class Twi {
+    public:
+        Twi( const uint32_t clockHz = 100000UL );       // bus speed, up to 400kHz
+
+        explicit operator bool() const;                 // Determines if the Twi initialized correctly
+        bool isBusy() const;                            // Determines if a transaction is underway
+
+        #include "twi_private.h"
+    };
+
+
+    /// @brief Provides asynchronous access to a single device on a Twi bus
+    class TwiDevice {
+    public:
+        TwiDevice(
+            Twi& bus,                                   // the bus the device is attached to
+            const uint8_t address,                      // 7-bit device address
+            const Synapse& readySyn );                  // Synapse to fire when a transaction completes
+
+        bool read(
+            void* dest,                                 // destination address, in local SRAM
+            const uint16_t numBytes );                  // number of bytes to read
+
+        bool write(
+            const void* src,                            // source data address, in local SRAM
+            const uint16_t numBytes );                  // number of bytes to write
+
+        bool writeRead(
+            const void* src,                            // bytes to write first, in local SRAM
+            const uint16_t numTxBytes,                  // number of bytes to write
+            void* dest,                                 // destination address for the read, in local SRAM
+            const uint16_t numRxBytes );                // number of bytes to read after the repeated start
+
+        TwiResult getResult() const;                    // Result of the most recent transaction
+
+        explicit operator bool() const;
+
+        #include "twidevice_private.h"
+    };
+
+}    // namespace zero
+
+
+#endif
+
+
+#endif
+
+
+#endif
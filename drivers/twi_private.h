@@ -0,0 +1,24 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~Twi();
+
+    void enqueue( TwiDevice& device );
+    void onTwi();
+
+private:
+    Twi( const Twi& t ) = delete;
+    void operator=( const Twi& t ) = delete;
+
+    void start( const bool afterStop );
+    void complete( const TwiResult result );
+
+    List<TwiDevice> _queue;                             // the transaction at the head is underway
+    bool _initialized{ false };
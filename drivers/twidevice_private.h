@@ -0,0 +1,38 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~TwiDevice();
+
+    // list membership
+    TwiDevice* _prev;
+    TwiDevice* _next;
+
+private:
+    friend class Twi;
+
+    TwiDevice( const TwiDevice& d ) = delete;
+    void operator=( const TwiDevice& d ) = delete;
+
+    bool submit(
+        const void* src,
+        const uint16_t numTxBytes,
+        void* dest,
+        const uint16_t numRxBytes );
+
+    Twi* _bus{ nullptr };
+    const Synapse* _readySyn{ nullptr };
+    uint8_t _address{ 0 };
+
+    // current transaction
+    const uint8_t* _txCursor{ nullptr };
+    uint8_t* _rxCursor{ nullptr };
+    uint16_t _txBytes{ 0 };
+    uint16_t _rxBytes{ 0 };
+    volatile TwiResult _result{ TwiResult::Ok };
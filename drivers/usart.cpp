@@ -43,12 +43,14 @@ using namespace zero;
 #endif
 
 
+volatile uint8_t* _UCSRA_base = &UCSR0A;
 volatile uint8_t* _UCSRB_base = &UCSR0B;
 volatile uint8_t* _UCSRC_base = &UCSR0C;
 volatile uint8_t* _UBRRH_base = &UBRR0H;
 volatile uint8_t* _UBRRL_base = &UBRR0L;
 volatile uint8_t* _UDR_base = &UDR0;
 
+#define UCSRA( p ) *( (volatile uint8_t*) ( _UCSRA_base + ( p * 8 ) ) )
 #define UCSRB( p ) *( (volatile uint8_t*) ( _UCSRB_base + ( p * 8 ) ) )
 #define UCSRC( p ) *( (volatile uint8_t*) ( _UCSRC_base + ( p * 8 ) ) )
 #define UBRRH( p ) *( (volatile uint8_t*) ( _UBRRH_base + ( p * 8 ) ) )
@@ -80,6 +82,46 @@ volatile uint8_t* _UDR_base = &UDR0;
 namespace {
     UsartTx* _usartTx[ NUM_DEVICES ];
     UsartRx* _usartRx[ NUM_DEVICES ];
+
+#ifdef ZERO_DRIVERS_SPI
+    UsartSpi* _usartSpi[ NUM_DEVICES ];
+
+    // the XCK pin of each USART, which becomes SCLK in MSPIM
+    #if defined( UCSR1B )
+        const PinField XCK_PINS[ NUM_DEVICES ] = { ZERO_PINB0, ZERO_PIND4 };
+    #else
+        const PinField XCK_PINS[ NUM_DEVICES ] = { ZERO_PIND4 };
+    #endif
+
+
+    // Works out the UCSRC bits and UBRR value for a set of device settings
+    void encodeUsartSpi(
+        const uint32_t clockHz,
+        const SpiMode mode,
+        const SpiBitOrder order,
+        SpiConfig& config )
+    {
+        // in MSPIM, SCLK = F_CPU / ( 2 * ( UBRR + 1 ) ), and UBRR is 12 bits
+        uint32_t scaled{ 0UL };
+
+        if ( clockHz and clockHz < ( F_CPU / 2 ) ) {
+            scaled = ( ( F_CPU / 2 ) + clockHz - 1 ) / clockHz - 1;
+        }
+
+        if ( !clockHz or scaled > 0x0FFF ) {
+            scaled = 0x0FFF;
+        }
+
+        config.values[ 0 ] = 0;
+
+        if ( (uint8_t) mode & 2 ) config.values[ 0 ] |= ( 1 << UCPOL0 );
+        if ( (uint8_t) mode & 1 ) config.values[ 0 ] |= ( 1 << UCPHA0 );
+        if ( order == SpiBitOrder::LsbFirst ) config.values[ 0 ] |= ( 1 << UDORD0 );
+
+        config.values[ 1 ] = scaled >> 8;
+        config.values[ 2 ] = scaled & 0xFF;
+    }
+#endif
 }    // namespace
 
 
@@ -191,6 +233,19 @@ bool UsartTx::transmit(
 }
 
 
+/// @brief Blocks the calling Thread until the transmission underway, if any, is done
+/// @details Once this returns, the buffer that was last transmitted can be reused. The
+/// ready Synapse is left signalled, so the next transmit() doesn't block.
+/// @note The ready Synapse must belong to the calling Thread.
+void UsartTx::waitUntilIdle()
+{
+    if ( _txReadySyn ) {
+        _txReadySyn->wait();
+        _txReadySyn->signal();
+    }
+}
+
+
 bool UsartTx::getNextTxByte( uint8_t& data )
 {
     bool rc{ false };
@@ -364,6 +419,118 @@ void UsartRx::onRx( const uint8_t deviceNum, const uint8_t data )
 }
 
 
+#ifdef ZERO_DRIVERS_SPI
+
+
+/// @brief Creates a new UsartSpi for using one of the hardware USART peripherals as an
+/// SPI master
+/// @param deviceNum The hardware USART peripheral device number to use.
+/// @param clockHz Optional. Default: `F_CPU / 2`. The SPI clock speed, in Hz, for
+/// transfers that aren't made through an SpiDevice. The fastest possible clock is half
+/// of `F_CPU`.
+/// @param mode Optional. Default: SpiMode::Mode0. The SPI mode for transfers that
+/// aren't made through an SpiDevice.
+/// @param order Optional. Default: SpiBitOrder::MsbFirst. The bit order for transfers
+/// that aren't made through an SpiDevice.
+/// @note The USART's XCK pin is claimed as a Gpio for the SPI clock, so it must not be
+/// owned by anyone else.
+UsartSpi::UsartSpi(
+    const uint8_t deviceNum,
+    const uint32_t clockHz,
+    const SpiMode mode,
+    const SpiBitOrder order )
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( deviceNum >= NUM_DEVICES ) return;
+
+        // MSPIM takes over both halves of the USART
+        auto txId = (resource::ResourceId)( (uint16_t) resource::ResourceId::UsartTx0 + deviceNum );
+        auto rxId = (resource::ResourceId)( (uint16_t) resource::ResourceId::UsartRx0 + deviceNum );
+
+        if ( !resource::obtain( txId ) ) return;
+
+        if ( !resource::obtain( rxId ) ) {
+            resource::release( txId );
+            return;
+        }
+
+        // we need the XCK pin for the clock
+        _clockPin = new Gpio{ XCK_PINS[ deviceNum ] };
+
+        if ( !_clockPin or !*_clockPin ) {
+            delete _clockPin;
+            _clockPin = nullptr;
+
+            resource::release( rxId );
+            resource::release( txId );
+            return;
+        }
+
+        _deviceNum = deviceNum;
+        _usartSpi[ deviceNum ] = this;
+
+        // the baud rate must be zero while the transmitter is being enabled
+        UBRRH( _deviceNum ) = 0;
+        UBRRL( _deviceNum ) = 0;
+
+        // XCK is an output in master mode
+        _clockPin->setAsOutput();
+        _clockPin->lock( GpioAspect::Direction );
+
+        // MSPIM, SPI mode 0, MSB first
+        UCSRC( _deviceNum ) = ( 1 << UMSEL01 ) | ( 1 << UMSEL00 );
+        UCSRB( _deviceNum ) = ( 1 << RXEN0 ) | ( 1 << TXEN0 );
+
+        // now we can set the clock speed, along with the mode and bit order, which
+        // each device can bring its own of
+        SpiConfig defaultConfig;
+        encodeUsartSpi( clockHz, mode, order, defaultConfig );
+
+        attachConfig(
+            &UCSRC( _deviceNum ), ( 1 << UDORD0 ) | ( 1 << UCPHA0 ) | ( 1 << UCPOL0 ),
+            &UBRRH( _deviceNum ), 0x0F,
+            &UBRRL( _deviceNum ), 0xFF,
+            encodeUsartSpi,
+            defaultConfig );
+
+        // double-buffered transmitter means two bytes can be in flight
+        attach(
+            &UDR( _deviceNum ),
+            &UCSRB( _deviceNum ),
+            ( 1 << RXCIE0 ),
+            &UCSRA( _deviceNum ),
+            ( 1 << UDRE0 ),
+            2 );
+    }
+}
+
+
+// dtor
+UsartSpi::~UsartSpi()
+{
+    ZERO_ATOMIC_BLOCK ( ZERO_ATOMIC_RESTORESTATE ) {
+        if ( _usartSpi[ _deviceNum ] == this ) {
+            // switch off, and return to asynchronous 8-none-1
+            UCSRB( _deviceNum ) = 0;
+            UCSRC( _deviceNum ) = ( 1 << UCSZ01 ) | ( 1 << UCSZ00 );
+
+            _usartSpi[ _deviceNum ] = nullptr;
+
+            _clockPin->reset();
+            delete _clockPin;
+            _clockPin = nullptr;
+
+            // free the resources
+            resource::release( (resource::ResourceId)( (uint16_t) resource::ResourceId::UsartRx0 + _deviceNum ) );
+            resource::release( (resource::ResourceId)( (uint16_t) resource::ResourceId::UsartTx0 + _deviceNum ) );
+        }
+    }
+}
+
+
+#endif
+
+
 #ifdef UCSR0B
 
 ISR( USART_TX_vect )
@@ -389,6 +556,14 @@ ISR( USART_UDRE_vect )
 
 ISR( USART_RX_vect )
 {
+    #ifdef ZERO_DRIVERS_SPI
+        // in MSPIM, receive-complete means a byte was exchanged
+        if ( _usartSpi[ 0 ] ) {
+            _usartSpi[ 0 ]->onXferComplete();
+            return;
+        }
+    #endif
+
     register volatile uint8_t newByte = UDR0;
     UsartRx::onRx( 0, newByte );
 }
@@ -421,6 +596,14 @@ ISR( USART1_UDRE_vect )
 
 ISR( USART1_RX_vect )
 {
+    #ifdef ZERO_DRIVERS_SPI
+        // in MSPIM, receive-complete means a byte was exchanged
+        if ( _usartSpi[ 1 ] ) {
+            _usartSpi[ 1 ]->onXferComplete();
+            return;
+        }
+    #endif
+
     register volatile uint8_t newByte = UDR1;
     UsartRx::onRx( 1, newByte );
 }
@@ -453,6 +636,14 @@ ISR( USART2_UDRE_vect )
 
 ISR( USART2_RX_vect )
 {
+    #ifdef ZERO_DRIVERS_SPI
+        // in MSPIM, receive-complete means a byte was exchanged
+        if ( _usartSpi[ 2 ] ) {
+            _usartSpi[ 2 ]->onXferComplete();
+            return;
+        }
+    #endif
+
     register volatile uint8_t newByte = UDR2;
     UsartRx::onRx( 2, newByte );
 }
@@ -485,6 +676,14 @@ ISR( USART3_UDRE_vect )
 
 ISR( USART3_RX_vect )
 {
+    #ifdef ZERO_DRIVERS_SPI
+        // in MSPIM, receive-complete means a byte was exchanged
+        if ( _usartSpi[ 3 ] ) {
+            _usartSpi[ 3 ]->onXferComplete();
+            return;
+        }
+    #endif
+
     register volatile uint8_t newByte = UDR3;
     UsartRx::onRx( 3, newByte );
 }
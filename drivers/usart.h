@@ -23,6 +23,10 @@
 #include "thread.h"
 #include "doublebuffer.h"
 
+#ifdef ZERO_DRIVERS_SPI
+    #include "spibus.h"
+#endif
+
 
 namespace zero {
 
@@ -53,6 +57,8 @@ namespace zero {
             const uint16_t sz,
             const bool allowBlock = false );
 
+        void waitUntilIdle();
+
         explicit operator bool() const;
 
         #include "usarttx_private.h"
@@ -79,6 +85,37 @@ namespace zero {
         #include "usartrx_private.h"
     };
 
+#ifdef ZERO_DRIVERS_SPI
+
+    /// @brief Provides an SpiBus using a hardware USART in Master SPI Mode (MSPIM)
+    /// @details In MSPIM, the USART's TXD, RXD, and XCK pins become MOSI, MISO, and SCLK
+    /// respectively. The USART's transmitter is double-buffered, so the bus is kept
+    /// streaming at full clock with no gaps between bytes. A UsartSpi takes over both the
+    /// transmitter and receiver of its USART.
+    /// @code
+    /// int usartSpiDemo()
+    /// {
+    ///     Synapse memReadySyn;
+    ///     Gpio memCs{ ZERO_PINC0 };
+    ///     UsartSpi spi{ 1 };
+    ///     SpiMemory mem{ 128 * 1024UL, memCs, memReadySyn, spi };
+    ///
+    ///     // ...
+    /// }
+    /// @endcode
+    class UsartSpi : public SpiBus {
+    public:
+        UsartSpi(
+            const uint8_t deviceNum,
+            const uint32_t clockHz = F_CPU / 2,         // settings for transfers without an SpiDevice
+            const SpiMode mode = SpiMode::Mode0,
+            const SpiBitOrder order = SpiBitOrder::MsbFirst );
+
+        #include "usartspi_private.h"
+    };
+
+#endif
+
 }    // namespace zero
 
 
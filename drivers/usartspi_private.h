@@ -0,0 +1,18 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~UsartSpi();
+
+private:
+    UsartSpi( const UsartSpi& u ) = delete;
+    void operator=( const UsartSpi& u ) = delete;
+
+    uint8_t _deviceNum{ 0 };
+    Gpio* _clockPin{ nullptr };
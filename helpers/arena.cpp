@@ -0,0 +1,126 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#include <stdint.h>
+
+#include "arena.h"
+#include "memory.h"
+
+
+using namespace zero;
+
+
+namespace {
+
+    const uint16_t NO_MARK{ 0xFFFF };
+
+}    // namespace
+
+
+/// @brief Creates a new Arena, taking its memory from the heap
+/// @param numBytes The number of bytes the Arena can hand out before it's reset. Each
+/// outstanding mark() also takes two (2) bytes of it.
+Arena::Arena( const uint16_t numBytes )
+:
+    _chunk{ (uint8_t*) memory::allocateFrom( HEAP_CALLER, numBytes, &_chunkBytes, memory::SearchStrategy::BottomUp ) },
+    _markOffset{ NO_MARK }
+{
+    // empty
+}
+
+
+// dtor
+Arena::~Arena()
+{
+    memory::freeFrom( HEAP_CALLER, _chunk, _chunkBytes );
+}
+
+
+/// @brief Determines if the Arena initialized correctly
+/// @returns `true` if the Arena initialized correctly, `false` otherwise.
+Arena::operator bool() const
+{
+    return _chunk;
+}
+
+
+/// @brief Allocates memory from the Arena
+/// @param numBytes The number of bytes required.
+/// @param alignment Optional. Default: 1. The address returned will be a multiple of
+/// this, which must be a power of two (2).
+/// @returns The address of the memory, or `nullptr` if there isn't enough left in the
+/// Arena. Unlike memory::allocate(), running out doesn't call onOutOfMemory().
+void* Arena::allocate( const uint16_t numBytes, const uint8_t alignment )
+{
+    if ( !_chunk or !numBytes or !alignment ) return nullptr;
+
+    const uint16_t padding{ (uint16_t) ( -( (uintptr_t) _chunk + _usedBytes ) & ( alignment - 1 ) ) };
+
+    const uint16_t available{ (uint16_t) ( _chunkBytes - _usedBytes ) };
+
+    if ( numBytes > available or padding > available - numBytes ) {
+        return nullptr;
+    }
+
+    void* const rc{ _chunk + _usedBytes + padding };
+    _usedBytes += padding + numBytes;
+
+    return rc;
+}
+
+
+/// @brief Frees everything allocated from the Arena, and forgets any marks
+void Arena::reset()
+{
+    _usedBytes = 0;
+    _markOffset = NO_MARK;
+}
+
+
+/// @brief Remembers how much of the Arena is in use, for a later rewind()
+/// @details Marks nest, and each one is kept in the Arena itself, so there's no limit
+/// to how deep they go.
+/// @returns `true` if the mark was made, `false` if the Arena is full.
+bool Arena::mark()
+{
+    uint16_t* const m{ (uint16_t*) allocate( sizeof( uint16_t ) ) };
+
+    if ( !m ) {
+        return false;
+    }
+
+    *m = _markOffset;
+    _markOffset = (uint8_t*) m - _chunk;
+
+    return true;
+}
+
+
+/// @brief Frees everything allocated since the most recent mark(), and that mark
+/// @note Does nothing if there is no mark.
+void Arena::rewind()
+{
+    if ( _markOffset == NO_MARK ) return;
+
+    _usedBytes = _markOffset;
+    _markOffset = *(uint16_t*) ( _chunk + _markOffset );
+}
+
+
+/// @brief Gets the number of bytes in use, including any alignment padding and marks
+uint16_t Arena::getUsedBytes() const
+{
+    return _usedBytes;
+}
+
+
+/// @brief Gets the total number of bytes the Arena holds
+uint16_t Arena::getCapacity() const
+{
+    return _chunkBytes;
+}
@@ -0,0 +1,59 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifndef TCRI_ZERO_ARENA_H
+#define TCRI_ZERO_ARENA_H
+
+
+#include <stdint.h>
+
+
+namespace zero {
+
+    /// @brief Hands out short-lived memory from one chunk of the heap, all freed at once
+    /// @details The Arena takes a single chunk from the heap when it's created. Each
+    /// allocate() just moves a pointer along the chunk, and nothing is freed on its own.
+    /// reset(), or destroying the Arena, gives everything back in one go, so a burst
+    /// of temporary buffers never fragments the heap. mark() and rewind() free only
+    /// what was allocated since the matching mark(), and may be nested. An Arena is
+    /// meant to be used by one Thread at a time.
+    /// @par Example
+    /// @code
+    /// void handleMessage( Arena& arena, const Message& msg )
+    /// {
+    ///     uint8_t* header{ (uint8_t*) arena.allocate( 8 ) };
+    ///
+    ///     arena.mark();
+    ///     uint16_t* table{ (uint16_t*) arena.allocate( msg.count * 2, 2 ) };
+    ///     ...
+    ///     arena.rewind();                             // table is gone, header isn't
+    ///     ...
+    ///     arena.reset();                              // everything is gone
+    /// }
+    /// @endcode
+    class Arena {
+    public:
+        Arena( const uint16_t numBytes );
+        explicit operator bool() const;
+
+        void* allocate( const uint16_t numBytes, const uint8_t alignment = 1 );
+        void reset();
+
+        bool mark();
+        void rewind();
+
+        uint16_t getUsedBytes() const;
+        uint16_t getCapacity() const;
+
+        #include "arena_private.h"
+    };
+
+}    // namespace zero
+
+
+#endif
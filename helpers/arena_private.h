@@ -0,0 +1,23 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+public:
+    /// @privatesection
+    ~Arena();
+
+private:
+    Arena( const Arena& a ) = delete;
+    void operator=( const Arena& a ) = delete;
+
+    // before _chunk, which is initialized by allocating it, and sets this
+    uint16_t _chunkBytes;
+    uint8_t* const _chunk;
+    uint16_t _usedBytes{ 0 };
+
+    // where the innermost mark is stored in the chunk, or NO_MARK
+    uint16_t _markOffset;
@@ -7,12 +7,27 @@
 
 
 #include "gpio.h"
+#include "spibus.h"
+#include "suart.h"
 #include "thread.h"
+#include "twi.h"
 
 
 #ifdef ZERO_DRIVERS_GPIO
     template class List<Gpio>;
 #endif
 
+#ifdef ZERO_DRIVERS_SPI
+    template class List<SpiTransfer>;
+#endif
+
+#ifdef ZERO_DRIVERS_SUART
+    template class List<SuartTx>;
+#endif
+
+#ifdef ZERO_DRIVERS_TWI
+    template class List<TwiDevice>;
+#endif
+
 template class List<Thread>;
 template class OffsetList<Thread>;
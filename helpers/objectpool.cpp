@@ -0,0 +1,67 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#include <stdint.h>
+
+#include <util/atomic.h>
+
+#include "objectpool.h"
+
+
+using namespace zero;
+
+
+/// @brief Gets the number of slots currently handed out
+uint8_t ObjectPoolBase::getUsedCount() const
+{
+    return _numUsed;
+}
+
+
+/// @brief Gets the most slots that have been handed out at once
+/// @details Handy for sizing the pool - a peak at the capacity means some objects
+/// probably had to come from the heap instead.
+uint8_t ObjectPoolBase::getPeakCount() const
+{
+    return _peakUsed;
+}
+
+
+// Takes a given-back slot if there is one, otherwise the next never-used slot
+void* ObjectPoolBase::allocate( uint8_t* const slots, const uint16_t slotBytes, const uint8_t numSlots )
+{
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        void* rc{ _freeList };
+
+        if ( rc ) {
+            _freeList = *(void**) rc;
+        }
+        else if ( _numTouched < numSlots ) {
+            rc = slots + _numTouched++ * slotBytes;
+        }
+
+        if ( rc and ++_numUsed > _peakUsed ) {
+            _peakUsed = _numUsed;
+        }
+
+        return rc;
+    }
+}
+
+
+// Puts a slot at the head of the free list
+void ObjectPoolBase::free( void* const p )
+{
+    if ( !p ) return;
+
+    ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+        *(void**) p = _freeList;
+        _freeList = p;
+        _numUsed--;
+    }
+}
@@ -0,0 +1,148 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+#ifndef TCRI_ZERO_OBJECTPOOL_H
+#define TCRI_ZERO_OBJECTPOOL_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memory.h"
+
+
+namespace zero {
+
+    /// @private
+    /// @brief The type-independent workings of ObjectPool
+    class ObjectPoolBase {
+    public:
+        uint8_t getUsedCount() const;                   // Slots handed out right now
+        uint8_t getPeakCount() const;                   // Most slots ever handed out at once
+
+    protected:
+        void* allocate( uint8_t* const slots, const uint16_t slotBytes, const uint8_t numSlots );
+        void free( void* const p );
+
+    private:
+        void* _freeList{ nullptr };                     // slots given back, linked through their first bytes
+        uint8_t _numTouched{ 0 };                       // slots handed out at least once
+        uint8_t _numUsed{ 0 };
+        uint8_t _peakUsed{ 0 };
+    };
+
+
+    /// @brief A fixed number of same-sized slots for objects of one class
+    /// @details The slots live in the pool itself, so a pool declared as a global
+    /// costs exactly `N` objects' worth of SRAM, rather than a whole number of heap
+    /// pages per object. Slots are taken and given back in O(1), and never fragment
+    /// the heap. A freshly zeroed pool is ready to use, so pools work even in code
+    /// that runs before the C++ constructors. It's also safe to use from an ISR.
+    /// @tparam T The class of object the slots are for.
+    /// @tparam N The number of slots.
+    /// @par Example
+    /// @code
+    /// class Packet {
+    /// public:
+    ///     ZERO_POOLED( Packet, 8 )
+    ///
+    ///     uint8_t payload[ 20 ];
+    /// };
+    ///
+    /// int packetDemo()
+    /// {
+    ///     Packet* p{ new Packet };                    // comes from the pool
+    ///     delete p;                                   // goes back to the pool
+    /// }
+    /// @endcode
+    template <class T, uint8_t N>
+    class ObjectPool : public ObjectPoolBase {
+    public:
+        /// @brief Takes a slot from the pool
+        /// @returns A pointer to uninitialised memory for one T, or `nullptr` if the
+        /// pool is empty.
+        void* allocate()
+        {
+            return ObjectPoolBase::allocate( _slots, SLOT_BYTES, N );
+        }
+
+        /// @brief Gives a slot back to the pool
+        /// @param p A pointer returned by allocate().
+        void free( void* const p )
+        {
+            ObjectPoolBase::free( p );
+        }
+
+        /// @brief Determines if a pointer is one of the pool's slots
+        bool owns( const void* const p ) const
+        {
+            const uint8_t* const b{ (const uint8_t*) p };
+
+            return b >= _slots and b < _slots + sizeof( _slots );
+        }
+
+        /// @brief Gets the number of slots in the pool
+        uint8_t getCapacity() const
+        {
+            return N;
+        }
+
+        /// @private
+        // the two halves of a pool-backed operator new/delete
+        void* newObject( const size_t size )
+        {
+            void* const rc{ ( size == sizeof( T ) ) ? allocate() : nullptr };
+
+            return rc ? rc : memory::allocate( size );
+        }
+
+        /// @private
+        void deleteObject( void* const p, const size_t size )
+        {
+            if ( owns( p ) ) {
+                free( p );
+            }
+            else {
+                memory::free( p, size );
+            }
+        }
+
+    private:
+        static_assert( N > 0, "An ObjectPool needs at least one (1) slot" );
+
+        // a free slot holds the free list link
+        static constexpr uint16_t SLOT_BYTES{ sizeof( T ) < sizeof( void* ) ? sizeof( void* ) : sizeof( T ) };
+
+        uint8_t _slots[ N * SLOT_BYTES ]{};
+    };
+
+}    // namespace zero
+
+
+/// @brief Gives a class its own `new` and `delete`, backed by an ObjectPool of N objects
+/// @details Put it in the public part of the class declaration. When the pool is empty,
+/// or for a derived class of a different size, objects come from the heap as usual.
+#define ZERO_POOLED( T, N )                                                             \
+    static zero::ObjectPool<T, N>& getObjectPool()                                      \
+    {                                                                                   \
+        static zero::ObjectPool<T, N> pool;                                             \
+        return pool;                                                                    \
+    }                                                                                   \
+                                                                                        \
+    static void* operator new( size_t size )                                            \
+    {                                                                                   \
+        return getObjectPool().newObject( size );                                       \
+    }                                                                                   \
+                                                                                        \
+    static void operator delete( void* p, size_t size )                                 \
+    {                                                                                   \
+        getObjectPool().deleteObject( p, size );                                        \
+    }
+
+
+#endif
@@ -8,6 +8,7 @@
 
 #include <string.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 
 #include "pagemanager.h"
 #include "util.h"
@@ -47,7 +48,11 @@ bool PageManager<PAGE_COUNT>::isPageAvailable( const uint16_t pageNumber ) const
 template <uint16_t PAGE_COUNT>
 void PageManager<PAGE_COUNT>::markAsFree( const uint16_t pageNumber )
 {
-    MARK_AS_FREE( pageNumber );
+    if ( !IS_PAGE_AVAIL( pageNumber ) ) {
+        MARK_AS_FREE( pageNumber );
+        _freePages++;
+        _largestFreeRunValid = false;
+    }
 }
 
 
@@ -57,7 +62,11 @@ void PageManager<PAGE_COUNT>::markAsFree( const uint16_t pageNumber )
 template <uint16_t PAGE_COUNT>
 void PageManager<PAGE_COUNT>::markAsUsed( const uint16_t pageNumber )
 {
-    MARK_AS_USED( pageNumber );
+    if ( IS_PAGE_AVAIL( pageNumber ) ) {
+        MARK_AS_USED( pageNumber );
+        _freePages--;
+        _largestFreeRunValid = false;
+    }
 }
 
 
@@ -73,19 +82,12 @@ uint16_t PageManager<PAGE_COUNT>::getTotalPageCount() const
 
 /// @brief Gets the number of currently available pages
 /// @returns The number of free pages.
+/// @note The count is kept up to date as pages are marked, so this is O(1).
 /// @see getTotalPageCount(), getUsedPageCount()
 template <uint16_t PAGE_COUNT>
 uint16_t PageManager<PAGE_COUNT>::getFreePageCount() const
 {
-    uint16_t rc{ 0 };
-
-    for ( uint16_t i = 0; i < getTotalPageCount(); i++ ) {
-        if ( isPageAvailable( i ) ) {
-            rc++;
-        }
-    }
-
-    return rc;
+    return _freePages;
 }
 
 
@@ -99,36 +101,77 @@ uint16_t PageManager<PAGE_COUNT>::getUsedPageCount() const
 }
 
 
-// search strategy function prototypes
-static uint16_t getPageForSearchStep_TopDown( const uint16_t step, const uint16_t totalPages );
-static uint16_t getPageForSearchStep_BottomUp( const uint16_t step, const uint16_t totalPages );
+namespace {
 
+    // For each nibble value, the number of free (zero) bits counting up from bit 0 (low
+    // half of the entry), and counting down from bit 3 (high half of the entry)
+    const uint8_t _nibbleEnds[ 16 ] PROGMEM = {
+        0x44, 0x30, 0x21, 0x20, 0x12, 0x10, 0x11, 0x10,
+        0x03, 0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00,
+    };
 
-// search strategy - BottomUp starts searching the allocation table at the bottom and works up
-static uint16_t getPageForSearchStep_BottomUp(
-    const uint16_t step,
-    const uint16_t )
-{
-    return step;
-}
+    // For each nibble value, the longest run of free (zero) bits anywhere in it
+    const uint8_t _nibbleLongest[ 16 ] PROGMEM = {
+        4, 3, 2, 2, 2, 1, 1, 1, 3, 2, 1, 1, 2, 1, 1, 0,
+    };
 
 
-// search strategy - TopDown starts searching the allocation table at the top and works down
-static uint16_t getPageForSearchStep_TopDown(
-    const uint16_t step,
-    const uint16_t totalPages )
-{
-    return totalPages - ( step + 1 );
-}
+    // Free pages at the bottom (bit 0) end of a bitmap byte
+    uint8_t getLowFree( const uint8_t b )
+    {
+        const uint8_t lo{ (uint8_t) ( pgm_read_byte( &_nibbleEnds[ b & 0x0F ] ) & 0x0F ) };
 
+        return ( lo == 4 ) ? 4 + ( pgm_read_byte( &_nibbleEnds[ b >> 4 ] ) & 0x0F ) : lo;
+    }
 
-namespace {
-    // set up the vector table for the search strategies
-    uint16_t ( *_strategies[] )( const uint16_t, const uint16_t ) = {
-        getPageForSearchStep_TopDown,
-        getPageForSearchStep_BottomUp,
-    };
-}
+
+    // Free pages at the top (bit 7) end of a bitmap byte
+    uint8_t getHighFree( const uint8_t b )
+    {
+        const uint8_t hi{ (uint8_t) ( pgm_read_byte( &_nibbleEnds[ b >> 4 ] ) >> 4 ) };
+
+        return ( hi == 4 ) ? 4 + ( pgm_read_byte( &_nibbleEnds[ b & 0x0F ] ) >> 4 ) : hi;
+    }
+
+
+    // The longest run of free pages anywhere in a bitmap byte
+    uint8_t getLongestFree( const uint8_t b )
+    {
+        const uint8_t across{ (uint8_t) (
+            ( pgm_read_byte( &_nibbleEnds[ b & 0x0F ] ) >> 4 ) +
+            ( pgm_read_byte( &_nibbleEnds[ b >> 4 ] ) & 0x0F ) ) };
+
+        const uint8_t inLo{ pgm_read_byte( &_nibbleLongest[ b & 0x0F ] ) };
+        const uint8_t inHi{ pgm_read_byte( &_nibbleLongest[ b >> 4 ] ) };
+
+        return MAX( across, MAX( inLo, inHi ) );
+    }
+
+
+    // Finds the first run of numPages free pages lying wholly inside one bitmap
+    // byte, searching in the direction of the strategy
+    template <memory::SearchStrategy STRATEGY>
+    uint16_t findInByte( const uint8_t b, const uint16_t firstPage, const uint8_t numPages )
+    {
+        constexpr bool BOTTOM_UP{ STRATEGY == memory::SearchStrategy::BottomUp };
+        uint8_t count{ 0 };
+
+        for ( uint8_t i = 0; i < 8; i++ ) {
+            const uint8_t bit{ (uint8_t) ( BOTTOM_UP ? i : 7 - i ) };
+
+            if ( b & ( 1 << bit ) ) {
+                count = 0;
+            }
+            else if ( ++count == numPages ) {
+                return BOTTOM_UP ? firstPage + bit - ( numPages - 1 ) : firstPage + bit;
+            }
+        }
+
+        // not reached - the caller checked there was a run
+        return firstPage;
+    }
+
+}    // namespace
 
 
 // This is the main workhorse for the memory allocator. Using only the search strategy supplied,
@@ -138,43 +181,111 @@ int16_t PageManager<PAGE_COUNT>::findFreePages(
     const uint16_t numPagesRequired,
     const memory::SearchStrategy strat ) const
 {
-    uint16_t startPage{ (uint16_t) -1 };
-    uint16_t pageCount{ 0 };
+    if ( strat == memory::SearchStrategy::TopDown ) {
+        return scan<memory::SearchStrategy::TopDown>( numPagesRequired );
+    }
 
-    for ( uint16_t curStep = 0; curStep < PAGE_COUNT; curStep++ ) {
-        const uint16_t curPage{ _strategies[ (int) strat ]( curStep, PAGE_COUNT ) };
+    return scan<memory::SearchStrategy::BottomUp>( numPagesRequired );
+}
 
-        // If that page was free..
-        if ( isPageAvailable( curPage ) ) {
-            pageCount++;
 
-            // if we didn't have a startPage, we do now
-            if ( startPage == (uint16_t) -1 ) {
-                startPage = curPage;
-            }
+// Walks the bitmap a byte at a time in the strategy's direction, carrying the length of
+// the free run that reaches the edge of the last byte. Fully used bytes are skipped with
+// one compare, fully free ones add eight pages, and mixed ones are sized up with the
+// nibble tables. Returns the lowest page of the first run found, or -1.
+template <uint16_t PAGE_COUNT>
+template <memory::SearchStrategy STRATEGY>
+int16_t PageManager<PAGE_COUNT>::scan( const uint16_t numPagesRequired ) const
+{
+    constexpr bool BOTTOM_UP{ STRATEGY == memory::SearchStrategy::BottomUp };
+    constexpr uint16_t NUM_BYTES{ sizeof( _memoryMap ) };
 
-            // if we've found the right number of pages, stop looking
-            if ( pageCount == numPagesRequired ) {
-                // MIN in case we searched backwards
-                startPage = MIN( startPage, curPage );
-                break;
-            }
+    // the bits in the last byte beyond the last page never count as free
+    constexpr uint8_t TAIL_MASK{ ( PAGE_COUNT % 8 ) ? (uint8_t) ( 0xFF << ( PAGE_COUNT % 8 ) ) : (uint8_t) 0 };
+
+    uint16_t run{ 0 };
+
+    for ( uint16_t step = 0; step < NUM_BYTES; step++ ) {
+        const uint16_t byteNum{ BOTTOM_UP ? step : (uint16_t) ( NUM_BYTES - ( step + 1 ) ) };
+        const uint16_t firstPage{ (uint16_t) ( byteNum * 8 ) };
+        uint8_t b{ _memoryMap[ byteNum ] };
+
+        if ( byteNum == NUM_BYTES - 1 ) {
+            b |= TAIL_MASK;
+        }
+
+        // fully used - the run is broken
+        if ( b == 0xFF ) {
+            run = 0;
+            continue;
+        }
+
+        // the free pages at the edge of the byte that the search comes in through
+        // join up with the run carried over from the bytes before
+        const uint8_t entering{ ( b == 0x00 ) ? (uint8_t) 8 : ( BOTTOM_UP ? getLowFree( b ) : getHighFree( b ) ) };
+
+        if ( run + entering >= numPagesRequired ) {
+            return BOTTOM_UP ? firstPage - run : firstPage + 8 + run - numPagesRequired;
+        }
+
+        if ( b == 0x00 ) {
+            run += 8;
+            continue;
         }
-        else {
-            // wasn't free? start the search from scratch
-            startPage = (uint16_t) -1;
-            pageCount = 0;
+
+        // a small request might fit in a gap in the middle of the byte
+        if ( numPagesRequired < 8 and getLongestFree( b ) >= numPagesRequired ) {
+            return findInByte<STRATEGY>( b, firstPage, numPagesRequired );
         }
+
+        // only the pages at the far edge carry on to the next byte
+        run = BOTTOM_UP ? getHighFree( b ) : getLowFree( b );
     }
 
-    // if we couldn't find right number of pages
-    if ( pageCount < numPagesRequired ) {
-        return -1;
+    return -1;
+}
+
+
+/// @brief Gets the length of the longest run of contiguous free pages
+/// @returns The number of pages in the biggest block that could be allocated right now.
+/// @note The bitmap is scanned a byte at a time when the map has changed since the last
+/// call, otherwise the previous answer is returned straight away.
+/// @see getFreePageCount()
+template <uint16_t PAGE_COUNT>
+uint16_t PageManager<PAGE_COUNT>::getLargestFreeRun() const
+{
+    constexpr uint16_t NUM_BYTES{ sizeof( _memoryMap ) };
+    constexpr uint8_t TAIL_MASK{ ( PAGE_COUNT % 8 ) ? (uint8_t) ( 0xFF << ( PAGE_COUNT % 8 ) ) : (uint8_t) 0 };
+
+    if ( _largestFreeRunValid ) {
+        return _largestFreeRun;
     }
 
-    // if we get here, then we were successful at
-    // finding what the caller wanted
-    return startPage;
+    uint16_t largest{ 0 };
+    uint16_t run{ 0 };
+
+    for ( uint16_t byteNum = 0; byteNum < NUM_BYTES; byteNum++ ) {
+        uint8_t b{ _memoryMap[ byteNum ] };
+
+        if ( byteNum == NUM_BYTES - 1 ) {
+            b |= TAIL_MASK;
+        }
+
+        if ( b == 0x00 ) {
+            run += 8;
+            continue;
+        }
+
+        // the run so far ends in this byte, or just before it
+        largest = MAX( largest, run + getLowFree( b ) );
+        largest = MAX( largest, getLongestFree( b ) );
+        run = getHighFree( b );
+    }
+
+    _largestFreeRun = MAX( largest, run );
+    _largestFreeRunValid = true;
+
+    return _largestFreeRun;
 }
 
 
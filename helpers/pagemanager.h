@@ -19,6 +19,10 @@
 
 const uint16_t SRAM_PAGES{ DYNAMIC_BYTES / PAGE_BYTES };
 
+#ifdef ZERO_DRIVERS_FARHEAP
+    const uint16_t FAR_PAGES{ FAR_HEAP_BYTES / FAR_PAGE_BYTES };
+#endif
+
 
 namespace zero {
 
@@ -50,6 +54,7 @@ namespace zero {
         uint16_t getTotalPageCount() const;
         uint16_t getUsedPageCount() const;
         uint16_t getFreePageCount() const;
+        uint16_t getLargestFreeRun() const;
 
         #include "pagemanager_private.h"
     };
@@ -10,5 +10,10 @@ namespace zero {
 
     template class PageManager<SRAM_PAGES>;
 
+    // when the far heap has as many pages as SRAM, that's the class just above
+    #if defined( ZERO_DRIVERS_FARHEAP ) and ( FAR_HEAP_BYTES / FAR_PAGE_BYTES ) != ( DYNAMIC_BYTES / PAGE_BYTES )
+        template class PageManager<FAR_PAGES>;
+    #endif
+
 }
 
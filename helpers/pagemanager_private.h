@@ -14,4 +14,12 @@ public:
         const memory::SearchStrategy strat ) const;
 
 private:
-    uint8_t _memoryMap[ ROUND_UP( PAGE_COUNT, 8 ) / 8 ];
+    template <memory::SearchStrategy STRATEGY>
+    int16_t scan( const uint16_t numPagesRequired ) const;
+
+    uint8_t _memoryMap[ ROUND_UP( PAGE_COUNT, 8 ) / 8 ]{};
+    uint16_t _freePages{ PAGE_COUNT };
+
+    // the longest free run is worked out on demand, and kept until the map changes
+    mutable uint16_t _largestFreeRun{ PAGE_COUNT };
+    mutable bool _largestFreeRunValid{ true };
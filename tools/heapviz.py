@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+#
+# zero - pre-emptive multitasking kernel for AVR
+#
+# Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+# Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+#
+
+"""Replays a zero heap trace and shows how the heap was used.
+
+Build with HEAP_TRACE = 1, drain the records with memory::readTrace() and send
+them, raw, to the host. Then:
+
+    tools/heapviz.py trace.bin --page-bytes 16 --elf zero.elf
+
+prints the heap's occupancy after each operation (one character per page,
+a letter per Thread, '.' for free), then the blocks that were never freed,
+and the blocks that most often sat between two free runs at the heap's most
+fragmented moment. Callers are shown as byte addresses, resolved to
+file:line with avr-addr2line if --elf is given.
+"""
+
+import argparse
+import collections
+import shutil
+import struct
+import subprocess
+import sys
+
+
+RECORD = struct.Struct( "<BBBHHH" )
+OPS = { 1: "alloc", 2: "free", 3: "claim", 4: "FAIL" }
+NO_THREAD = 0xFF
+
+
+Record = collections.namedtuple( "Record", "op seq thread address size caller" )
+
+
+def read_records( path ):
+    with open( path, "rb" ) as f:
+        data = f.read()
+
+    if len( data ) % RECORD.size:
+        print( f"warning: {len( data ) % RECORD.size} trailing bytes ignored", file=sys.stderr )
+
+    records = []
+    expected = None
+
+    for offset in range( 0, len( data ) - RECORD.size + 1, RECORD.size ):
+        rec = Record( *RECORD.unpack_from( data, offset ) )
+
+        if rec.op not in OPS:
+            sys.exit( f"bad record at byte {offset} - is the stream aligned?" )
+
+        if expected is not None and rec.seq != expected:
+            print( f"warning: {( rec.seq - expected ) & 0xFF} record(s) lost before #{len( records )}", file=sys.stderr )
+
+        expected = ( rec.seq + 1 ) & 0xFF
+        records.append( rec )
+
+    return records
+
+
+class Resolver:
+    """Turns caller word addresses into something readable."""
+
+    def __init__( self, elf ):
+        self.elf = elf
+        self.cache = {}
+        self.tool = shutil.which( "avr-addr2line" ) if elf else None
+
+    def __call__( self, caller ):
+        byteAddr = caller * 2
+
+        if byteAddr not in self.cache:
+            name = f"0x{byteAddr:05x}"
+
+            if self.tool:
+                out = subprocess.run(
+                    [ self.tool, "-f", "-C", "-s", "-e", self.elf, hex( byteAddr ) ],
+                    capture_output=True, text=True ).stdout.split( "\n" )
+
+                if len( out ) >= 2 and not out[ 0 ].startswith( "??" ):
+                    name += f" {out[ 0 ]} ({out[ 1 ]})"
+
+            self.cache[ byteAddr ] = name
+
+        return self.cache[ byteAddr ]
+
+
+def thread_char( thread ):
+    if thread == NO_THREAD:
+        return "#"
+
+    return chr( ord( "A" ) + thread % 26 )
+
+
+def free_runs( cells ):
+    """Yields ( start, length ) for each run of free cells."""
+    start = None
+
+    for i, c in enumerate( cells + [ "x" ] ):
+        if c == "." and start is None:
+            start = i
+        elif c != "." and start is not None:
+            yield start, i - start
+            start = None
+
+
+def main():
+    parser = argparse.ArgumentParser( description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter )
+    parser.add_argument( "trace", help="file of raw TraceRecords" )
+    parser.add_argument( "--page-bytes", type=int, default=16, help="bytes per character (PAGE_BYTES)" )
+    parser.add_argument( "--base", type=lambda v: int( v, 0 ), help="heap start address (default: lowest seen)" )
+    parser.add_argument( "--heap-bytes", type=int, help="heap size (default: up to the highest address seen)" )
+    parser.add_argument( "--elf", help="firmware image, for naming callers" )
+    parser.add_argument( "--quiet", action="store_true", help="skip the occupancy timeline" )
+    args = parser.parse_args()
+
+    records = read_records( args.trace )
+
+    if not records:
+        sys.exit( "no records" )
+
+    resolve = Resolver( args.elf )
+    used = [ r for r in records if r.op != 4 ]
+    base = args.base if args.base is not None else min( r.address for r in used )
+    end = base + args.heap_bytes if args.heap_bytes else max( r.address + r.size for r in used )
+    numCells = ( end - base + args.page_bytes - 1 ) // args.page_bytes
+
+    cells = [ "." ] * numCells
+    live = {}                                           # address -> record that allocated it
+    worst = ( -1, None, None )                          # ( fragmentation, index, live blocks )
+    failures = collections.Counter()
+
+    def paint( address, size, c ):
+        first = ( address - base ) // args.page_bytes
+        last = ( address - base + size - 1 ) // args.page_bytes
+
+        for i in range( max( first, 0 ), min( last + 1, numCells ) ):
+            cells[ i ] = c
+
+    for n, rec in enumerate( records ):
+        if rec.op in ( 1, 3 ):
+            live[ rec.address ] = rec
+            paint( rec.address, rec.size, thread_char( rec.thread ) )
+        elif rec.op == 2:
+            if live.pop( rec.address, None ) is None:
+                print( f"warning: #{n} frees 0x{rec.address:04x}, which isn't allocated", file=sys.stderr )
+
+            paint( rec.address, rec.size, "." )
+
+        runs = list( free_runs( cells ) )
+        freeCells = sum( length for _, length in runs )
+        largest = max( ( length for _, length in runs ), default=0 )
+        frag = 100 - ( 100 * largest ) // freeCells if freeCells else 0
+
+        if rec.op == 4:
+            # failed even though there was enough free memory in total
+            if freeCells * args.page_bytes >= rec.size:
+                failures[ ( rec.thread, rec.caller ) ] += 1
+
+        if frag > worst[ 0 ]:
+            worst = ( frag, n, dict( live ) )
+
+        if not args.quiet:
+            what = f"{OPS[ rec.op ]:5} {thread_char( rec.thread )} 0x{rec.address:04x} {rec.size:5}"
+            print( f"{n:6} {''.join( cells )} {what} free {freeCells * args.page_bytes:5} frag {frag:3}%" )
+
+    print()
+    print( f"{len( records )} records, heap 0x{base:04x}-0x{end:04x}, {args.page_bytes} bytes per character" )
+
+    # leaks - everything still allocated at the end
+    leaks = collections.defaultdict( list )
+
+    for rec in live.values():
+        leaks[ ( rec.thread, rec.caller ) ].append( rec )
+
+    print()
+    print( "Still allocated at the end of the trace:" if leaks else "Nothing left allocated." )
+
+    for ( thread, caller ), recs in sorted( leaks.items(), key=lambda kv: -sum( r.size for r in kv[ 1 ] ) ):
+        print( f"  {sum( r.size for r in recs ):6} bytes in {len( recs ):3} block(s), thread {thread_char( thread )}, from {resolve( caller )}" )
+
+    # fragmentation hot spots - the blocks walling off free runs at the worst moment
+    frag, n, blocks = worst
+
+    if frag > 0:
+        cells[ : ] = [ "." ] * numCells
+
+        for rec in blocks.values():
+            paint( rec.address, rec.size, "x" )
+
+        walls = collections.Counter()
+
+        for rec in blocks.values():
+            first = ( rec.address - base ) // args.page_bytes
+            last = ( rec.address - base + rec.size - 1 ) // args.page_bytes
+
+            if 0 < first and last + 1 < numCells and cells[ first - 1 ] == "." and cells[ last + 1 ] == ".":
+                walls[ ( rec.thread, rec.caller ) ] += 1
+
+        print()
+        print( f"Most fragmented after record #{n} ({frag}%). Blocks with free memory both sides:" )
+
+        for ( thread, caller ), count in walls.most_common( 10 ):
+            print( f"  {count:3} block(s), thread {thread_char( thread )}, from {resolve( caller )}" )
+
+    if failures:
+        print()
+        print( "Allocations that failed for want of a big enough free run:" )
+
+        for ( thread, caller ), count in failures.most_common( 10 ):
+            print( f"  {count:3} time(s), thread {thread_char( thread )}, from {resolve( caller )}" )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,105 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Checks heap accounting when one Thread resizes another's block. Built with
+// HEAP_ACCOUNTING on. The block's owner pays for it however it's resized, and
+// whether it grows in place or has to move, never the Thread doing the resizing.
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/pgmspace.h>
+
+#include "memory.h"
+#include "thread.h"
+#include "kernel.h"
+
+
+using namespace zero;
+using namespace zero::memory;
+
+
+namespace {
+
+    uint16_t _numChecks{ 0 };
+
+
+    void check( const bool ok, const char* const what )
+    {
+        _numChecks++;
+
+        if ( !ok ) {
+            printf( "accounts: FAILED: %s\n", what );
+            exit( 1 );
+        }
+    }
+
+
+    int unused()
+    {
+        return 0;
+    }
+
+}    // namespace
+
+
+int main()
+{
+    Thread owner{ PSTR( "owner" ), 0, unused };
+    Thread other{ PSTR( "other" ), 0, unused };
+    uint16_t ownerBytes;
+
+    // the owner's block, with a block of nobody's hard up against it
+    setCurrentThread( &owner );
+    uint8_t* const block{ (uint8_t*) memory::allocate( 40, &ownerBytes ) };
+
+    setCurrentThread( nullptr );
+    void* const wall{ memory::allocate( 16 ) };
+
+    check( block and wall, "allocated" );
+    check( getThreadBytes( owner ) == ownerBytes, "the owner is charged" );
+
+    memset( block, 0x5A, ownerBytes );
+
+    // too little quota for the other Thread to hold the block itself
+    setCurrentThread( &other );
+    check( setThreadQuota( other, 32 ), "quota set" );
+    check( !memory::allocate( DYNAMIC_BYTES / 4 ), "the other Thread's quota bites" );
+
+    // it has to move to grow, and the owner still pays
+    uint16_t movedBytes;
+    uint8_t* const moved{ (uint8_t*) memory::reallocate( block, DYNAMIC_BYTES / 4, &movedBytes ) };
+
+    check( moved, "a move isn't held to the resizer's quota" );
+    check( moved != block, "the block moved" );
+    check( moved[ 0 ] == 0x5A and moved[ ownerBytes - 1 ] == 0x5A, "the contents moved with it" );
+    check( getThreadBytes( owner ) == movedBytes, "the owner pays for the moved block" );
+    check( getThreadBytes( other ) == 0, "the resizer pays nothing for a move" );
+
+    // shrinking in place refunds the owner
+    uint16_t shrunkBytes;
+    uint8_t* const shrunk{ (uint8_t*) memory::reallocate( moved, 20, &shrunkBytes ) };
+
+    check( shrunk == moved, "shrank in place" );
+    check( getThreadBytes( owner ) == shrunkBytes, "the owner is refunded when it shrinks" );
+    check( getThreadBytes( other ) == 0, "the resizer is refunded nothing" );
+
+    // and freeing it from anywhere pays the owner back
+    memory::free( shrunk );
+    check( getThreadBytes( owner ) == 0, "the owner is paid back" );
+
+    setCurrentThread( nullptr );
+    memory::free( wall );
+
+    printf( "accounts: %u checks passed\n", _numChecks );
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Checks Arena against the real heap: a fresh Arena has its whole chunk to hand out,
+// alignment, marks and resets behave, and the chunk goes back to the heap afterwards.
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "memory.h"
+
+
+using namespace zero;
+
+
+namespace {
+
+    uint16_t _numChecks{ 0 };
+
+
+    void check( const bool ok, const char* const what )
+    {
+        _numChecks++;
+
+        if ( !ok ) {
+            printf( "arena: FAILED: %s\n", what );
+            exit( 1 );
+        }
+    }
+
+}    // namespace
+
+
+int main()
+{
+    const uint16_t freeAtStart{ memory::getFreeBytes() };
+
+    {
+        Arena arena( 100 );
+
+        check( (bool) arena, "fresh Arena has a chunk" );
+        check( arena.getCapacity() >= 100, "fresh Arena holds at least what was asked for" );
+        check( arena.getUsedBytes() == 0, "fresh Arena is empty" );
+        check( memory::getFreeBytes() <= freeAtStart - arena.getCapacity(), "chunk came from the heap" );
+
+        uint8_t* const a{ (uint8_t*) arena.allocate( 3 ) };
+        check( a, "allocate from a fresh Arena" );
+        check( arena.getUsedBytes() == 3, "used bytes count the allocation" );
+
+        uint8_t* const b{ (uint8_t*) arena.allocate( 8, 8 ) };
+        check( b and ( (uintptr_t) b & 7 ) == 0, "aligned allocate" );
+        check( b >= a + 3, "allocations don't overlap" );
+
+        const uint16_t beforeMark{ arena.getUsedBytes() };
+        check( arena.mark(), "mark" );
+
+        uint8_t* const c{ (uint8_t*) arena.allocate( 10 ) };
+        check( c, "allocate after mark" );
+        check( arena.mark(), "nested mark" );
+        check( arena.allocate( 5 ), "allocate after nested mark" );
+
+        arena.rewind();
+        check( arena.allocate( 1 ) == c + 10, "rewind frees only the inner scope" );
+
+        arena.rewind();
+        check( arena.getUsedBytes() == beforeMark, "rewind back to the outer mark" );
+
+        arena.rewind();
+        check( arena.getUsedBytes() == beforeMark, "rewind with no mark does nothing" );
+
+        check( !arena.allocate( arena.getCapacity() ), "allocate more than is left fails" );
+        check( arena.allocate( arena.getCapacity() - arena.getUsedBytes() ), "allocate exactly what is left" );
+        check( !arena.allocate( 1 ), "full Arena refuses more" );
+        check( !arena.mark(), "full Arena refuses a mark" );
+
+        arena.reset();
+        check( arena.getUsedBytes() == 0, "reset empties the Arena" );
+        check( arena.allocate( 1 ) == a, "reset starts again from the beginning" );
+    }
+
+    check( memory::getFreeBytes() == freeAtStart, "destroyed Arena gives its chunk back" );
+
+    {
+        Arena tooBig( DYNAMIC_BYTES + 1 );
+
+        check( !tooBig, "Arena bigger than the heap fails" );
+        check( tooBig.getCapacity() == 0, "failed Arena has no capacity" );
+        check( !tooBig.allocate( 1 ), "failed Arena hands nothing out" );
+    }
+
+    check( memory::getFreeBytes() == freeAtStart, "failed Arena takes nothing from the heap" );
+
+    printf( "arena: %u checks passed\n", _numChecks );
+
+    return 0;
+}
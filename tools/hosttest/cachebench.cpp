@@ -0,0 +1,270 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Benchmarks SpiMemoryCache for random small reads and writes, against going straight
+// to the SpiMemory.
+//
+// The SpiMemory here is a stand-in that keeps the chip's contents in host memory and
+// counts the transfers and bytes that would cross the SPI bus. Those counts are exact.
+// Turning them into throughput takes a timing model, given on the command line:
+//
+//    cachebench [seed] [accesses] [us per transfer] [us per bus byte] [us per cache access]
+//
+// The defaults are a 4 MHz bus (2 us a byte), 20 us of fixed cost per transfer for
+// chip select, queueing, the ISR chain and waking the Thread, and 4 us to look up a
+// line and copy a few bytes in local SRAM. Every read is also checked against a copy
+// of what was written, so a broken cache fails loudly.
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+namespace zero {
+
+    // Stand-in for the SpiMemory in sram.h, which is kept out below
+    class SpiMemory {
+    public:
+        static const uint32_t CHIP_BYTES{ 128 * 1024UL };
+        static const uint8_t HEADER_BYTES{ 4 };         // command and three (3) address bytes
+
+        explicit operator bool() const
+        {
+            return true;
+        }
+
+        void read( void* dest, const uint32_t srcAddr, const uint32_t numBytes )
+        {
+            memcpy( dest, &chip[ srcAddr ], numBytes );
+            count( numBytes );
+        }
+
+        void write( const void* src, const uint32_t destAddr, const uint32_t numBytes )
+        {
+            memcpy( &chip[ destAddr ], src, numBytes );
+            count( numBytes );
+        }
+
+        void waitUntilIdle()
+        {
+            // transfers finish straight away
+        }
+
+        void count( const uint32_t numBytes )
+        {
+            transfers++;
+            busBytes += HEADER_BYTES + numBytes;
+        }
+
+        uint8_t chip[ CHIP_BYTES ];
+        uint32_t transfers;
+        uint32_t busBytes;
+    };
+
+}    // namespace zero
+
+
+// the real SpiMemory needs the SPI hardware
+#define TCRI_ZERO_SRAM_H
+
+#include "spicache.cpp"
+
+
+namespace {
+
+    // how addresses are picked
+    struct Pattern {
+        const char* name;
+        uint32_t windowBytes;                           // accesses land in a window this big...
+        uint32_t windowMoves;                           // ... that moves this often, in accesses
+    };
+
+    const Pattern PATTERNS[]{
+        { "random, whole chip", SpiMemory::CHIP_BYTES, 0 },
+        { "random, 4KB window", 4096, 0 },
+        { "random, 512B window", 512, 0 },
+        { "logging, 256B window moving", 256, 64 },
+    };
+
+    struct Config {
+        uint8_t numLines;
+        uint16_t lineBytes;
+    };
+
+    const Config CONFIGS[]{
+        { 2, 16 },
+        { 4, 32 },
+        { 8, 32 },
+        { 4, 64 },
+    };
+
+    SpiMemory _mem;
+    uint8_t _shadow[ SpiMemory::CHIP_BYTES ];
+    uint32_t _random;
+
+    double _transferUs{ 20.0 };
+    double _byteUs{ 2.0 };
+    double _hitUs{ 4.0 };
+
+
+    // xorshift, so a seed means the same thing on every host
+    uint32_t getRandom( const uint32_t limit )
+    {
+        _random ^= _random << 13;
+        _random ^= _random >> 17;
+        _random ^= _random << 5;
+
+        return _random % limit;
+    }
+
+
+    struct Result {
+        uint32_t appBytes;
+        uint32_t transfers;
+        uint32_t busBytes;
+        SpiMemoryCacheStats stats;
+    };
+
+
+    // Modelled throughput, in KB/s of the application's own data
+    double getKbPerSec( const Result& r, const uint32_t numAccesses, const bool cached )
+    {
+        const double us{ r.transfers * _transferUs + r.busBytes * _byteUs + ( cached ? numAccesses * _hitUs : 0.0 ) };
+
+        return ( r.appBytes / 1024.0 ) / ( us / 1000000.0 );
+    }
+
+
+    // Runs the same accesses either through a cache, or straight to the chip
+    Result run( const Pattern& p, SpiMemoryCache* const cache, const uint32_t seed, const uint32_t numAccesses )
+    {
+        Result r{};
+        uint32_t windowBase{ 0 };
+        uint8_t buffer[ 8 ];
+
+        _random = seed;
+        memset( _mem.chip, 0, sizeof( _mem.chip ) );
+        memset( _shadow, 0, sizeof( _shadow ) );
+        _mem.transfers = 0;
+        _mem.busBytes = 0;
+
+        for ( uint32_t i = 0; i < numAccesses; i++ ) {
+            if ( p.windowMoves and i % p.windowMoves == 0 ) {
+                windowBase = ( windowBase + p.windowBytes / 2 ) % ( SpiMemory::CHIP_BYTES - p.windowBytes );
+            }
+
+            const uint8_t numBytes{ (uint8_t) ( 1 + getRandom( sizeof( buffer ) ) ) };
+            const uint32_t addr{ windowBase + getRandom( p.windowBytes - numBytes ) };
+
+            if ( getRandom( 2 ) ) {
+                for ( uint8_t n = 0; n < numBytes; n++ ) {
+                    buffer[ n ] = (uint8_t) getRandom( 256 );
+                }
+
+                memcpy( &_shadow[ addr ], buffer, numBytes );
+
+                if ( cache ) {
+                    cache->write( buffer, addr, numBytes );
+                }
+                else {
+                    _mem.write( buffer, addr, numBytes );
+                }
+            }
+            else {
+                if ( cache ) {
+                    cache->read( buffer, addr, numBytes );
+                }
+                else {
+                    _mem.read( buffer, addr, numBytes );
+                }
+
+                if ( memcmp( buffer, &_shadow[ addr ], numBytes ) ) {
+                    printf( "cachebench: FAILED: read at 0x%05x gave the wrong data (access %u)\n", addr, i );
+                    exit( 1 );
+                }
+            }
+
+            r.appBytes += numBytes;
+        }
+
+        if ( cache ) {
+            cache->flush();
+            r.stats = cache->getStats();
+
+            if ( memcmp( _mem.chip, _shadow, sizeof( _shadow ) ) ) {
+                printf( "cachebench: FAILED: chip doesn't match after flush()\n" );
+                exit( 1 );
+            }
+        }
+
+        r.transfers = _mem.transfers;
+        r.busBytes = _mem.busBytes;
+
+        return r;
+    }
+
+}    // namespace
+
+
+int main( int argc, char** argv )
+{
+    const uint32_t seed{ argc > 1 ? (uint32_t) strtoul( argv[ 1 ], nullptr, 0 ) : 1 };
+    const uint32_t numAccesses{ argc > 2 ? (uint32_t) strtoul( argv[ 2 ], nullptr, 0 ) : 100000 };
+
+    if ( argc > 3 ) _transferUs = atof( argv[ 3 ] );
+    if ( argc > 4 ) _byteUs = atof( argv[ 4 ] );
+    if ( argc > 5 ) _hitUs = atof( argv[ 5 ] );
+
+    // too big for the heap's 16-bit sizes, so it must not be built, rather than be
+    // built over a wrapped-round, much smaller allocation
+    {
+        SpiMemoryCache huge( _mem, 64, 2048 );
+
+        if ( huge ) {
+            printf( "cachebench: FAILED: 64 x 2048 byte cache was allowed\n" );
+            return 1;
+        }
+    }
+
+    printf( "cachebench: %u accesses of 1-8 bytes, half reads, half writes\n", numAccesses );
+    printf( "model: %.1f us per transfer, %.1f us per bus byte, %.1f us per cache access\n", _transferUs, _byteUs, _hitUs );
+
+    for ( const Pattern& p : PATTERNS ) {
+        const Result direct{ run( p, nullptr, seed ? seed : 1, numAccesses ) };
+
+        printf( "\n%s\n", p.name );
+        printf( "  %-10s  hit rate  transfers  bus bytes  KB/s   speedup\n", "" );
+        printf( "  %-10s  %7s  %9u  %9u  %5.1f\n", "uncached", "-", direct.transfers, direct.busBytes,
+            getKbPerSec( direct, numAccesses, false ) );
+
+        for ( const Config& c : CONFIGS ) {
+            SpiMemoryCache cache( _mem, c.numLines, c.lineBytes );
+            char name[ 16 ];
+
+            if ( !cache ) {
+                printf( "cachebench: FAILED: couldn't allocate %u x %u cache\n", c.numLines, c.lineBytes );
+                return 1;
+            }
+
+            const Result cached{ run( p, &cache, seed ? seed : 1, numAccesses ) };
+            const uint32_t lookups{ cached.stats.hits + cached.stats.misses };
+
+            snprintf( name, sizeof( name ), "%u x %uB", c.numLines, c.lineBytes );
+            printf( "  %-10s  %6.1f%%  %9u  %9u  %5.1f  %5.2fx\n",
+                name,
+                100.0 * cached.stats.hits / ( lookups ? lookups : 1 ),
+                cached.transfers, cached.busBytes,
+                getKbPerSec( cached, numAccesses, true ),
+                getKbPerSec( cached, numAccesses, true ) / getKbPerSec( direct, numAccesses, false ) );
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,340 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Randomised stress test of memory::allocate(), free() and reallocate().
+//
+// Built once per heap backend (see the Makefile), and run with the same seed, so both
+// backends see exactly the same requests. Every block is filled with its own pattern,
+// and checked for overlaps and damage, so a bad backend fails loudly. Then it reports
+// how fragmented each heap got and how long each call took on the host, which is only
+// good for comparing one backend with the other.
+//
+//    heapfuzz [seed] [operations]
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "memory.h"
+#include "util.h"
+
+
+using namespace zero;
+
+
+#ifdef ZERO_HEAP_TLSF
+    #define BACKEND "tlsf"
+#else
+    #define BACKEND "pages"
+#endif
+
+
+namespace {
+
+    const uint16_t MAX_LIVE{ 64 };
+    const uint16_t HISTOGRAM_BUCKETS{ 1000 };           // 10 ns each, the last for anything slower
+
+    struct Live {
+        uint8_t* address;
+        uint16_t bytesReqd;
+        uint16_t allocatedBytes;
+        uint8_t pattern;
+    };
+
+    struct Timing {
+        const char* name;
+        uint32_t count;
+        uint64_t totalNs;
+        uint32_t maxNs;
+        uint32_t histogram[ HISTOGRAM_BUCKETS ];
+    };
+
+    Live _live[ MAX_LIVE ];
+    uint16_t _numLive{ 0 };
+    uint32_t _liveBytes{ 0 };
+
+    Timing _allocTime{ "allocate" };
+    Timing _freeTime{ "free" };
+    Timing _reallocTime{ "reallocate" };
+
+    uint32_t _random;
+
+
+    // xorshift, so a seed means the same thing on every host
+    uint32_t getRandom( const uint32_t limit )
+    {
+        _random ^= _random << 13;
+        _random ^= _random >> 17;
+        _random ^= _random << 5;
+
+        return _random % limit;
+    }
+
+
+    // Mostly small requests, some medium, the odd big one
+    uint16_t getRandomSize()
+    {
+        const uint32_t kind{ getRandom( 100 ) };
+
+        if ( kind < 70 ) return 1 + getRandom( 32 );
+        if ( kind < 95 ) return 33 + getRandom( 96 );
+
+        return 129 + getRandom( DYNAMIC_BYTES / 3 - 128 );
+    }
+
+
+    uint64_t getNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch() ).count();
+    }
+
+
+    void addTiming( Timing& t, const uint64_t startNs )
+    {
+        const uint32_t ns{ (uint32_t) ( getNs() - startNs ) };
+        const uint32_t bucket{ ns / 10 };
+
+        t.count++;
+        t.totalNs += ns;
+
+        if ( ns > t.maxNs ) {
+            t.maxNs = ns;
+        }
+
+        t.histogram[ bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1 ]++;
+    }
+
+
+    uint32_t getPercentileNs( const Timing& t, const uint32_t perMille )
+    {
+        const uint64_t wanted{ ( (uint64_t) t.count * perMille + 999 ) / 1000 };
+        uint64_t seen{ 0 };
+
+        for ( uint16_t i = 0; i < HISTOGRAM_BUCKETS; i++ ) {
+            seen += t.histogram[ i ];
+
+            if ( seen >= wanted ) {
+                return ( i + 1 ) * 10;
+            }
+        }
+
+        return t.maxNs;
+    }
+
+
+    void fail( const char* const what, const uint32_t op )
+    {
+        printf( "%s: FAILED at operation %u: %s\n", BACKEND, op, what );
+        exit( 1 );
+    }
+
+
+    void fill( const Live& l )
+    {
+        for ( uint16_t i = 0; i < l.allocatedBytes; i++ ) {
+            l.address[ i ] = l.pattern + i;
+        }
+    }
+
+
+    // Checks the first numBytes of a block still hold its pattern
+    bool isIntact( const Live& l, const uint16_t numBytes )
+    {
+        for ( uint16_t i = 0; i < numBytes; i++ ) {
+            if ( l.address[ i ] != (uint8_t) ( l.pattern + i ) ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    // Checks a new or moved block doesn't overlap any other live block
+    bool isOverlapping( const uint16_t index )
+    {
+        const Live& l{ _live[ index ] };
+
+        for ( uint16_t i = 0; i < _numLive; i++ ) {
+            const Live& other{ _live[ i ] };
+
+            if ( i != index
+                and l.address < other.address + other.allocatedBytes
+                and other.address < l.address + l.allocatedBytes )
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    void doAllocate( const uint32_t op )
+    {
+        Live& l{ _live[ _numLive ] };
+        const memory::SearchStrategy strategy{ getRandom( 4 )
+            ? memory::SearchStrategy::BottomUp
+            : memory::SearchStrategy::TopDown };
+
+        l.bytesReqd = getRandomSize();
+        l.pattern = (uint8_t) getRandom( 256 );
+
+        const uint64_t startNs{ getNs() };
+        l.address = (uint8_t*) memory::allocate( l.bytesReqd, &l.allocatedBytes, strategy );
+        addTiming( _allocTime, startNs );
+
+        if ( !l.address ) {
+            if ( l.allocatedBytes ) fail( "allocatedBytes set for a failed allocation", op );
+            return;
+        }
+
+        if ( l.allocatedBytes < l.bytesReqd ) fail( "allocated fewer bytes than asked for", op );
+        if ( isOverlapping( _numLive ) ) fail( "new block overlaps a live block", op );
+
+        fill( l );
+        _liveBytes += l.allocatedBytes;
+        _numLive++;
+    }
+
+
+    void doFree( const uint32_t op )
+    {
+        const uint16_t index{ (uint16_t) getRandom( _numLive ) };
+        Live& l{ _live[ index ] };
+
+        if ( !isIntact( l, l.allocatedBytes ) ) fail( "block damaged before free", op );
+
+        const uint64_t startNs{ getNs() };
+        memory::free( l.address, getRandom( 2 ) ? l.bytesReqd : 0 );
+        addTiming( _freeTime, startNs );
+
+        _liveBytes -= l.allocatedBytes;
+        l = _live[ --_numLive ];
+    }
+
+
+    void doReallocate( const uint32_t op )
+    {
+        const uint16_t index{ (uint16_t) getRandom( _numLive ) };
+        Live& l{ _live[ index ] };
+        const uint16_t bytesReqd{ getRandomSize() };
+        uint16_t allocatedBytes;
+
+        const uint64_t startNs{ getNs() };
+        uint8_t* const address{ (uint8_t*) memory::reallocate( l.address, bytesReqd, &allocatedBytes ) };
+        addTiming( _reallocTime, startNs );
+
+        if ( !address ) {
+            // the block must be left just as it was
+            if ( !isIntact( l, l.allocatedBytes ) ) fail( "failed reallocate damaged the block", op );
+            return;
+        }
+
+        if ( allocatedBytes < bytesReqd ) fail( "reallocated fewer bytes than asked for", op );
+
+        l.address = address;
+
+        if ( !isIntact( l, MIN( l.bytesReqd, bytesReqd ) ) ) fail( "reallocate lost the contents", op );
+
+        _liveBytes += allocatedBytes - l.allocatedBytes;
+        l.bytesReqd = bytesReqd;
+        l.allocatedBytes = allocatedBytes;
+
+        if ( isOverlapping( index ) ) fail( "resized block overlaps a live block", op );
+
+        fill( l );
+    }
+
+
+    void printTiming( const Timing& t )
+    {
+        printf( "  %-10s %8u calls  mean %5u ns  p99 %5u ns  p99.9 %5u ns  max %6u ns\n",
+            t.name,
+            t.count,
+            t.count ? (uint32_t) ( t.totalNs / t.count ) : 0,
+            getPercentileNs( t, 990 ),
+            getPercentileNs( t, 999 ),
+            t.maxNs );
+    }
+
+}    // namespace
+
+
+int main( int argc, char** argv )
+{
+    _random = argc > 1 ? strtoul( argv[ 1 ], nullptr, 0 ) : 1;
+    const uint32_t numOps{ argc > 2 ? (uint32_t) strtoul( argv[ 2 ], nullptr, 0 ) : 200000 };
+
+    if ( !_random ) {
+        _random = 1;
+    }
+
+    const uint16_t initialFree{ memory::getFreeBytes() };
+    uint32_t allocs{ 0 }, failed{ 0 }, failedWithEnoughFree{ 0 };
+    uint64_t fragmentationTotal{ 0 };
+    uint8_t fragmentationMax{ 0 };
+    uint32_t peakLiveBytes{ 0 };
+
+    for ( uint32_t op = 0; op < numOps; op++ ) {
+        const uint32_t kind{ getRandom( 100 ) };
+
+        if ( _numLive < MAX_LIVE and ( kind < 50 or !_numLive ) ) {
+            const uint16_t before{ _numLive };
+            const uint16_t freeBytes{ memory::getFreeBytes() };
+
+            doAllocate( op );
+            allocs++;
+
+            if ( _numLive == before ) {
+                failed++;
+                failedWithEnoughFree += _live[ _numLive ].bytesReqd <= freeBytes;
+            }
+        }
+        else if ( kind < 85 ) {
+            doFree( op );
+        }
+        else {
+            doReallocate( op );
+        }
+
+        const uint16_t freeBytes{ memory::getFreeBytes() };
+        const uint8_t fragmentation{ memory::getFragmentation() };
+
+        if ( freeBytes + _liveBytes > initialFree ) fail( "free and live bytes add up to more than the heap", op );
+        if ( memory::getLargestFreeBlock() > freeBytes ) fail( "largest free block is bigger than the free bytes", op );
+
+        fragmentationTotal += fragmentation;
+        fragmentationMax = MAX( fragmentationMax, fragmentation );
+        peakLiveBytes = MAX( peakLiveBytes, _liveBytes );
+    }
+
+    // everything back, and it should all join up again
+    while ( _numLive ) {
+        doFree( numOps );
+    }
+
+    if ( memory::getFreeBytes() != initialFree ) fail( "free bytes not back to the start", numOps );
+    if ( memory::getLargestFreeBlock() != initialFree ) fail( "free memory not merged back into one block", numOps );
+
+    printf( "%s: %u operations, %u byte heap, %u free at start\n", BACKEND, numOps, (uint16_t) DYNAMIC_BYTES, initialFree );
+    printf( "  allocations %u, failed %u (%u of them with enough bytes free in total)\n", allocs, failed, failedWithEnoughFree );
+    printf( "  fragmentation mean %u%%, max %u%%; peak live bytes %u\n",
+        (uint32_t) ( fragmentationTotal / numOps ), fragmentationMax, peakLiveBytes );
+
+    printTiming( _allocTime );
+    printTiming( _freeTime );
+    printTiming( _reallocTime );
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Stand-ins for the bits of the kernel that the heap code calls. The host tools run
+// a single thread of their own, which the heap sees as "before the scheduler starts",
+// unless a tool makes stand-in Threads and picks one with setCurrentThread(). Those
+// Threads have no stack, and never run.
+
+
+#include <stdint.h>
+
+#include "thread.h"
+#include "kernel.h"
+
+
+using namespace zero;
+
+
+namespace {
+
+    bool _switchingEnabled{ true };
+    Thread* _current{ nullptr };
+
+}    // namespace
+
+
+void Thread::forbid()
+{
+    _switchingEnabled = false;
+}
+
+
+void Thread::permit()
+{
+    _switchingEnabled = true;
+}
+
+
+bool Thread::isSwitchingEnabled()
+{
+    return _switchingEnabled;
+}
+
+
+void setCurrentThread( Thread* const t )
+{
+    _current = t;
+}
+
+
+Thread::Thread(
+    const char* const name,
+    const uint16_t,
+    const ThreadEntry,
+    const ThreadFlags,
+    const Synapse* const,
+    int* const )
+:
+    _stackBottom{ nullptr },
+    _name{ name }
+{
+    // empty
+}
+
+
+Thread::~Thread()
+{
+    // empty
+}
+
+
+Thread* Thread::getCurrentOrNull()
+{
+    return _current;
+}
+
+
+uint16_t Thread::getThreadId() const
+{
+    return 0;
+}
+
+
+const char* Thread::getName() const
+{
+    return "host";
+}
@@ -0,0 +1,23 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Controls for the stand-in kernel in kernel.cpp
+
+
+#ifndef TCRI_ZERO_HOSTTEST_KERNEL_H
+#define TCRI_ZERO_HOSTTEST_KERNEL_H
+
+
+#include "thread.h"
+
+
+// Makes the heap see t as the running Thread, or no Thread at all for nullptr
+void setCurrentThread( zero::Thread* const t );
+
+
+#endif
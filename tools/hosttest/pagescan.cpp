@@ -0,0 +1,249 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Checks PageManager's byte-at-a-time findFreePages() against the page-at-a-time search
+// it replaced, on random bitmaps of several sizes, then times the two against how full
+// the heap is. Times are host nanoseconds, only good for comparing the two.
+//
+//    pagescan [seed]
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+// built in, so that page counts other than SRAM_PAGES can be instantiated too
+#include "pagemanager.cpp"
+
+
+using namespace zero;
+using memory::SearchStrategy;
+
+
+namespace {
+
+    uint32_t _random;
+
+
+    // xorshift, so a seed means the same thing on every host
+    uint32_t getRandom( const uint32_t limit )
+    {
+        _random ^= _random << 13;
+        _random ^= _random >> 17;
+        _random ^= _random << 5;
+
+        return _random % limit;
+    }
+
+
+    uint64_t getNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch() ).count();
+    }
+
+
+    uint16_t getPageForSearchStep_TopDown( const uint16_t curStep, const uint16_t numPages )
+    {
+        return numPages - curStep - 1;
+    }
+
+
+    uint16_t getPageForSearchStep_BottomUp( const uint16_t curStep, const uint16_t )
+    {
+        return curStep;
+    }
+
+
+    uint16_t ( *_strategies[] )( const uint16_t, const uint16_t ) = {
+        getPageForSearchStep_TopDown,
+        getPageForSearchStep_BottomUp,
+    };
+
+
+    // The search findFreePages() used to do: one page per step, through the strategy
+    // table, restarting the count at every used page
+    template <uint16_t PAGE_COUNT>
+    int16_t findOneByOne( const PageManager<PAGE_COUNT>& pm, const uint16_t numPagesRequired, const SearchStrategy strat )
+    {
+        uint16_t startPage{ (uint16_t) -1 };
+        uint16_t pageCount{ 0 };
+
+        for ( uint16_t curStep = 0; curStep < PAGE_COUNT; curStep++ ) {
+            const uint16_t curPage{ _strategies[ (int) strat ]( curStep, PAGE_COUNT ) };
+
+            if ( pm.isPageAvailable( curPage ) ) {
+                pageCount++;
+
+                if ( startPage == (uint16_t) -1 ) {
+                    startPage = curPage;
+                }
+
+                if ( pageCount == numPagesRequired ) {
+                    startPage = MIN( startPage, curPage );
+                    break;
+                }
+            }
+            else {
+                startPage = (uint16_t) -1;
+                pageCount = 0;
+            }
+        }
+
+        return ( pageCount < numPagesRequired ) ? -1 : startPage;
+    }
+
+
+    // Marks used pages in runs of 1-8, starting anywhere in the first span pages, until
+    // at least numUsed are used
+    template <uint16_t PAGE_COUNT>
+    void fill( PageManager<PAGE_COUNT>& pm, const uint16_t numUsed, const uint16_t span = PAGE_COUNT )
+    {
+        for ( uint16_t i = 0; i < PAGE_COUNT; i++ ) {
+            pm.markAsFree( i );
+        }
+
+        while ( pm.getUsedPageCount() < numUsed ) {
+            const uint16_t start{ (uint16_t) getRandom( span ) };
+            const uint16_t length{ (uint16_t) ( 1 + getRandom( 8 ) ) };
+
+            for ( uint16_t i = start; i < start + length and i < PAGE_COUNT and pm.getUsedPageCount() < numUsed; i++ ) {
+                pm.markAsUsed( i );
+            }
+        }
+    }
+
+
+    // Compares the two searches over many random bitmaps and requests
+    template <uint16_t PAGE_COUNT>
+    uint32_t checkEquivalence( const uint16_t numMaps )
+    {
+        static PageManager<PAGE_COUNT> pm;
+        uint32_t numCompared{ 0 };
+
+        for ( uint16_t map = 0; map < numMaps; map++ ) {
+            fill( pm, getRandom( PAGE_COUNT + 1 ) );
+
+            for ( uint16_t request = 0; request < 32; request++ ) {
+                // mostly small requests, but some as big as the whole map, and bigger
+                const uint16_t numPages{ (uint16_t) ( getRandom( 4 )
+                    ? 1 + getRandom( MIN( PAGE_COUNT, 24 ) )
+                    : 1 + getRandom( PAGE_COUNT + 1 ) ) };
+
+                for ( uint8_t direction = 0; direction < 2; direction++ ) {
+                    const SearchStrategy strat{ direction ? SearchStrategy::TopDown : SearchStrategy::BottomUp };
+                    const int16_t expected{ findOneByOne( pm, numPages, strat ) };
+                    const int16_t got{ pm.findFreePages( numPages, strat ) };
+
+                    if ( got != expected ) {
+                        printf( "pagescan: FAILED: %u pages, map %u, %u wanted %s: got %d, expected %d\n",
+                            PAGE_COUNT, map, numPages,
+                            strat == SearchStrategy::BottomUp ? "bottom-up" : "top-down",
+                            got, expected );
+                        exit( 1 );
+                    }
+
+                    numCompared++;
+                }
+            }
+        }
+
+        return numCompared;
+    }
+
+
+    template <uint16_t PAGE_COUNT>
+    uint32_t timeOneByOne( const PageManager<PAGE_COUNT>& pm, const uint16_t numPages, const uint16_t repeats )
+    {
+        volatile int16_t sink;
+        const uint64_t start{ getNs() };
+
+        for ( uint16_t i = 0; i < repeats; i++ ) {
+            sink = findOneByOne( pm, numPages + ( i & 3 ), SearchStrategy::BottomUp );
+        }
+
+        (void) sink;
+
+        return ( getNs() - start ) / repeats;
+    }
+
+
+    template <uint16_t PAGE_COUNT>
+    uint32_t timeByBytes( const PageManager<PAGE_COUNT>& pm, const uint16_t numPages, const uint16_t repeats )
+    {
+        volatile int16_t sink;
+        const uint64_t start{ getNs() };
+
+        for ( uint16_t i = 0; i < repeats; i++ ) {
+            sink = pm.findFreePages( numPages + ( i & 3 ), SearchStrategy::BottomUp );
+        }
+
+        (void) sink;
+
+        return ( getNs() - start ) / repeats;
+    }
+
+
+    // Times both searches against how full the heap is. Like a real bottom-up heap, the
+    // used pages are packed towards the bottom, with holes.
+    template <uint16_t PAGE_COUNT>
+    void benchmark()
+    {
+        static PageManager<PAGE_COUNT> pm;
+        const uint16_t REPEATS{ 20000 };
+
+        printf( "\n%u pages, mean ns per bottom-up search\n", PAGE_COUNT );
+        printf( "  used  largest free   1-4 pages: page  byte  speedup   no fit: page   byte  speedup\n" );
+
+        for ( uint8_t percent = 0; percent <= 90; percent += 10 ) {
+            const uint16_t numUsed{ (uint16_t) ( (uint32_t) PAGE_COUNT * percent / 100 ) };
+
+            fill( pm, numUsed, MIN( PAGE_COUNT, numUsed + numUsed / 4 + 1 ) );
+
+            const uint16_t largest{ pm.getLargestFreeRun() };
+            const uint32_t smallOld{ timeOneByOne( pm, 1, REPEATS ) };
+            const uint32_t smallNew{ timeByBytes( pm, 1, REPEATS ) };
+            const uint32_t missOld{ timeOneByOne( pm, largest + 1, REPEATS / 10 ) };
+            const uint32_t missNew{ timeByBytes( pm, largest + 1, REPEATS / 10 ) };
+
+            printf( "  %3u%%  %12u   %15u  %4u  %6.1fx   %12u  %5u  %6.1fx\n",
+                percent, largest,
+                smallOld, smallNew, (double) smallOld / ( MAX( smallNew, 1U ) ),
+                missOld, missNew, (double) missOld / ( MAX( missNew, 1U ) ) );
+        }
+    }
+
+}    // namespace
+
+
+int main( int argc, char** argv )
+{
+    _random = argc > 1 ? strtoul( argv[ 1 ], nullptr, 0 ) : 1;
+
+    if ( !_random ) {
+        _random = 1;
+    }
+
+    uint32_t numCompared{ 0 };
+
+    numCompared += checkEquivalence<1>( 200 );
+    numCompared += checkEquivalence<7>( 2000 );
+    numCompared += checkEquivalence<9>( 2000 );
+    numCompared += checkEquivalence<61>( 2000 );
+    numCompared += checkEquivalence<SRAM_PAGES>( 2000 );
+    numCompared += checkEquivalence<900>( 500 );
+
+    printf( "pagescan: %u searches matched the page-at-a-time search\n", numCompared );
+
+    benchmark<SRAM_PAGES>();
+    benchmark<960>();
+
+    return 0;
+}
@@ -0,0 +1,296 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Compares ObjectPool with the heap for small objects: the SRAM a batch of objects
+// really costs, and how long a new and delete take. Also checks that pooled objects
+// never overlap, and that ZERO_POOLED falls back to the heap when its pool is empty.
+//
+// Bytes are what the heap's free count drops by, so they include its rounding and
+// headers. They're host bytes, with 8-byte pointers, so the first table only checks
+// a model of both heaps' and the pool's overheads against the real thing. The second
+// table applies the same model to the AVR, with two-byte pointers and no padding, for
+// the classes most often created and destroyed. Times are host nanoseconds, only
+// good for comparing one with the other.
+//
+//    poolbench [seed]
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+#include "memory.h"
+#include "objectpool.h"
+
+
+using namespace zero;
+
+
+#ifdef ZERO_HEAP_TLSF
+    #define BACKEND "tlsf"
+#else
+    #define BACKEND "pages"
+#endif
+
+
+namespace {
+
+    const uint8_t NUM_OBJECTS{ 16 };
+    const uint32_t REPEATS{ 200000 };
+
+    // the things the model needs to know about a compiler
+    struct Target {
+        uint16_t pointerBytes;
+        uint16_t alignBytes;                            // the most any member is aligned to
+    };
+
+    const Target HOST{ sizeof( void* ), alignof( void* ) };
+    const Target AVR{ 2, 1 };
+
+    // classes often made and destroyed, with their sizes under avr-gcc as worked out
+    // from their members - the default makefile, without stack swap or accounting
+    struct AvrClass {
+        const char* name;
+        uint16_t bytes;
+    };
+
+    const AvrClass AVR_CLASSES[]{
+        { "Synapse", 4 },                               // Thread*, SignalBitField
+        { "DoubleBuffer", 10 },                         // buffer pointer and four uint16_t
+        { "Gpio", 16 },                                 // list links, callback, Synapse*, PinField, two PinControls
+        { "Thread", 27 },                               // stack and list pointers, times, signals, ID, name
+    };
+
+    template <uint16_t SIZE>
+    class Object {
+    public:
+        ZERO_POOLED( Object, NUM_OBJECTS )
+
+        uint8_t payload[ SIZE ];
+    };
+
+    uint32_t _random;
+
+
+    // xorshift, so a seed means the same thing on every host
+    uint32_t getRandom( const uint32_t limit )
+    {
+        _random ^= _random << 13;
+        _random ^= _random >> 17;
+        _random ^= _random << 5;
+
+        return _random % limit;
+    }
+
+
+    uint64_t getNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch() ).count();
+    }
+
+
+    uint16_t roundUp( const uint16_t bytes, const uint16_t multiple )
+    {
+        return ( bytes + multiple - 1 ) / multiple * multiple;
+    }
+
+
+    // Heap bytes for NUM_OBJECTS objects: whole pages each, or a TLSF header and at
+    // least room for the free list links, in four-byte granules
+    uint16_t getModelHeapBytes( const uint16_t objectBytes, const Target& t )
+    {
+        #ifdef ZERO_HEAP_TLSF
+            const uint16_t headerBytes{ roundUp( t.pointerBytes + 2, t.alignBytes ) };
+            const uint16_t payloadBytes{ roundUp( objectBytes, 4 ) };
+            const uint16_t minPayloadBytes{ (uint16_t) ( 2 * t.pointerBytes ) };
+
+            return NUM_OBJECTS * ( headerBytes + ( payloadBytes > minPayloadBytes ? payloadBytes : minPayloadBytes ) );
+        #else
+            (void) t;
+
+            return NUM_OBJECTS * roundUp( objectBytes, PAGE_BYTES );
+        #endif
+    }
+
+
+    // ObjectPool bytes: slots big enough for a free list link, and the free list and
+    // three counts
+    uint16_t getModelPoolBytes( const uint16_t objectBytes, const Target& t )
+    {
+        const uint16_t slotBytes{ objectBytes > t.pointerBytes ? objectBytes : t.pointerBytes };
+        const uint16_t baseBytes{ roundUp( t.pointerBytes + 3, t.alignBytes ) };
+
+        return roundUp( baseBytes + NUM_OBJECTS * slotBytes, t.alignBytes );
+    }
+
+
+    void fail( const char* const what, const uint16_t size )
+    {
+        printf( "%s: FAILED: %u byte objects: %s\n", BACKEND, size, what );
+        exit( 1 );
+    }
+
+
+    // Bytes the heap gives up for NUM_OBJECTS objects of SIZE bytes
+    template <uint16_t SIZE>
+    uint16_t getHeapBytes()
+    {
+        void* objects[ NUM_OBJECTS ];
+        const uint16_t before{ memory::getFreeBytes() };
+
+        for ( uint8_t i = 0; i < NUM_OBJECTS; i++ ) {
+            objects[ i ] = memory::allocate( SIZE );
+
+            if ( !objects[ i ] ) fail( "heap ran out", SIZE );
+        }
+
+        const uint16_t used{ (uint16_t) ( before - memory::getFreeBytes() ) };
+
+        for ( uint8_t i = 0; i < NUM_OBJECTS; i++ ) {
+            memory::free( objects[ i ], SIZE );
+        }
+
+        return used;
+    }
+
+
+    // Takes everything from a pooled class, checks it, and then one more from the heap
+    template <uint16_t SIZE>
+    void checkPooled()
+    {
+        using O = Object<SIZE>;
+
+        O* objects[ NUM_OBJECTS ];
+        const uint16_t freeBefore{ memory::getFreeBytes() };
+
+        for ( uint8_t i = 0; i < NUM_OBJECTS; i++ ) {
+            objects[ i ] = new O;
+
+            if ( !O::getObjectPool().owns( objects[ i ] ) ) fail( "object didn't come from the pool", SIZE );
+
+            for ( uint8_t j = 0; j < i; j++ ) {
+                const uint8_t* const a{ (const uint8_t*) objects[ i ] };
+                const uint8_t* const b{ (const uint8_t*) objects[ j ] };
+
+                if ( a < b + sizeof( O ) and b < a + sizeof( O ) ) fail( "pooled objects overlap", SIZE );
+            }
+        }
+
+        if ( memory::getFreeBytes() != freeBefore ) fail( "pooled objects took heap memory", SIZE );
+
+        O* const extra{ new O };
+
+        if ( !extra or O::getObjectPool().owns( extra ) ) fail( "full pool didn't fall back to the heap", SIZE );
+        if ( memory::getFreeBytes() >= freeBefore ) fail( "fallback object didn't come from the heap", SIZE );
+
+        delete extra;
+
+        for ( uint8_t i = 0; i < NUM_OBJECTS; i++ ) {
+            delete objects[ i ];
+        }
+
+        if ( memory::getFreeBytes() != freeBefore ) fail( "heap not back to where it started", SIZE );
+        if ( O::getObjectPool().getUsedCount() ) fail( "pool still has slots handed out", SIZE );
+        if ( O::getObjectPool().getPeakCount() != NUM_OBJECTS ) fail( "pool peak is wrong", SIZE );
+    }
+
+
+    // Mean ns for a new and a delete, churning through a set of live objects. With
+    // a pooled class, every one is served by the pool.
+    template <class O>
+    uint32_t timeChurn( const uint32_t seed )
+    {
+        O* objects[ NUM_OBJECTS ]{};
+
+        _random = seed;
+
+        const uint64_t start{ getNs() };
+
+        for ( uint32_t i = 0; i < REPEATS; i++ ) {
+            O*& o{ objects[ getRandom( NUM_OBJECTS ) ] };
+
+            if ( o ) {
+                delete o;
+                o = nullptr;
+            }
+            else {
+                o = new O;
+            }
+        }
+
+        const uint64_t ns{ getNs() - start };
+
+        for ( uint8_t i = 0; i < NUM_OBJECTS; i++ ) {
+            delete objects[ i ];
+        }
+
+        // each pass was half a new and delete pair
+        return (uint32_t) ( 2 * ns / REPEATS );
+    }
+
+
+    // the same object, left to the global new and delete
+    template <uint16_t SIZE>
+    class HeapObject {
+    public:
+        uint8_t payload[ SIZE ];
+    };
+
+
+    template <uint16_t SIZE>
+    void report( const uint32_t seed )
+    {
+        checkPooled<SIZE>();
+
+        const uint16_t heapBytes{ getHeapBytes<SIZE>() };
+        const uint16_t poolBytes{ (uint16_t) sizeof( ObjectPool<Object<SIZE>, NUM_OBJECTS> ) };
+        if ( heapBytes != getModelHeapBytes( SIZE, HOST ) ) fail( "the heap model is wrong", SIZE );
+        if ( poolBytes != getModelPoolBytes( SIZE, HOST ) ) fail( "the pool model is wrong", SIZE );
+
+        const uint32_t heapNs{ timeChurn<HeapObject<SIZE>>( seed ) };
+        const uint32_t poolNs{ timeChurn<Object<SIZE>>( seed ) };
+
+        printf( "  %4u bytes  %10u  %10u  %6.2fx   %8u  %8u  %6.1fx\n",
+            SIZE,
+            heapBytes, poolBytes, (double) heapBytes / poolBytes,
+            heapNs, poolNs, (double) heapNs / ( poolNs ? poolNs : 1 ) );
+    }
+
+}    // namespace
+
+
+int main( int argc, char** argv )
+{
+    const uint32_t seed{ argc > 1 ? (uint32_t) strtoul( argv[ 1 ], nullptr, 0 ) : 1 };
+
+    printf( "%s: %u objects at a time, %u byte pages\n", BACKEND, NUM_OBJECTS, (uint16_t) PAGE_BYTES );
+    printf( "host, measured - %u byte pointers\n", (uint16_t) sizeof( void* ) );
+    printf( "  object      heap bytes  pool bytes  saving   heap ns   pool ns  speedup\n" );
+
+    report<8>( seed ? seed : 1 );
+    report<12>( seed ? seed : 1 );
+    report<20>( seed ? seed : 1 );
+    report<33>( seed ? seed : 1 );
+    report<40>( seed ? seed : 1 );
+
+    printf( "AVR, from the same model - 2 byte pointers\n" );
+    printf( "  class         bytes  heap bytes  pool bytes  saving\n" );
+
+    for ( const AvrClass& c : AVR_CLASSES ) {
+        const uint16_t heapBytes{ getModelHeapBytes( c.bytes, AVR ) };
+        const uint16_t poolBytes{ getModelPoolBytes( c.bytes, AVR ) };
+
+        printf( "  %-12s  %5u  %10u  %10u  %5.2fx\n",
+            c.name, c.bytes, heapBytes, poolBytes, (double) heapBytes / poolBytes );
+    }
+
+    return 0;
+}
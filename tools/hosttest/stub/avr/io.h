@@ -0,0 +1,20 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Just enough of avr-libc to build zero's hardware-free code on the host
+
+
+#ifndef TCRI_ZERO_HOSTTEST_AVR_IO_H
+#define TCRI_ZERO_HOSTTEST_AVR_IO_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#endif
@@ -0,0 +1,25 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// The host has one address space, so program memory is just memory
+
+
+#ifndef TCRI_ZERO_HOSTTEST_AVR_PGMSPACE_H
+#define TCRI_ZERO_HOSTTEST_AVR_PGMSPACE_H
+
+
+#include <stdint.h>
+
+
+#define PROGMEM
+#define PSTR( s ) ( s )
+#define pgm_read_byte( p ) ( *(const uint8_t*) ( p ) )
+#define pgm_read_word( p ) ( *(const uint16_t*) ( p ) )
+
+
+#endif
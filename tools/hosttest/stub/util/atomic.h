@@ -0,0 +1,24 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// The host tools are single threaded with no interrupts, so atomic blocks just run
+
+
+#ifndef TCRI_ZERO_HOSTTEST_UTIL_ATOMIC_H
+#define TCRI_ZERO_HOSTTEST_UTIL_ATOMIC_H
+
+
+#include <stdint.h>
+
+
+#define ATOMIC_BLOCK( t )           for ( t, __ToDo = 1; __ToDo; __ToDo = 0 )
+#define ATOMIC_RESTORESTATE         uint8_t sreg_save __attribute__( ( unused ) ) = 0
+#define ATOMIC_FORCEON              uint8_t sreg_save __attribute__( ( unused ) ) = 0
+
+
+#endif
@@ -0,0 +1,100 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Checks the heap trace records what was really allocated, and who by. Built with
+// HEAP_TRACE on. Addresses in the trace are 16 bits, so only their low bits are
+// compared on the host.
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "memory.h"
+
+
+using namespace zero;
+using namespace zero::memory;
+
+
+namespace {
+
+    struct Thing {
+        uint8_t bytes[ 20 ];
+    };
+
+    uint16_t _numChecks{ 0 };
+
+
+    void check( const bool ok, const char* const what )
+    {
+        _numChecks++;
+
+        if ( !ok ) {
+            printf( "trace: FAILED: %s\n", what );
+            exit( 1 );
+        }
+    }
+
+
+    uint16_t low( const void* const p )
+    {
+        return (uint16_t) (uintptr_t) p;
+    }
+
+
+    // Every heap call in here should be traced as coming from somewhere in here, so
+    // all the callers land close together. Calls traced as coming from inside the
+    // heap's own wrappers would land somewhere else entirely.
+    void __attribute__( ( noinline ) ) useHeap( void** const blocks )
+    {
+        blocks[ 0 ] = memory::allocate( 10 );
+        blocks[ 1 ] = new Thing;
+        blocks[ 2 ] = memory::reallocate( nullptr, 30 );
+        blocks[ 2 ] = memory::reallocate( blocks[ 2 ], DYNAMIC_BYTES / 2 );
+        memory::free( blocks[ 0 ] );
+        delete (Thing*) blocks[ 1 ];
+
+        // not a tail call, or delete would be traced as called from main()
+        blocks[ 1 ] = nullptr;
+    }
+
+}    // namespace
+
+
+int main()
+{
+    void* blocks[ 3 ];
+    TraceRecord records[ 16 ];
+
+    useHeap( blocks );
+
+    const uint8_t numRecords{ readTrace( records, 16 ) };
+
+    check( numRecords >= 6, "every call was traced" );
+    check( records[ 0 ].op == TraceOp::Allocate and records[ 0 ].address == low( blocks[ 0 ] ), "allocate() records its address" );
+    check( records[ 0 ].address != 0, "allocate() address isn't zero" );
+    check( records[ 1 ].op == TraceOp::Allocate and records[ 1 ].address != 0, "new records its address" );
+    check( records[ 2 ].op == TraceOp::Allocate and records[ 2 ].address != 0, "reallocate( nullptr ) records its address" );
+
+    for ( uint8_t i = 1; i < numRecords; i++ ) {
+        const int32_t distance{ (int32_t) records[ i ].caller - records[ 0 ].caller };
+
+        check( distance > -512 and distance < 512, "every record names the caller, not a heap wrapper" );
+    }
+
+    for ( uint8_t i = 0; i < numRecords; i++ ) {
+        check( records[ i ].op != TraceOp::Fail, "nothing failed" );
+    }
+
+    memory::free( blocks[ 2 ] );
+
+    printf( "trace: %u checks passed\n", _numChecks );
+
+    return 0;
+}
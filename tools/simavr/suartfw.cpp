@@ -0,0 +1,79 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Firmware for suartjitter. Three SuartTx channels on PD5, PD6 and PD7 send their
+// own message over and over, while another Thread keeps shutting interrupts off for
+// a few microseconds at a time, so the bit-clock ISR is sometimes late. The harness
+// watches the pins, so nothing here reports back.
+
+
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include <util/delay.h>
+
+#include "gpio.h"
+#include "suart.h"
+#include "thread.h"
+
+
+using namespace zero;
+
+
+namespace {
+
+    const uint32_t BAUD{ 38400 };
+
+    // keep these in step with suartjitter.cpp, which decodes them
+    const uint8_t MESSAGE_0[]{ 'z', 'e', 'r', 'o', ' ', 's', 'u', 'a', 'r', 't' };
+    const uint8_t MESSAGE_1[]{ 0x55, 0xAA, 0x00, 0xFF };
+    const uint8_t MESSAGE_2[]{ 0x01, 0x80, 0x0F, 0xF0, 0x3C };
+
+
+    template <uint8_t CHANNEL>
+    int channelMain()
+    {
+        const PinField PINS[]{ ZERO_PIND5, ZERO_PIND6, ZERO_PIND7 };
+        const uint8_t* const MESSAGES[]{ MESSAGE_0, MESSAGE_1, MESSAGE_2 };
+        const uint16_t SIZES[]{ sizeof( MESSAGE_0 ), sizeof( MESSAGE_1 ), sizeof( MESSAGE_2 ) };
+
+        Synapse readySyn;
+        Gpio pin{ PINS[ CHANNEL ] };
+        SuartTx tx{ BAUD, pin, readySyn };
+
+        while ( tx ) {
+            tx.transmit( MESSAGES[ CHANNEL ], SIZES[ CHANNEL ], true );
+        }
+
+        return 0;
+    }
+
+
+    // stands in for other drivers' critical sections and ISRs
+    int loadMain()
+    {
+        while ( true ) {
+            ATOMIC_BLOCK ( ATOMIC_RESTORESTATE ) {
+                _delay_us( 3 );
+            }
+
+            _delay_us( 7 );
+        }
+
+        return 0;
+    }
+
+}    // namespace
+
+
+int main()
+{
+    new Thread( PSTR( "suart0" ), 192, channelMain<0> );
+    new Thread( PSTR( "suart1" ), 192, channelMain<1> );
+    new Thread( PSTR( "suart2" ), 192, channelMain<2> );
+    new Thread( PSTR( "load" ), 128, loadMain );
+}
@@ -0,0 +1,293 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Runs suartfw in simavr, and measures the SuartTx edges it makes.
+//
+// Every edge on PD5-PD7 is timed to the CPU cycle and written to a VCD file for a
+// waveform viewer. Then each channel is decoded as 8N1 and checked against the bytes
+// the firmware sends, and the edge timing is reported:
+//
+//  - jitter: how far each edge lands from a whole number of bit-times after its
+//    frame's start bit. Edges are only compared within a frame, as the bit-clock
+//    stops and starts again between buffers.
+//  - skew: how far apart the channels' edges are when they fall in the same tick.
+//    They share one PIND write, so this should be zero.
+//
+//    suartjitter <suartfw.elf> [ms to run] [vcd file]
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "avr_ioport.h"
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_time.h"
+#include "sim_vcd_file.h"
+
+
+namespace {
+
+    const uint32_t F_CPU{ 16000000UL };
+    const uint32_t BAUD{ 38400 };
+
+    // one bit-time, as the driver sets up Timer2: whole counts at pre-scaler 32
+    const uint32_t BIT_CYCLES{ ( F_CPU / ( 32UL * BAUD ) ) * 32 };
+
+    const uint8_t NUM_CHANNELS{ 3 };
+    const uint32_t MAX_EDGES{ 200000 };
+
+    // as sent by suartfw.cpp
+    const uint8_t MESSAGE_0[]{ 'z', 'e', 'r', 'o', ' ', 's', 'u', 'a', 'r', 't' };
+    const uint8_t MESSAGE_1[]{ 0x55, 0xAA, 0x00, 0xFF };
+    const uint8_t MESSAGE_2[]{ 0x01, 0x80, 0x0F, 0xF0, 0x3C };
+
+    struct Channel {
+        const char* name;
+        uint8_t pin;
+        const uint8_t* message;
+        uint8_t messageBytes;
+
+        uint64_t edges[ MAX_EDGES ];
+        uint8_t levels[ MAX_EDGES ];
+        uint32_t numEdges;
+        uint8_t level;
+    };
+
+    Channel _channels[ NUM_CHANNELS ]{
+        { "suart0", 5, MESSAGE_0, sizeof( MESSAGE_0 ) },
+        { "suart1", 6, MESSAGE_1, sizeof( MESSAGE_1 ) },
+        { "suart2", 7, MESSAGE_2, sizeof( MESSAGE_2 ) },
+    };
+
+    avr_t* _avr;
+    elf_firmware_t _firmware;
+    avr_vcd_t _vcd;
+    uint64_t _endCycle;
+
+
+    void onPinChange( avr_irq_t* irq, uint32_t value, void* param )
+    {
+        Channel& c{ *(Channel*) param };
+
+        (void) irq;
+
+        if ( value == c.level ) return;
+
+        c.level = value;
+
+        if ( c.numEdges < MAX_EDGES ) {
+            c.edges[ c.numEdges ] = _avr->cycle;
+            c.levels[ c.numEdges ] = value;
+            c.numEdges++;
+        }
+    }
+
+
+    // Returns the line level at a given cycle. Idle (high) before the first edge.
+    uint8_t getLevelAt( const Channel& c, const uint64_t cycle )
+    {
+        uint32_t lo{ 0 }, hi{ c.numEdges };
+
+        // find the last edge at or before the cycle
+        while ( lo < hi ) {
+            const uint32_t mid{ ( lo + hi ) / 2 };
+
+            if ( c.edges[ mid ] <= cycle ) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+
+        return lo ? c.levels[ lo - 1 ] : 1;
+    }
+
+
+    struct Decoded {
+        uint32_t numBytes;
+        uint32_t numBad;                                // wrong bytes, or no stop bit
+        int32_t minError;                               // earliest and latest edge, in cycles
+        int32_t maxError;
+    };
+
+
+    // Decodes the channel as 8N1, sampling mid-bit, and checks every byte against the
+    // message sent over and over. Every edge in a frame is also timed against the
+    // frame's start bit.
+    Decoded decode( const Channel& c )
+    {
+        Decoded rc{};
+
+        for ( uint32_t i = 0; i < c.numEdges; ) {
+            // a start bit begins with a falling edge
+            if ( c.levels[ i ] ) {
+                i++;
+                continue;
+            }
+
+            const uint64_t start{ c.edges[ i ] };
+
+            // the run might end mid-byte
+            if ( start + BIT_CYCLES * 10 > _endCycle ) {
+                break;
+            }
+
+            uint8_t byte{ 0 };
+
+            for ( uint8_t bit = 0; bit < 8; bit++ ) {
+                byte |= getLevelAt( c, start + BIT_CYCLES * ( 2 * bit + 3 ) / 2 ) << bit;
+            }
+
+            const bool stopOk{ getLevelAt( c, start + BIT_CYCLES * 19 / 2 ) == 1 };
+
+            if ( !stopOk or byte != c.message[ rc.numBytes % c.messageBytes ] ) {
+                rc.numBad++;
+            }
+
+            rc.numBytes++;
+
+            // time the frame's other edges, up to the middle of the stop bit
+            for ( i++; i < c.numEdges and c.edges[ i ] <= start + BIT_CYCLES * 19 / 2; i++ ) {
+                const uint64_t offset{ c.edges[ i ] - start };
+                const uint64_t bits{ ( offset + BIT_CYCLES / 2 ) / BIT_CYCLES };
+                const int32_t error{ (int32_t) ( (int64_t) offset - (int64_t) ( bits * BIT_CYCLES ) ) };
+
+                rc.minError = error < rc.minError ? error : rc.minError;
+                rc.maxError = error > rc.maxError ? error : rc.maxError;
+            }
+        }
+
+        return rc;
+    }
+
+
+    // Finds the biggest gap between one channel's edges and channel 0's in the same tick
+    uint32_t getSkew( const Channel& c, uint32_t& numPairs )
+    {
+        const Channel& ref{ _channels[ 0 ] };
+        uint32_t maxSkew{ 0 };
+        uint32_t j{ 0 };
+
+        numPairs = 0;
+
+        for ( uint32_t i = 0; i < c.numEdges; i++ ) {
+            while ( j + 1 < ref.numEdges and ref.edges[ j + 1 ] <= c.edges[ i ] ) {
+                j++;
+            }
+
+            for ( uint32_t k = j; k < j + 2 and k < ref.numEdges; k++ ) {
+                const uint64_t a{ c.edges[ i ] }, b{ ref.edges[ k ] };
+                const uint32_t skew{ (uint32_t) ( a > b ? a - b : b - a ) };
+
+                if ( skew < BIT_CYCLES / 2 ) {
+                    maxSkew = skew > maxSkew ? skew : maxSkew;
+                    numPairs++;
+                }
+            }
+        }
+
+        return maxSkew;
+    }
+
+}    // namespace
+
+
+int main( int argc, char** argv )
+{
+    if ( argc < 2 ) {
+        printf( "usage: suartjitter <suartfw.elf> [ms to run] [vcd file]\n" );
+        return 2;
+    }
+
+    const uint32_t runMs{ argc > 2 ? (uint32_t) strtoul( argv[ 2 ], nullptr, 0 ) : 200 };
+    const char* const vcdName{ argc > 3 ? argv[ 3 ] : "suartjitter.vcd" };
+
+    if ( elf_read_firmware( argv[ 1 ], &_firmware ) ) {
+        printf( "suartjitter: can't read %s\n", argv[ 1 ] );
+        return 2;
+    }
+
+    // the zero makefile doesn't add simavr's .mmcu section
+    if ( !_firmware.mmcu[ 0 ] ) strcpy( _firmware.mmcu, "atmega328p" );
+    if ( !_firmware.frequency ) _firmware.frequency = F_CPU;
+
+    _avr = avr_make_mcu_by_name( _firmware.mmcu );
+
+    if ( !_avr ) {
+        printf( "suartjitter: simavr doesn't know %s\n", _firmware.mmcu );
+        return 2;
+    }
+
+    avr_init( _avr );
+    avr_load_firmware( _avr, &_firmware );
+
+    avr_vcd_init( _avr, vcdName, &_vcd, 1000 );
+
+    for ( Channel& c : _channels ) {
+        avr_irq_t* const irq{ avr_io_getirq( _avr, AVR_IOCTL_IOPORT_GETIRQ( 'D' ), c.pin ) };
+
+        c.level = 1;
+        avr_irq_register_notify( irq, onPinChange, &c );
+        avr_vcd_add_signal( &_vcd, irq, 1, c.name );
+    }
+
+    avr_vcd_start( &_vcd );
+
+    const avr_cycle_count_t endCycle{ avr_usec_to_cycles( _avr, runMs * 1000UL ) };
+    int state{ cpu_Running };
+
+    while ( _avr->cycle < endCycle and state != cpu_Done and state != cpu_Crashed ) {
+        state = avr_run( _avr );
+    }
+
+    avr_vcd_stop( &_vcd );
+    _endCycle = _avr->cycle;
+
+    if ( state == cpu_Crashed ) {
+        printf( "suartjitter: FAILED: firmware crashed at cycle %llu\n", (unsigned long long) _avr->cycle );
+        return 1;
+    }
+
+    printf( "suartjitter: %u ms, %u baud, bit-time %u cycles (%.2f%% off nominal), trace in %s\n",
+        runMs, BAUD, BIT_CYCLES, 100.0 * ( (double) BIT_CYCLES * BAUD / F_CPU - 1.0 ), vcdName );
+    printf( "  channel   edges   bytes   bad   jitter min/max cycles   p-p ns   skew to suart0\n" );
+
+    bool ok{ true };
+
+    for ( uint8_t i = 0; i < NUM_CHANNELS; i++ ) {
+        const Channel& c{ _channels[ i ] };
+        uint32_t numPairs{ 0 };
+
+        const Decoded d{ decode( c ) };
+        const uint32_t skew{ i ? getSkew( c, numPairs ) : 0 };
+
+        printf( "  %-8s %6u  %6u  %4u   %+6d / %+6d        %6.0f   ",
+            c.name, c.numEdges, d.numBytes, d.numBad, d.minError, d.maxError,
+            ( d.maxError - d.minError ) * 1e9 / F_CPU );
+
+        if ( i ) {
+            printf( "%u cycles over %u edges\n", skew, numPairs );
+        }
+        else {
+            printf( "-\n" );
+        }
+
+        ok = ok and d.numBytes and !d.numBad;
+    }
+
+    if ( !ok ) {
+        printf( "suartjitter: FAILED: a channel sent nothing, or the wrong bytes\n" );
+        return 1;
+    }
+
+    return 0;
+}
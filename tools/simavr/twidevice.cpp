@@ -0,0 +1,228 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Runs twifw in simavr, against a virtual 24C02-style EEPROM on the TWI bus.
+//
+// The EEPROM answers at address 0x50. Its first written byte sets the word address,
+// which then steps on for every byte written or read. Every bus event is logged, so
+// a failure shows what the Twi master actually did. The run passes when the firmware
+// reports success on PB1, and the EEPROM holds what it was sent.
+//
+//    twidevice <twifw.elf> [ms to run]
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "avr_ioport.h"
+#include "avr_twi.h"
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_time.h"
+
+
+namespace {
+
+    const uint32_t F_CPU{ 16000000UL };
+
+    // as used by twifw.cpp
+    const uint8_t EEPROM_ADDRESS{ 0x50 };
+    const uint8_t WORD_ADDRESS{ 0x10 };
+    const uint8_t DATA[]{ 'z', 'e', 'r', 'o', 0xA5, 0x5A, 0x00, 0xFF };
+
+    // simavr wants these writable
+    const char* _irqNames[ 2 ]{ "8>eeprom.out", "32<eeprom.in" };
+
+    struct Eeprom {
+        avr_irq_t* irq;                                 // our end of the bus
+        uint8_t selected;                               // the address byte we answered, or 0
+        bool haveWordAddress;                           // the first byte written has arrived
+        uint8_t wordAddress;
+        uint8_t memory[ 256 ];
+
+        uint32_t numStarts;
+        uint32_t numStops;
+        uint32_t numNacked;                             // address bytes nobody answered
+        uint32_t bytesWritten;
+        uint32_t bytesRead;
+    };
+
+    avr_t* _avr;
+    elf_firmware_t _firmware;
+    Eeprom _eeprom;
+    uint8_t _done;
+    uint8_t _pass;
+
+
+    void log( const char* const what, const uint8_t value )
+    {
+        printf( "  %10llu  %-6s 0x%02x\n", (unsigned long long) _avr->cycle, what, value );
+    }
+
+
+    // Everything the AVR's TWI puts on the bus arrives here
+    void onBus( avr_irq_t* irq, uint32_t value, void* param )
+    {
+        Eeprom& e{ *(Eeprom*) param };
+        avr_twi_msg_irq_t v;
+
+        (void) irq;
+        v.u.v = value;
+
+        if ( v.u.twi.msg & TWI_COND_STOP ) {
+            log( "stop", 0 );
+            e.numStops++;
+            e.selected = 0;
+        }
+
+        if ( v.u.twi.msg & TWI_COND_START ) {
+            log( "start", v.u.twi.addr );
+            e.numStarts++;
+            e.selected = 0;
+
+            // a new transaction writes the word address again, a read carries on
+            if ( ( v.u.twi.addr >> 1 ) == EEPROM_ADDRESS ) {
+                e.selected = v.u.twi.addr;
+                e.haveWordAddress = e.haveWordAddress and ( v.u.twi.addr & 1 );
+                avr_raise_irq( e.irq + TWI_IRQ_INPUT, avr_twi_irq_msg( TWI_COND_ACK, e.selected, 1 ) );
+            }
+            else {
+                e.numNacked++;
+            }
+        }
+
+        if ( !e.selected ) return;
+
+        if ( v.u.twi.msg & TWI_COND_WRITE ) {
+            log( "write", v.u.twi.data );
+            avr_raise_irq( e.irq + TWI_IRQ_INPUT, avr_twi_irq_msg( TWI_COND_ACK, e.selected, 1 ) );
+
+            if ( !e.haveWordAddress ) {
+                e.wordAddress = v.u.twi.data;
+                e.haveWordAddress = true;
+            }
+            else {
+                e.memory[ e.wordAddress++ ] = v.u.twi.data;
+                e.bytesWritten++;
+            }
+        }
+
+        if ( v.u.twi.msg & TWI_COND_READ ) {
+            const uint8_t data{ e.memory[ e.wordAddress++ ] };
+
+            log( "read", data );
+            avr_raise_irq( e.irq + TWI_IRQ_INPUT, avr_twi_irq_msg( TWI_COND_READ, e.selected, data ) );
+            e.bytesRead++;
+        }
+    }
+
+
+    void onDone( avr_irq_t* irq, uint32_t value, void* param )
+    {
+        (void) irq;
+        (void) param;
+
+        _done = value;
+    }
+
+
+    void onPass( avr_irq_t* irq, uint32_t value, void* param )
+    {
+        (void) irq;
+        (void) param;
+
+        _pass = value;
+    }
+
+}    // namespace
+
+
+int main( int argc, char** argv )
+{
+    if ( argc < 2 ) {
+        printf( "usage: twidevice <twifw.elf> [ms to run]\n" );
+        return 2;
+    }
+
+    const uint32_t runMs{ argc > 2 ? (uint32_t) strtoul( argv[ 2 ], nullptr, 0 ) : 200 };
+
+    if ( elf_read_firmware( argv[ 1 ], &_firmware ) ) {
+        printf( "twidevice: can't read %s\n", argv[ 1 ] );
+        return 2;
+    }
+
+    // the zero makefile doesn't add simavr's .mmcu section
+    if ( !_firmware.mmcu[ 0 ] ) strcpy( _firmware.mmcu, "atmega328p" );
+    if ( !_firmware.frequency ) _firmware.frequency = F_CPU;
+
+    _avr = avr_make_mcu_by_name( _firmware.mmcu );
+
+    if ( !_avr ) {
+        printf( "twidevice: simavr doesn't know %s\n", _firmware.mmcu );
+        return 2;
+    }
+
+    avr_init( _avr );
+    avr_load_firmware( _avr, &_firmware );
+
+    // an erased part
+    memset( _eeprom.memory, 0xFF, sizeof( _eeprom.memory ) );
+
+    // plug the EEPROM into the TWI
+    _eeprom.irq = avr_alloc_irq( &_avr->irq_pool, 0, 2, _irqNames );
+    avr_irq_register_notify( _eeprom.irq + TWI_IRQ_OUTPUT, onBus, &_eeprom );
+    avr_connect_irq( _eeprom.irq + TWI_IRQ_INPUT, avr_io_getirq( _avr, AVR_IOCTL_TWI_GETIRQ( 0 ), TWI_IRQ_INPUT ) );
+    avr_connect_irq( avr_io_getirq( _avr, AVR_IOCTL_TWI_GETIRQ( 0 ), TWI_IRQ_OUTPUT ), _eeprom.irq + TWI_IRQ_OUTPUT );
+
+    avr_irq_register_notify( avr_io_getirq( _avr, AVR_IOCTL_IOPORT_GETIRQ( 'B' ), 0 ), onDone, nullptr );
+    avr_irq_register_notify( avr_io_getirq( _avr, AVR_IOCTL_IOPORT_GETIRQ( 'B' ), 1 ), onPass, nullptr );
+
+    printf( "twidevice: bus log\n" );
+
+    const avr_cycle_count_t endCycle{ avr_usec_to_cycles( _avr, runMs * 1000UL ) };
+    int state{ cpu_Running };
+
+    while ( !_done and _avr->cycle < endCycle and state != cpu_Done and state != cpu_Crashed ) {
+        state = avr_run( _avr );
+    }
+
+    printf( "twidevice: %u starts, %u stops, %u unanswered addresses, %u bytes written, %u read\n",
+        _eeprom.numStarts, _eeprom.numStops, _eeprom.numNacked, _eeprom.bytesWritten, _eeprom.bytesRead );
+
+    if ( state == cpu_Crashed ) {
+        printf( "twidevice: FAILED: firmware crashed at cycle %llu\n", (unsigned long long) _avr->cycle );
+        return 1;
+    }
+
+    if ( !_done ) {
+        printf( "twidevice: FAILED: firmware didn't finish in %u ms\n", runMs );
+        return 1;
+    }
+
+    if ( !_pass ) {
+        printf( "twidevice: FAILED: firmware's checks failed\n" );
+        return 1;
+    }
+
+    if ( memcmp( &_eeprom.memory[ WORD_ADDRESS ], DATA, sizeof( DATA ) ) ) {
+        printf( "twidevice: FAILED: EEPROM doesn't hold what was written\n" );
+        return 1;
+    }
+
+    // one write, one write-read, a chained write-read and read, and the absent device
+    if ( _eeprom.numStarts < 6 or !_eeprom.numNacked ) {
+        printf( "twidevice: FAILED: expected at least 6 starts and an unanswered address\n" );
+        return 1;
+    }
+
+    printf( "twidevice: passed\n" );
+
+    return 0;
+}
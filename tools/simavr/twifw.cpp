@@ -0,0 +1,118 @@
+//
+// zero - pre-emptive multitasking kernel for AVR
+//
+// Techno Cosmic Research Institute    Dirk Mahoney           dirk@tcri.com.au
+// Catchpole Robotics                  Christian Catchpole    christian@catchpole.net
+//
+
+
+// Firmware for twidevice. Talks to the virtual 24C02-style EEPROM that twidevice puts
+// at address 0x50, using each kind of Twi transaction, then sets PB1 if everything
+// checked out and PB0 to say it's finished.
+
+
+#include <string.h>
+
+#include <avr/pgmspace.h>
+
+#include "gpio.h"
+#include "twi.h"
+#include "thread.h"
+
+
+using namespace zero;
+
+
+namespace {
+
+    const uint8_t EEPROM_ADDRESS{ 0x50 };
+    const uint8_t ABSENT_ADDRESS{ 0x51 };
+
+    // keep these in step with twidevice.cpp, which checks the EEPROM afterwards
+    const uint8_t WORD_ADDRESS{ 0x10 };
+    const uint8_t DATA[]{ 'z', 'e', 'r', 'o', 0xA5, 0x5A, 0x00, 0xFF };
+
+
+    // Starts a transaction, waits for it, and checks how it went
+    bool finish( const bool queued, const Synapse& readySyn, const TwiDevice& device, const TwiResult expected )
+    {
+        if ( !queued ) return false;
+
+        readySyn.wait();
+
+        return device.getResult() == expected;
+    }
+
+
+    int testMain()
+    {
+        Gpio done{ ZERO_PINB0 };
+        Gpio pass{ ZERO_PINB1 };
+
+        done.setAsOutput();
+        pass.setAsOutput();
+        done.switchOff();
+        pass.switchOff();
+
+        Synapse eepromSyn;
+        Synapse secondSyn;
+        Synapse absentSyn;
+        Twi twi{ 100000UL };
+        TwiDevice eeprom{ twi, EEPROM_ADDRESS, eepromSyn };
+        TwiDevice second{ twi, EEPROM_ADDRESS, secondSyn };
+        TwiDevice absent{ twi, ABSENT_ADDRESS, absentSyn };
+
+        bool ok{ twi and eeprom and second and absent };
+
+        // write: the word address, then the data
+        uint8_t message[ 1 + sizeof( DATA ) ];
+        message[ 0 ] = WORD_ADDRESS;
+        memcpy( message + 1, DATA, sizeof( DATA ) );
+
+        ok = ok and finish( eeprom.write( message, sizeof( message ) ), eepromSyn, eeprom, TwiResult::Ok );
+
+        // write-then-read with a repeated start
+        uint8_t readBack[ sizeof( DATA ) ]{};
+
+        ok = ok and finish( eeprom.writeRead( &WORD_ADDRESS, 1, readBack, sizeof( readBack ) ),
+            eepromSyn, eeprom, TwiResult::Ok );
+        ok = ok and !memcmp( readBack, DATA, sizeof( DATA ) );
+
+        // two devices queued at once, so the ISR chains the second straight on from the
+        // first. The plain read carries on from where the first left the EEPROM's address.
+        uint8_t firstHalf[ 4 ]{};
+        uint8_t secondHalf[ 4 ]{};
+
+        if ( ok ) {
+            const bool firstQueued{ eeprom.writeRead( &WORD_ADDRESS, 1, firstHalf, sizeof( firstHalf ) ) };
+            const bool secondQueued{ second.read( secondHalf, sizeof( secondHalf ) ) };
+
+            ok = finish( firstQueued, eepromSyn, eeprom, TwiResult::Ok );
+            ok = finish( secondQueued, secondSyn, second, TwiResult::Ok ) and ok;
+            ok = ok and !memcmp( firstHalf, DATA, 4 );
+            ok = ok and !memcmp( secondHalf, DATA + 4, 4 );
+        }
+
+        // nobody home
+        ok = ok and finish( absent.write( &WORD_ADDRESS, 1 ), absentSyn, absent, TwiResult::AddressNack );
+
+        if ( ok ) {
+            pass.switchOn();
+        }
+
+        done.switchOn();
+
+        while ( true ) {
+            me.delay( 1_secs );
+        }
+
+        return 0;
+    }
+
+}    // namespace
+
+
+int main()
+{
+    new Thread( PSTR( "twitest" ), 256, testMain );
+}